@@ -0,0 +1,1085 @@
+// File:        benchmark.cpp
+// Date:        2026-10-17
+// Description: Stand-alone benchmarks for the RedBlackTree and StockSystem classes.
+//              Usage: benchmark [name]   (runs every benchmark but suite when no name is given)
+//                     benchmark suite [file.csv]   (the comparison suite, as CSV on stdout or to file)
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "redblacktree.h"
+#include "compacttree.h"
+#include "stocksystem.h"
+#include "inventorykernels.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// Every heap allocation made by the program goes through this counter.
+// The replacements are kept out of line: inlined, GCC would pair the malloc
+//   of one with the free of the other and warn of mismatched new and delete.
+static long long allocations = 0;
+
+[[gnu::noinline]] void* operator new(size_t bytes) {
+    ++allocations;
+    void* memory = malloc(bytes > 0 ? bytes : 1);
+    if (memory == NULL) {
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+[[gnu::noinline]] void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+[[gnu::noinline]] void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+// nanoseconds elapsed since start
+static double ElapsedNs(Clock::time_point start) {
+    return (double) chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+// n distinct keys in random order
+static vector<int> ShuffledKeys(int n, mt19937& rng) {
+    vector<int> keys(n);
+    for (int i = 0; i < n; i++) {
+        keys[i] = i * 2; // leave gaps so that the tree is not built from a dense range
+    }
+    shuffle(keys.begin(), keys.end(), rng);
+    return keys;
+}
+
+// Remove stress benchmark.
+// Removes random keys from trees of 1k to 1M items in rounds of 1000, putting
+//   each round back (untimed) so the tree keeps its size. The per-remove cost
+//   should only grow with the height of the tree.
+static void BenchRemove() {
+    const int sizes[] = {1000, 10000, 100000, 1000000};
+    const int roundsize = 1000;
+    const int totalremoves = 200000;
+    mt19937 rng(42);
+
+    cout << "remove: items\tns/remove" << endl;
+    for (int s = 0; s < 4; s++) {
+        int n = sizes[s];
+        RedBlackTree<int, IdentityKeyOf, PoolNodeAllocator<Node<int> > > tree;
+        vector<int> keys = ShuffledKeys(n, rng);
+        for (int i = 0; i < n; i++) {
+            tree.Insert(keys[i]);
+        }
+
+        double ns = 0;
+        int removed = 0;
+        vector<int> victims(roundsize);
+        while (removed < totalremoves) {
+            for (int i = 0; i < roundsize; i++) {
+                victims[i] = keys[rng() % n];
+            }
+            Clock::time_point start = Clock::now();
+            for (int i = 0; i < roundsize; i++) {
+                tree.Remove(victims[i]);
+            }
+            ns += ElapsedNs(start);
+            for (int i = 0; i < roundsize; i++) {
+                tree.Insert(victims[i]);
+            }
+            removed += roundsize;
+        }
+        cout << "remove: " << n << "\t" << ns / removed << endl;
+    }
+}
+
+// An item that counts how often it is copied and moved.
+struct CountedItem {
+    static long long copies;
+    static long long moves;
+    int key;
+
+    CountedItem(int k) : key(k) {
+    }
+    CountedItem(const CountedItem& item) : key(item.key) {
+        ++copies;
+    }
+    CountedItem(CountedItem&& item) : key(item.key) {
+        ++moves;
+    }
+    CountedItem& operator=(const CountedItem& item) {
+        key = item.key;
+        ++copies;
+        return *this;
+    }
+    bool operator<(const CountedItem& item) const {
+        return key < item.key;
+    }
+    bool operator==(const CountedItem& item) const {
+        return key == item.key;
+    }
+};
+
+long long CountedItem::copies = 0;
+long long CountedItem::moves = 0;
+
+// Insert allocation benchmark.
+// Counts the heap allocations, copies and moves made per insert by each way
+//   of adding an item: a tree with one new/delete per node should make
+//   exactly one allocation and at most one copy, a pooled tree one allocation
+//   per slab, and StockNewItem none for the description.
+static void BenchInsert() {
+    const int n = 100000;
+    mt19937 rng(42);
+    vector<int> keys = ShuffledKeys(n, rng);
+
+    cout << "insert: path	allocs/insert	copies/insert	moves/insert	ns/insert" << endl;
+    for (int path = 0; path < 3; path++) {
+        const char* names[] = {"Insert(const T&)", "Insert(T&&)", "Emplace"};
+        RedBlackTree<CountedItem> tree;
+        vector<CountedItem> items(keys.begin(), keys.end());
+        CountedItem::copies = 0;
+        CountedItem::moves = 0;
+        long long before = allocations;
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < n; i++) {
+            if (path == 0) {
+                tree.Insert(items[i]);
+            } else if (path == 1) {
+                tree.Insert(move(items[i]));
+            } else {
+                tree.Emplace(keys[i]);
+            }
+        }
+        double ns = ElapsedNs(start);
+        cout << "insert: " << names[path] << "	" << (double) (allocations - before) / n << "	"
+            << (double) CountedItem::copies / n << "	" << (double) CountedItem::moves / n << "	" << ns / n << endl;
+    }
+
+    StockSystem store;
+    long long before = allocations;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < n; i++) {
+        store.StockNewItem(StockItem(10000 + keys[i] % 90000, "a description of thirty chars", 1.5));
+    }
+    double ns = ElapsedNs(start);
+    cout << "insert: StockNewItem(StockItem&&)	" << (double) (allocations - before) / n << "	-	-	" << ns / n << endl;
+}
+
+// Aggregation kernel benchmark.
+// Runs the inventory kernels over columns of 1M items and reports the
+//   throughput in bytes read per nanosecond (GB/s).
+static void BenchAggregate() {
+    const int n = 1000000;
+    const int repeats = 50;
+    mt19937 rng(42);
+    vector<double> prices(n);
+    vector<int> stocks(n);
+    for (int i = 0; i < n; i++) {
+        prices[i] = (rng() % 10000) / 100.0;
+        stocks[i] = rng() % 1001;
+    }
+
+    double value = 0;
+    long long units = 0;
+    size_t below = 0;
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < repeats; r++) {
+        value += SumPriceTimesStock(prices.data(), stocks.data(), n);
+    }
+    double valuens = ElapsedNs(start) / repeats;
+    start = Clock::now();
+    for (int r = 0; r < repeats; r++) {
+        units += SumUnits(stocks.data(), n);
+    }
+    double unitsns = ElapsedNs(start) / repeats;
+    start = Clock::now();
+    for (int r = 0; r < repeats; r++) {
+        below += CountBelow(stocks.data(), n, 1);
+    }
+    double belowns = ElapsedNs(start) / repeats;
+
+    cout << "aggregate: items=" << n << " avx2=" << KernelsUseAVX2() << endl;
+    cout << "aggregate: InventoryValue\t" << valuens / n << " ns/item\t" << n * 12.0 / valuens << " GB/s" << endl;
+    cout << "aggregate: TotalUnits\t" << unitsns / n << " ns/item\t" << n * 4.0 / unitsns << " GB/s" << endl;
+    cout << "aggregate: CountBelow\t" << belowns / n << " ns/item\t" << n * 4.0 / belowns << " GB/s" << endl;
+    if (value < 0 || units < 0 || below > (size_t) n * repeats) { // Keep the results alive.
+        cout << "aggregate: unexpected result" << endl;
+    }
+}
+
+// Batch benchmark.
+// Applies the same random stream of sells, restocks and price edits to a
+//   50k item catalogue, once with one call per operation and once through
+//   ApplyBatch at batch sizes of 1, 16, 256 and 4096.
+static void BenchBatch() {
+    const int items = 50000;
+    const int totalops = 1 << 20;
+    const int batchsizes[] = {1, 16, 256, 4096};
+    mt19937 rng(42);
+
+    vector<StockOperation> ops(totalops);
+    for (int i = 0; i < totalops; i++) {
+        ops[i].code = (StockOpCode) (rng() % 3 == 0 ? RESTOCK_OP : SELL_OP);
+        if (rng() % 50 == 0) {
+            ops[i].code = EDIT_PRICE_OP;
+        }
+        ops[i].itemsku = 10000 + rng() % 90000;
+        ops[i].quantity = 1 + rng() % 20;
+        ops[i].price = (rng() % 1000) / 100.0;
+    }
+
+    cout << "batch: batchsize\tper-call ops/s\tApplyBatch ops/s" << endl;
+    for (int b = 0; b < 4; b++) {
+        int batchsize = batchsizes[b];
+        StockSystem percall;
+        StockSystem batched;
+        mt19937 itemrng(7);
+        for (int i = 0; i < items; i++) {
+            StockItem item(10000 + itemrng() % 90000, "item", (itemrng() % 10000) / 100.0);
+            percall.StockNewItem(item);
+            batched.StockNewItem(item);
+        }
+
+        // Both paths replay the stream three times, alternating, and the best pass counts.
+        double percallns = 0;
+        double batchns = 0;
+        vector<char> results(batchsize);
+        for (int pass = 0; pass < 3; pass++) {
+            Clock::time_point start = Clock::now();
+            for (int i = 0; i < totalops; i++) {
+                const StockOperation& op = ops[i];
+                if (op.code == SELL_OP) {
+                    percall.Sell(op.itemsku, op.quantity);
+                } else if (op.code == RESTOCK_OP) {
+                    percall.Restock(op.itemsku, op.quantity, op.price);
+                } else {
+                    percall.EditStockItemPrice(op.itemsku, op.price);
+                }
+            }
+            double ns = ElapsedNs(start);
+            if (pass == 0 || ns < percallns) {
+                percallns = ns;
+            }
+
+            start = Clock::now();
+            for (int i = 0; i < totalops; i += batchsize) {
+                batched.ApplyBatch(span<const StockOperation>(&ops[i], batchsize), span<bool>((bool*) results.data(), batchsize));
+            }
+            ns = ElapsedNs(start);
+            if (pass == 0 || ns < batchns) {
+                batchns = ns;
+            }
+        }
+
+        cout << "batch: " << batchsize << "\t" << totalops / percallns * 1e9 << "\t" << totalops / batchns * 1e9 << endl;
+        if (percall.GetBalance() != batched.GetBalance()) {
+            cout << "batch: balances differ" << endl;
+        }
+    }
+}
+
+// Catalogue output benchmark.
+// Prints a 90k item catalogue as one string with GetCatalogue, and streams it
+//   with WriteCatalogue to /dev/null, both as a whole and one 50 row page.
+static void BenchCatalogue() {
+    const int items = 90000;
+    const int repeats = 10;
+    StockSystem store;
+    for (int i = 0; i < items; i++) {
+        store.StockNewItem(StockItem(10000 + i, "catalogue item " + to_string(i), (i % 10000) / 100.0));
+        store.Restock(10000 + i, i % 1000, 0);
+    }
+    int devnull = open("/dev/null", O_WRONLY);
+
+    size_t bytes = 0;
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < repeats; r++) {
+        bytes += store.GetCatalogue().size();
+    }
+    double stringns = ElapsedNs(start) / repeats;
+    start = Clock::now();
+    for (int r = 0; r < repeats; r++) {
+        store.WriteCatalogue(devnull);
+    }
+    double streamns = ElapsedNs(start) / repeats;
+    CatalogueOptions page;
+    page.offset = items / 2;
+    page.limit = 50;
+    start = Clock::now();
+    for (int r = 0; r < repeats * 100; r++) {
+        store.WriteCatalogue(devnull, page);
+    }
+    double pagens = ElapsedNs(start) / (repeats * 100);
+    close(devnull);
+
+    cout << "catalogue: items=" << items << " bytes=" << bytes / repeats << endl;
+    cout << "catalogue: GetCatalogue\t" << stringns / 1e6 << " ms" << endl;
+    cout << "catalogue: WriteCatalogue\t" << streamns / 1e6 << " ms" << endl;
+    cout << "catalogue: WriteCatalogue 50 rows at offset " << page.offset << "\t" << pagens / 1e3 << " us" << endl;
+}
+
+// Snapshot benchmark.
+// Saves a full catalogue (every 5 digit SKU) and loads it back into each
+//   storage engine, against re-entering the items with StockNewItem.
+static void BenchSnapshot() {
+    const char* path = "benchmark.snapshot";
+    StockSystem store;
+    for (int sku = SKU_MIN; sku <= SKU_MAX; sku++) {
+        store.StockNewItem(StockItem(sku, "snapshot item", (sku % 10000) / 100.0));
+    }
+
+    Clock::time_point start = Clock::now();
+    bool saved = store.SaveSnapshot(path);
+    double savens = ElapsedNs(start);
+    cout << "snapshot: items=" << SKU_COUNT << " saved=" << saved << "\t" << savens / 1e6 << " ms" << endl;
+
+    const StockStorage engines[] = {TREE_STORAGE, TABLE_STORAGE, SUMMARY_TREE_STORAGE};
+    const char* names[] = {"tree", "table", "summary tree"};
+    for (int e = 0; e < 3; e++) {
+        StockSystem loaded(engines[e]);
+        start = Clock::now();
+        bool ok = loaded.LoadSnapshot(path);
+        double loadns = ElapsedNs(start);
+
+        StockSystem entered(engines[e]);
+        start = Clock::now();
+        store.ForEachItem([&](const StockItem& item) {
+            entered.StockNewItem(item);
+        });
+        double enterns = ElapsedNs(start);
+        cout << "snapshot: " << names[e] << " LoadSnapshot\t" << loadns / 1e6 << " ms (ok=" << ok << ")\tStockNewItem\t" << enterns / 1e6 << " ms" << endl;
+    }
+    remove(path);
+}
+
+// Bulk load benchmark.
+// Builds a tree of 1M sorted keys with Insert, one key at a time, and with
+//   BuildFromSorted.
+static void BenchBulkLoad() {
+    const int n = 1000000;
+    vector<int> keys(n);
+    for (int i = 0; i < n; i++) {
+        keys[i] = i * 2;
+    }
+
+    RedBlackTree<int, IdentityKeyOf, PoolNodeAllocator<Node<int> > > inserted;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < n; i++) {
+        inserted.Insert(keys[i]);
+    }
+    double insertns = ElapsedNs(start);
+
+    RedBlackTree<int, IdentityKeyOf, PoolNodeAllocator<Node<int> > > built;
+    start = Clock::now();
+    built.BuildFromSorted(keys.begin(), keys.end());
+    double buildns = ElapsedNs(start);
+
+    cout << "bulkload: items=" << n << endl;
+    cout << "bulkload: Insert\t" << insertns / 1e6 << " ms\theight=" << inserted.Height() << endl;
+    cout << "bulkload: BuildFromSorted\t" << buildns / 1e6 << " ms\theight=" << built.Height() << endl;
+}
+
+// Copy benchmark.
+// Copies a tree of 1M items by cloning and with copy-on-write (where the
+//   clone is paid by the first change instead), and a full StockSystem both ways.
+static void BenchCopy() {
+    typedef RedBlackTree<int, IdentityKeyOf, PoolNodeAllocator<Node<int> > > PooledTree;
+    const int n = 1000000;
+    vector<int> keys(n);
+    for (int i = 0; i < n; i++) {
+        keys[i] = i * 2;
+    }
+    PooledTree tree;
+    tree.BuildFromSorted(keys.begin(), keys.end());
+
+    for (int cow = 0; cow < 2; cow++) {
+        tree.SetCopyOnWrite(cow == 1);
+        Clock::time_point start = Clock::now();
+        PooledTree copy(tree);
+        double copyns = ElapsedNs(start);
+        start = Clock::now();
+        tree.Insert(-1);
+        double writens = ElapsedNs(start);
+        tree.Remove(-1);
+        cout << "copy: tree items=" << n << (cow ? " copy-on-write" : " clone") << "\tcopy " << copyns / 1e6
+            << " ms\tfirst Insert " << writens / 1e6 << " ms" << endl;
+    }
+
+    StockSystem store;
+    for (int sku = SKU_MIN; sku <= SKU_MAX; sku++) {
+        store.StockNewItem(StockItem(sku, "copy item", 1.0));
+    }
+    for (int cow = 0; cow < 2; cow++) {
+        store.SetCopyOnWrite(cow == 1);
+        Clock::time_point start = Clock::now();
+        StockSystem report(store);
+        double copyns = ElapsedNs(start);
+        cout << "copy: StockSystem items=" << SKU_COUNT << (cow ? " copy-on-write" : " clone") << "\t" << copyns / 1e6 << " ms" << endl;
+    }
+}
+
+// Journal benchmark.
+// Sales per second with the journal off, and on with groups of 1
+//   (an fdatasync per sale), 64 and 1024 records per sync.
+static void BenchJournal() {
+    const char* path = "benchmark.journal";
+    const int sales = 20000;
+    mt19937 rng(16);
+    uniform_int_distribution<int> pick(SKU_MIN, SKU_MIN + 999);
+
+    const unsigned int groups[] = {0, 1, 64, 1024}; // 0 is the journal off
+    for (unsigned int group : groups) {
+        StockSystem store;
+        for (int sku = SKU_MIN; sku < SKU_MIN + 1000; sku++) {
+            store.StockNewItem(StockItem(sku, "journal item", 1.0));
+            store.Restock(sku, 1000, 0.01);
+        }
+        remove(path);
+        if (group > 0) {
+            JournalPolicy policy;
+            policy.syncevery = group;
+            policy.syncmicroseconds = 0;
+            store.EnableJournal(path, policy);
+        }
+        int count = group == 1 ? sales / 10 : sales; // a sync per sale is slow, time fewer
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < count; i++) {
+            store.Sell(pick(rng), 1);
+        }
+        store.CommitJournal();
+        double ns = ElapsedNs(start);
+        if (group == 0) {
+            cout << "journal: off\t";
+        } else {
+            cout << "journal: sync every " << group << "\t";
+        }
+        cout << count / (ns / 1e9) << " sales/s\t" << ns / count << " ns/op" << endl;
+    }
+    remove(path);
+}
+
+// Versions benchmark.
+// Sell throughput of the versioned engine (a path copy per sale) against the
+//   in-place engines, the cost of Snapshot on each engine, and the sales made
+//   while another thread formats a snapshot of the same store.
+static void BenchVersions() {
+    const int sales = 1000000;
+    const StockStorage engines[] = {TREE_STORAGE, SUMMARY_TREE_STORAGE, VERSIONED_TREE_STORAGE};
+    const char* names[] = {"tree", "summary tree", "versioned tree"};
+    mt19937 rng(19);
+    uniform_int_distribution<int> pick(SKU_MIN, SKU_MAX);
+
+    for (int e = 0; e < 3; e++) {
+        StockSystem store(engines[e]);
+        for (int sku = SKU_MIN; sku <= SKU_MAX; sku++) {
+            store.StockNewItem(StockItem(sku, "version item", 1.0));
+            store.Restock(sku, 1000, 0.01);
+        }
+        long long before = allocations;
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < sales; i++) {
+            store.Sell(pick(rng), 1);
+        }
+        double sellns = ElapsedNs(start);
+        double sellallocs = (double) (allocations - before) / sales;
+        start = Clock::now();
+        CatalogueView view = store.Snapshot();
+        double snapns = ElapsedNs(start);
+        cout << "versions: " << names[e] << " items=" << SKU_COUNT << "	Sell " << sellns / sales << " ns/op, "
+            << sellallocs << " allocs/op	Snapshot " << snapns / 1e3 << " us" << endl;
+    }
+
+    StockSystem store(VERSIONED_TREE_STORAGE);
+    for (int sku = SKU_MIN; sku <= SKU_MAX; sku++) {
+        store.StockNewItem(StockItem(sku, "version item", 1.0));
+        store.Restock(sku, 1000, 0.01);
+    }
+    CatalogueView view = store.Snapshot();
+    atomic<int> reports(0);
+    thread reader([&] {
+        for (int i = 0; i < 5; i++) {
+            reports += view.GetCatalogue().empty() ? 0 : 1;
+        }
+    });
+    int sold = 0;
+    Clock::time_point start = Clock::now();
+    while (reports < 5) {
+        store.Sell(pick(rng), 1);
+        ++sold;
+    }
+    reader.join();
+    double ns = ElapsedNs(start);
+    cout << "versions: Sell during 5 catalogue reports of a snapshot	" << sold << " sales, " << ns / sold << " ns/op" << endl;
+}
+
+// Compact tree benchmark.
+// Node size, random inserts and random searches of the pooled RedBlackTree
+//   against CompactRedBlackTree, whose nodes sit in one vector, at 1k to 1M
+//   items, then the searches again once Compact has laid the nodes out. The
+//   larger the tree, the more a descent waits on cache misses.
+static void BenchCompact() {
+    const int sizes[] = {1000, 100000, 1000000};
+    const int searches = 1000000;
+    mt19937 rng(25);
+
+    for (int n : sizes) {
+        vector<int> keys = ShuffledKeys(n, rng);
+        vector<int> lookups(searches);
+        for (int i = 0; i < searches; i++) {
+            lookups[i] = keys[rng() % n];
+        }
+
+        RedBlackTree<int, IdentityKeyOf, PoolNodeAllocator<Node<int> > > tree;
+        Clock::time_point start = Clock::now();
+        for (int key : keys) {
+            tree.Insert(key);
+        }
+        double treeinsertns = ElapsedNs(start) / n;
+        long long found = 0;
+        start = Clock::now();
+        for (int key : lookups) {
+            found += tree.Search(key);
+        }
+        double treesearchns = ElapsedNs(start) / searches;
+
+        CompactRedBlackTree<int> compact;
+        start = Clock::now();
+        for (int key : keys) {
+            compact.Insert(key);
+        }
+        double compactinsertns = ElapsedNs(start) / n;
+        start = Clock::now();
+        for (int key : lookups) {
+            found += compact.Search(key);
+        }
+        double compactsearchns = ElapsedNs(start) / searches;
+        compact.Compact();
+        start = Clock::now();
+        for (int key : lookups) {
+            found += compact.Search(key);
+        }
+        double compactedsearchns = ElapsedNs(start) / searches;
+
+        if (found != 3LL * searches) {
+            cout << "compact: unexpected result" << endl;
+        }
+        cout << "compact: items=" << n << "\tnode bytes " << sizeof(Node<int>) << " -> " << sizeof(CompactNode<int>)
+            << "\tInsert " << treeinsertns << " -> " << compactinsertns << " ns/op"
+            << "\tSearch " << treesearchns << " -> " << compactsearchns << " -> " << compactedsearchns << " after Compact ns/op" << endl;
+    }
+}
+
+// Key distributions of the suite benchmark
+enum KeyOrder {
+    UNIFORM_KEYS, // any key, equally likely (inserts and removes in random order)
+    SEQUENTIAL_KEYS, // ascending, wrapping around (inserts and removes in ascending order)
+    ZIPF_KEYS // the key of rank r with probability proportional to 1/r (lookups only)
+};
+
+static const char* const keyOrderNames[] = {"uniform", "sequential", "zipf"};
+
+// count keys drawn from keys under order. The Zipf ranks are given to the
+//   keys in random order, so the hot keys are spread over the whole tree.
+static vector<int> DrawKeys(const vector<int>& keys, KeyOrder order, int count, mt19937& rng) {
+    vector<int> drawn(count);
+    int n = keys.size();
+    if (order == UNIFORM_KEYS) {
+        uniform_int_distribution<int> pick(0, n - 1);
+        for (int i = 0; i < count; i++) {
+            drawn[i] = keys[pick(rng)];
+        }
+    } else if (order == SEQUENTIAL_KEYS) {
+        for (int i = 0; i < count; i++) {
+            drawn[i] = keys[i % n];
+        }
+    } else {
+        vector<int> ranked(keys);
+        shuffle(ranked.begin(), ranked.end(), rng);
+        vector<double> cumulative(n);
+        double total = 0;
+        for (int r = 0; r < n; r++) {
+            total += 1.0 / (r + 1);
+            cumulative[r] = total;
+        }
+        uniform_real_distribution<double> pick(0, total);
+        for (int i = 0; i < count; i++) {
+            int r = lower_bound(cumulative.begin(), cumulative.end(), pick(rng)) - cumulative.begin();
+            drawn[i] = ranked[r < n ? r : n - 1];
+        }
+    }
+    return drawn;
+}
+
+// The containers compared by the suite, with the same small interface.
+typedef RedBlackTree<StockItem, SkuKeyOf> SuiteItemTree;
+typedef map<int, StockItem> SuiteItemMap;
+typedef RedBlackTree<int> SuiteIntTree;
+typedef set<int> SuiteIntSet;
+typedef CompactRedBlackTree<StockItem, SkuKeyOf> SuiteItemCompact;
+typedef CompactRedBlackTree<int> SuiteIntCompact;
+
+static int KeyOfValue(const StockItem& item) {
+    return item.GetSKU();
+}
+
+static int KeyOfValue(int value) {
+    return value;
+}
+
+static bool SuiteInsert(SuiteItemTree& tree, const StockItem& item) {
+    return tree.Insert(item);
+}
+
+static bool SuiteInsert(SuiteItemMap& items, const StockItem& item) {
+    return items.emplace(item.GetSKU(), item).second;
+}
+
+static bool SuiteInsert(SuiteIntTree& tree, int value) {
+    return tree.Insert(value);
+}
+
+static bool SuiteInsert(SuiteItemCompact& tree, const StockItem& item) {
+    return tree.Insert(item);
+}
+
+static bool SuiteInsert(SuiteIntCompact& tree, int value) {
+    return tree.Insert(value);
+}
+
+static bool SuiteInsert(SuiteIntSet& values, int value) {
+    return values.insert(value).second;
+}
+
+template <class C>
+static bool SuiteRemove(C& container, int key) {
+    return container.Remove(key);
+}
+
+static bool SuiteRemove(SuiteItemMap& items, int key) {
+    return items.erase(key) > 0;
+}
+
+static bool SuiteRemove(SuiteIntSet& values, int key) {
+    return values.erase(key) > 0;
+}
+
+static StockItem* SuiteFind(SuiteItemTree& tree, int key) {
+    return tree.Retrieve(key);
+}
+
+static StockItem* SuiteFind(SuiteItemMap& items, int key) {
+    SuiteItemMap::iterator found = items.find(key);
+    return found == items.end() ? NULL : &found->second;
+}
+
+static const int* SuiteFind(SuiteIntTree& tree, int key) {
+    return tree.Retrieve(key);
+}
+
+static StockItem* SuiteFind(SuiteItemCompact& tree, int key) {
+    return tree.Retrieve(key);
+}
+
+static const int* SuiteFind(SuiteIntCompact& tree, int key) {
+    return tree.Retrieve(key);
+}
+
+static const int* SuiteFind(SuiteIntSet& values, int key) {
+    SuiteIntSet::iterator found = values.find(key);
+    return found == values.end() ? NULL : &*found;
+}
+
+// a new array of every value in ascending order, as RedBlackTree::Dump
+template <class V, class C>
+static V* SuiteDump(const C& container, int& arrsize) {
+    return container.Dump(arrsize);
+}
+
+template <>
+StockItem* SuiteDump<StockItem, SuiteItemMap>(const SuiteItemMap& items, int& arrsize) {
+    arrsize = items.size();
+    StockItem* contents = new StockItem[arrsize];
+    int index = 0;
+    for (const pair<const int, StockItem>& entry : items) {
+        contents[index++] = entry.second;
+    }
+    return contents;
+}
+
+template <>
+int* SuiteDump<int, SuiteIntSet>(const SuiteIntSet& values, int& arrsize) {
+    arrsize = values.size();
+    int* contents = new int[arrsize];
+    copy(values.begin(), values.end(), contents);
+    return contents;
+}
+
+// The bodies of StockSystem::SellItem and RestockItem, on an item found in
+//   any container, so the suite compares the containers and nothing else.
+static bool SellFrom(StockItem* item, unsigned int quantity, double& balance) {
+    if (item == NULL) {
+        return false;
+    }
+    unsigned int stock = item->GetStock();
+    unsigned int sold = quantity < stock ? quantity : stock;
+    balance += sold * item->GetPrice();
+    item->SetStock(stock - sold);
+    return true;
+}
+
+static bool RestockFrom(StockItem* item, unsigned int quantity, double unitprice, double& balance) {
+    if (item == NULL) {
+        return false;
+    }
+    unsigned int space = 1000 - item->GetStock();
+    unsigned int bought = quantity < space ? quantity : space;
+    if (balance - bought * unitprice < 0) {
+        return false;
+    }
+    balance -= bought * unitprice;
+    item->SetStock(item->GetStock() + bought);
+    return true;
+}
+
+// Writes the catalogue text of any container, as StockSystem::GetCatalogue.
+template <class C>
+static string SuiteCatalogue(const C& tree) {
+    ostringstream text;
+    CatalogueWriter writer(text);
+    writer.WriteHeader();
+    tree.ForEach([&](const StockItem& item) {
+        writer.WriteRow(item);
+    });
+    writer.Flush();
+    return text.str();
+}
+
+static string SuiteCatalogue(const SuiteItemMap& items) {
+    ostringstream text;
+    CatalogueWriter writer(text);
+    writer.WriteHeader();
+    for (const pair<const int, StockItem>& entry : items) {
+        writer.WriteRow(entry.second);
+    }
+    writer.Flush();
+    return text.str();
+}
+
+// Collects the measurements of the suite and prints them as CSV, one row
+//   per measurement. A measurement may be made of several Start/Stop spans,
+//   so untimed set-up can run between them.
+class SuiteReport {
+private:
+    ostream& out;
+    const char* workload;
+    const char* container;
+    int items;
+    Clock::time_point start;
+    long long startallocs;
+    double ns; // timed so far in this measurement
+    long long allocs; // allocations so far in this measurement
+
+public:
+    explicit SuiteReport(ostream& stream) : out(stream), workload(""), container(""), items(0), startallocs(0), ns(0), allocs(0) {
+        out << "workload,container,operation,distribution,items,ops,ns_per_op,allocs_per_op" << endl;
+    }
+
+    // names the rows that follow
+    void Begin(const char* workloadname, const char* containername, int n) {
+        workload = workloadname;
+        container = containername;
+        items = n;
+    }
+
+    void Start() {
+        startallocs = allocations;
+        start = Clock::now();
+    }
+
+    void Stop() {
+        ns += ElapsedNs(start);
+        allocs += allocations - startallocs;
+    }
+
+    // prints the measurement of ops operations and starts a new one
+    void Row(const char* operation, const char* distribution, long long ops) {
+        out << workload << "," << container << "," << operation << "," << distribution << "," << items << "," << ops
+            << "," << ns / ops << "," << (double) allocs / ops << endl;
+        ns = 0;
+        allocs = 0;
+    }
+};
+
+// Insert, remove, search and dump on containers of the given values. Small
+//   containers are built and emptied several times, so that every row covers
+//   at least SUITE_MIN_OPS operations.
+#define SUITE_MIN_OPS 200000
+
+template <class C, class V>
+static void SuiteContainer(SuiteReport& report, const vector<V>& values, mt19937& rng) {
+    int n = values.size();
+    int repeats = SUITE_MIN_OPS / n > 1 ? SUITE_MIN_OPS / n : 1;
+    vector<int> keys(n);
+    for (int i = 0; i < n; i++) {
+        keys[i] = KeyOfValue(values[i]);
+    }
+    vector<V> shuffled(values);
+    shuffle(shuffled.begin(), shuffled.end(), rng);
+
+    for (int order = UNIFORM_KEYS; order <= SEQUENTIAL_KEYS; order++) {
+        const vector<V>& sequence = order == UNIFORM_KEYS ? shuffled : values;
+        for (int r = 0; r < repeats; r++) {
+            C container;
+            report.Start();
+            for (int i = 0; i < n; i++) {
+                SuiteInsert(container, sequence[i]);
+            }
+            report.Stop();
+        }
+        report.Row("insert", keyOrderNames[order], (long long) n * repeats);
+
+        for (int r = 0; r < repeats; r++) {
+            C container;
+            for (int i = 0; i < n; i++) {
+                SuiteInsert(container, shuffled[i]);
+            }
+            report.Start();
+            for (int i = 0; i < n; i++) {
+                SuiteRemove(container, KeyOfValue(sequence[i]));
+            }
+            report.Stop();
+        }
+        report.Row("remove", keyOrderNames[order], (long long) n * repeats);
+    }
+
+    C container;
+    for (int i = 0; i < n; i++) {
+        SuiteInsert(container, shuffled[i]);
+    }
+    long long found = 0;
+    for (int order = UNIFORM_KEYS; order <= ZIPF_KEYS; order++) {
+        vector<int> lookups = DrawKeys(keys, (KeyOrder) order, SUITE_MIN_OPS, rng);
+        report.Start();
+        for (int key : lookups) {
+            found += SuiteFind(container, key) != NULL;
+        }
+        report.Stop();
+        report.Row("search", keyOrderNames[order], SUITE_MIN_OPS);
+    }
+
+    int dumps = repeats < 10 ? 10 : repeats;
+    for (int r = 0; r < dumps; r++) {
+        int arrsize;
+        report.Start();
+        V* contents = SuiteDump<V>(container, arrsize);
+        delete[] contents;
+        report.Stop();
+        found += arrsize;
+    }
+    report.Row("dump", "all", (long long) n * dumps); // per item dumped
+    if (found < 0) {
+        cout << "suite: unexpected result" << endl;
+    }
+}
+
+// Sell, restock and catalogue generation on a catalogue of n items, with
+//   the container bodies above and through StockSystem itself.
+template <class C>
+static void SuiteStore(SuiteReport& report, const vector<StockItem>& items, mt19937& rng) {
+    int n = items.size();
+    vector<int> keys(n);
+    for (int i = 0; i < n; i++) {
+        keys[i] = items[i].GetSKU();
+    }
+    C container;
+    for (const StockItem& item : items) {
+        SuiteInsert(container, item);
+    }
+    double balance = 100000.00;
+
+    for (int order = UNIFORM_KEYS; order <= ZIPF_KEYS; order++) {
+        vector<int> lookups = DrawKeys(keys, (KeyOrder) order, SUITE_MIN_OPS, rng);
+        report.Start();
+        for (int key : lookups) {
+            RestockFrom(SuiteFind(container, key), 5, 0.01, balance);
+        }
+        report.Stop();
+        report.Row("restock", keyOrderNames[order], SUITE_MIN_OPS);
+        report.Start();
+        for (int key : lookups) {
+            SellFrom(SuiteFind(container, key), 3, balance);
+        }
+        report.Stop();
+        report.Row("sell", keyOrderNames[order], SUITE_MIN_OPS);
+    }
+
+    int repeats = SUITE_MIN_OPS / n > 10 ? SUITE_MIN_OPS / n : 10;
+    size_t bytes = 0;
+    report.Start();
+    for (int r = 0; r < repeats; r++) {
+        bytes += SuiteCatalogue(container).size();
+    }
+    report.Stop();
+    report.Row("catalogue", "all", (long long) n * repeats); // per item listed
+    if (bytes == 0 || balance < 0) {
+        cout << "suite: unexpected result" << endl;
+    }
+}
+
+// The same as SuiteStore, through the public calls of a StockSystem.
+static void SuiteStockSystem(SuiteReport& report, const vector<StockItem>& items, mt19937& rng) {
+    int n = items.size();
+    vector<int> keys(n);
+    for (int i = 0; i < n; i++) {
+        keys[i] = items[i].GetSKU();
+    }
+    StockSystem store;
+    store.BulkLoad(items);
+
+    for (int order = UNIFORM_KEYS; order <= ZIPF_KEYS; order++) {
+        vector<int> lookups = DrawKeys(keys, (KeyOrder) order, SUITE_MIN_OPS, rng);
+        report.Start();
+        for (int key : lookups) {
+            store.Restock(key, 5, 0.01);
+        }
+        report.Stop();
+        report.Row("restock", keyOrderNames[order], SUITE_MIN_OPS);
+        report.Start();
+        for (int key : lookups) {
+            store.Sell(key, 3);
+        }
+        report.Stop();
+        report.Row("sell", keyOrderNames[order], SUITE_MIN_OPS);
+    }
+
+    int repeats = SUITE_MIN_OPS / n > 10 ? SUITE_MIN_OPS / n : 10;
+    size_t bytes = 0;
+    report.Start();
+    for (int r = 0; r < repeats; r++) {
+        bytes += store.GetCatalogue().size();
+    }
+    report.Stop();
+    report.Row("catalogue", "all", (long long) n * repeats);
+    if (bytes == 0) {
+        cout << "suite: unexpected result" << endl;
+    }
+}
+
+// Suite benchmark.
+// Runs the same workloads on RedBlackTree, CompactRedBlackTree and on
+//   std::map / std::set, and writes one CSV row per measurement (see
+//   SuiteReport) to out, for tracking regressions:
+//   - "item": RedBlackTree<StockItem, SkuKeyOf> and its compact variant
+//     against map<int, StockItem>,
+//     insert, remove, search and dump, then sell, restock and catalogue
+//     with the bodies of StockSystem, and the same through StockSystem.
+//     A catalogue holds at most SKU_COUNT items, so the largest size is
+//     SKU_COUNT (90k) rather than 100k, and there is no 1M size.
+//   - "int": RedBlackTree<int> and CompactRedBlackTree<int> against
+//     set<int>, insert, remove, search and dump at 1k, 100k and 1M items.
+// Inserts and removes run in uniform (random) and sequential (ascending)
+//   order; lookups draw uniform, sequential and Zipf distributed keys.
+// ns_per_op and allocs_per_op of dump and catalogue are per item.
+static void BenchSuite(ostream& out) {
+    SuiteReport report(out);
+    mt19937 rng(22);
+
+    const int itemsizes[] = {1000, SKU_COUNT};
+    for (int size : itemsizes) {
+        vector<StockItem> items;
+        for (int i = 0; i < size; i++) {
+            int sku = SKU_MIN + (int) ((long long) i * SKU_COUNT / size); // spread over the SKU range
+            items.push_back(StockItem(sku, "suite item " + to_string(i), (i % 10000) / 100.0));
+        }
+        report.Begin("item", "RedBlackTree", size);
+        SuiteContainer<SuiteItemTree>(report, items, rng);
+        SuiteStore<SuiteItemTree>(report, items, rng);
+        report.Begin("item", "CompactRedBlackTree", size);
+        SuiteContainer<SuiteItemCompact>(report, items, rng);
+        SuiteStore<SuiteItemCompact>(report, items, rng);
+        report.Begin("item", "std::map", size);
+        SuiteContainer<SuiteItemMap>(report, items, rng);
+        SuiteStore<SuiteItemMap>(report, items, rng);
+        report.Begin("item", "StockSystem", size);
+        SuiteStockSystem(report, items, rng);
+    }
+
+    const int intsizes[] = {1000, 100000, 1000000};
+    for (int size : intsizes) {
+        vector<int> values(size);
+        for (int i = 0; i < size; i++) {
+            values[i] = i * 2;
+        }
+        report.Begin("int", "RedBlackTree", size);
+        SuiteContainer<SuiteIntTree>(report, values, rng);
+        report.Begin("int", "CompactRedBlackTree", size);
+        SuiteContainer<SuiteIntCompact>(report, values, rng);
+        report.Begin("int", "std::set", size);
+        SuiteContainer<SuiteIntSet>(report, values, rng);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    string which = "all";
+    if (argc > 1) {
+        which = argv[1];
+    }
+
+    if (which == "all" || which == "remove") {
+        BenchRemove();
+    }
+    if (which == "all" || which == "insert") {
+        BenchInsert();
+    }
+    if (which == "all" || which == "aggregate") {
+        BenchAggregate();
+    }
+    if (which == "all" || which == "batch") {
+        BenchBatch();
+    }
+    if (which == "all" || which == "catalogue") {
+        BenchCatalogue();
+    }
+    if (which == "all" || which == "snapshot") {
+        BenchSnapshot();
+    }
+    if (which == "all" || which == "bulkload") {
+        BenchBulkLoad();
+    }
+    if (which == "all" || which == "copy") {
+        BenchCopy();
+    }
+    if (which == "all" || which == "journal") {
+        BenchJournal();
+    }
+    if (which == "all" || which == "versions") {
+        BenchVersions();
+    }
+    if (which == "all" || which == "compact") {
+        BenchCompact();
+    }
+    if (which == "suite") {
+        if (argc > 2) {
+            ofstream csv(argv[2]);
+            BenchSuite(csv);
+        } else {
+            BenchSuite(cout);
+        }
+    }
+    return 0;
+}
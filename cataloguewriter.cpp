@@ -0,0 +1,180 @@
+// File:        cataloguewriter.cpp
+// Date:        2026-10-17
+// Description: Implementation of a CatalogueWriter class
+
+#include <charconv>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cataloguewriter.h"
+
+// Longest row: 11 characters of SKU, a tab, 30 of description, 4 tabs,
+//   11 of stock, a tab and a dollar sign, up to 13 characters of price
+//   (e.g. -1.23457e+100) and the newline, rounded up.
+#define CATALOGUE_ROW_MAX 96
+
+//************************************
+// Method:    CatalogueWriter.
+// FullName:  CatalogueWriter::CatalogueWriter.
+// Access:    public.
+// Qualifier: : used(0), out(&stream), fd(-1), failed(false).
+// Desc:      Writer to an ostream.
+// Parameter: ostream& stream (receives the text).
+//************************************
+CatalogueWriter::CatalogueWriter(ostream& stream) : used(0), out(&stream), fd(-1), failed(false) {
+}
+
+
+
+//************************************
+// Method:    CatalogueWriter.
+// FullName:  CatalogueWriter::CatalogueWriter.
+// Access:    public.
+// Qualifier: : used(0), out(NULL), fd(filedesc), failed(false).
+// Desc:      Writer to a file descriptor, e.g. a socket or
+//            a pipe, bypassing iostreams entirely.
+// Parameter: int filedesc (an open, writable descriptor).
+//************************************
+CatalogueWriter::CatalogueWriter(int filedesc) : used(0), out(NULL), fd(filedesc), failed(false) {
+}
+
+
+
+//************************************
+// Method:    ~CatalogueWriter.
+// FullName:  CatalogueWriter::~CatalogueWriter.
+// Access:    public.
+// Desc:      Destructor, flushes the buffer.
+//************************************
+CatalogueWriter::~CatalogueWriter() {
+    Flush();
+}
+
+
+
+//************************************
+// Method:    Append.
+// FullName:  CatalogueWriter::Append.
+// Access:    private.
+// Returns:   void.
+// Desc:      Copies bytes into the buffer.
+// Parameter: const char* text.
+// Parameter: size_t length (at most CATALOGUE_BUFFER_SIZE).
+//************************************
+void CatalogueWriter::Append(const char* text, size_t length) {
+    if (used + length > CATALOGUE_BUFFER_SIZE) {
+        Flush();
+    }
+    memcpy(buffer + used, text, length);
+    used += length;
+}
+
+
+
+//************************************
+// Method:    WriteHeader.
+// FullName:  CatalogueWriter::WriteHeader.
+// Access:    public.
+// Returns:   void.
+//************************************
+void CatalogueWriter::WriteHeader() {
+    static const char header[] = "SKU\tDESCRIPTION\t\t\tQTY\tPRICE\n";
+    Append(header, sizeof(header) - 1);
+}
+
+
+
+//************************************
+// Method:    WriteRow.
+// FullName:  CatalogueWriter::WriteRow.
+// Access:    public.
+// Returns:   void.
+// Desc:      Formats one row straight into the buffer. The
+//            description is padded with one tab per started
+//            8 columns left before column 32, computed with
+//            integers. Numbers go through to_chars; the price
+//            uses the general format with 6 significant
+//            digits, which is what operator<< prints for a
+//            double by default.
+// Parameter: const StockItem& item (the item to format).
+//************************************
+void CatalogueWriter::WriteRow(const StockItem& item) {
+    if (used + CATALOGUE_ROW_MAX > CATALOGUE_BUFFER_SIZE) {
+        Flush();
+    }
+    char* pos = buffer + used;
+    char* end = buffer + CATALOGUE_BUFFER_SIZE;
+
+    pos = to_chars(pos, end, item.GetSKU()).ptr;
+    *pos++ = '\t';
+    string_view desc = item.GetDescription();
+    memcpy(pos, desc.data(), desc.length());
+    pos += desc.length();
+    int desclengthdiff = 32 - (int) desc.length();
+    for (int j = 0; j < (desclengthdiff + 7) / 8; j++) { // Same as ceil(desclengthdiff / 8.0) for a positive difference.
+        *pos++ = '\t';
+    }
+    pos = to_chars(pos, end, item.GetStock()).ptr;
+    *pos++ = '\t';
+    *pos++ = '$';
+    pos = to_chars(pos, end, item.GetPrice(), chars_format::general, 6).ptr;
+    *pos++ = '\n';
+
+    used = pos - buffer;
+}
+
+
+
+//************************************
+// Method:    WriteText.
+// FullName:  CatalogueWriter::WriteText.
+// Access:    public.
+// Returns:   void.
+// Desc:      Copies text into the buffer a buffer-full at a
+//            time, so it may be of any length.
+// Parameter: string_view text.
+//************************************
+void CatalogueWriter::WriteText(string_view text) {
+    while (text.length() > CATALOGUE_BUFFER_SIZE) {
+        Append(text.data(), CATALOGUE_BUFFER_SIZE);
+        text.remove_prefix(CATALOGUE_BUFFER_SIZE);
+    }
+    Append(text.data(), text.length());
+}
+
+
+
+//************************************
+// Method:    Flush.
+// FullName:  CatalogueWriter::Flush.
+// Access:    public.
+// Returns:   bool (false if a write has failed).
+// Desc:      Hands the buffered bytes to the destination. A
+//            descriptor may take fewer bytes than asked for,
+//            or be interrupted, so write is called again
+//            until everything is out.
+//************************************
+bool CatalogueWriter::Flush() {
+    if (used > 0 && !failed) {
+        if (out != NULL) {
+            out->write(buffer, used);
+            failed = !*out;
+        } else {
+            size_t written = 0;
+            while (written < used) {
+                ssize_t n = write(fd, buffer + written, used - written);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    failed = true;
+                    break;
+                }
+                written += n;
+            }
+        }
+    }
+    used = 0;
+    return !failed;
+}
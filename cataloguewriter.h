@@ -0,0 +1,53 @@
+// File:        cataloguewriter.h
+// Date:        2026-10-17
+// Description: Declaration of a CatalogueWriter class, which streams catalogue text
+
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string_view>
+
+#include "stockitem.h"
+
+#define CATALOGUE_BUFFER_SIZE 16384
+
+// Formats catalogue rows into a fixed-size buffer and hands it to an ostream
+//   or a file descriptor whenever it fills up, so a catalogue of any size is
+//   written with no allocation. The text is byte-identical to what
+//   StockSystem::GetCatalogue always produced with a default ostringstream:
+//   <sku> TAB <description> TABs to column 32 <stock> TAB $<price %g> NEWLINE
+class CatalogueWriter {
+private:
+    char buffer[CATALOGUE_BUFFER_SIZE];
+    size_t used; // bytes of buffer waiting to be written
+    ostream* out; // destination, or NULL when writing to fd
+    int fd;
+    bool failed; // a write failed, everything after it is dropped
+
+    // appends raw bytes, flushing first if they do not fit
+    void Append(const char* text, size_t length);
+
+public:
+    // writer to an ostream
+    explicit CatalogueWriter(ostream& stream);
+
+    // writer to a POSIX file descriptor (not closed by the writer)
+    explicit CatalogueWriter(int filedesc);
+
+    // flushes whatever is left
+    ~CatalogueWriter();
+
+    // the column header line
+    void WriteHeader();
+
+    // one catalogue line for item
+    void WriteRow(const StockItem& item);
+
+    // any other text, written as is
+    void WriteText(string_view text);
+
+    // writes out the buffer
+    // Return false if any write so far has failed.
+    bool Flush();
+};
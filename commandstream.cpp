@@ -0,0 +1,288 @@
+// File:        commandstream.cpp
+// Date:        2026-10-17
+// Description: Implementation of the CommandReader and CommandRunner classes
+
+#include <charconv>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "commandstream.h"
+
+// Splits the next field off rest (fields are separated by spaces and tabs).
+// Returns an empty view when rest holds no more fields.
+static string_view NextField(string_view& rest) {
+    size_t first = rest.find_first_not_of(" \t");
+    if (first == string_view::npos) {
+        rest = string_view();
+        return rest;
+    }
+    size_t last = rest.find_first_of(" \t", first);
+    if (last == string_view::npos) {
+        last = rest.length();
+    }
+    string_view field = rest.substr(first, last - first);
+    rest.remove_prefix(last);
+    return field;
+}
+
+// Parses the whole of field as a number, returns false if it is not one.
+template <class N>
+static bool ParseField(string_view field, N& value) {
+    if (field.empty()) {
+        return false;
+    }
+    from_chars_result result = from_chars(field.data(), field.data() + field.length(), value);
+    return result.ec == errc() && result.ptr == field.data() + field.length();
+}
+
+// Removes the spaces and tabs in front of a description.
+static string_view RestOfLine(string_view rest) {
+    size_t first = rest.find_first_not_of(" \t");
+    return first == string_view::npos ? string_view() : rest.substr(first);
+}
+
+//************************************
+// Method:    CommandReader.
+// FullName:  CommandReader::CommandReader.
+// Access:    public.
+// Qualifier: : buffer(COMMAND_BUFFER_SIZE), start(0), end(0), fd(filedesc), eof(false).
+// Parameter: int filedesc (an open, readable descriptor).
+//************************************
+CommandReader::CommandReader(int filedesc) : buffer(COMMAND_BUFFER_SIZE), start(0), end(0), fd(filedesc), eof(false) {
+}
+
+
+
+//************************************
+// Method:    NextLine.
+// FullName:  CommandReader::NextLine.
+// Access:    public.
+// Returns:   bool (false at the end of the input).
+// Desc:      Returns lines straight out of the buffer. When
+//            no newline is left in it, the partial line is
+//            moved to the front and the rest of the buffer is
+//            filled with one read. A last line without a
+//            newline is returned as well.
+// Parameter: string_view& line (set to the line).
+//************************************
+bool CommandReader::NextLine(string_view& line) {
+    while (true) {
+        const char* first = buffer.data() + start;
+        const char* newline = (const char*) memchr(first, '\n', end - start);
+        if (newline != NULL || (eof && start < end)) {
+            size_t length = newline != NULL ? newline - first : end - start;
+            start += newline != NULL ? length + 1 : length;
+            if (length > 0 && first[length - 1] == '\r') {
+                --length;
+            }
+            line = string_view(first, length);
+            return true;
+        }
+        if (eof) {
+            return false;
+        }
+
+        if (start > 0) {
+            memmove(buffer.data(), buffer.data() + start, end - start);
+            end -= start;
+            start = 0;
+        }
+        if (end == buffer.size()) { // A line longer than the buffer.
+            buffer.resize(buffer.size() * 2);
+        }
+        ssize_t got = read(fd, buffer.data() + end, buffer.size() - end);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            eof = true;
+        } else {
+            end += got;
+        }
+    }
+}
+
+
+
+//************************************
+// Method:    CommandRunner.
+// FullName:  CommandRunner::CommandRunner.
+// Access:    public.
+// Qualifier: : store(mystore), out(results), lineno(0).
+// Parameter: StockSystem& mystore (the store the commands change).
+// Parameter: CatalogueWriter& results (where the results go).
+//************************************
+CommandRunner::CommandRunner(StockSystem& mystore, CatalogueWriter& results) : store(mystore), out(results), lineno(0) {
+    batch.reserve(COMMAND_BATCH_SIZE);
+}
+
+
+
+//************************************
+// Method:    WriteResult.
+// FullName:  CommandRunner::WriteResult.
+// Access:    private.
+// Returns:   void.
+// Parameter: bool done (the return value of the call).
+//************************************
+void CommandRunner::WriteResult(bool done) {
+    if (done) {
+        out.WriteText("OK\n");
+    } else {
+        out.WriteText("FAIL\n");
+        ++stats.failed;
+    }
+}
+
+
+
+//************************************
+// Method:    Queue.
+// FullName:  CommandRunner::Queue.
+// Access:    private.
+// Returns:   void.
+// Parameter: const StockOperation& op (the operation to queue).
+//************************************
+void CommandRunner::Queue(const StockOperation& op) {
+    batch.push_back(op);
+    if (batch.size() == COMMAND_BATCH_SIZE) {
+        FlushBatch();
+    }
+}
+
+
+
+//************************************
+// Method:    FlushBatch.
+// FullName:  CommandRunner::FlushBatch.
+// Access:    private.
+// Returns:   void.
+// Desc:      Every command that does not queue flushes the
+//            queue first, so results are written in the order
+//            of the commands.
+//************************************
+void CommandRunner::FlushBatch() {
+    if (batch.empty()) {
+        return;
+    }
+    store.ApplyBatch(batch, span<bool>(batchresults, batch.size()));
+    for (size_t i = 0; i < batch.size(); i++) {
+        WriteResult(batchresults[i]);
+    }
+    batch.clear();
+}
+
+
+
+//************************************
+// Method:    Run.
+// FullName:  CommandRunner::Run.
+// Access:    public.
+// Returns:   void.
+// Desc:      Parses the command with from_chars, without
+//            copying the line. SKUs and quantities are read
+//            as int and passed on as the menu passes them.
+// Parameter: string_view line (the command line).
+//************************************
+void CommandRunner::Run(string_view line) {
+    ++lineno;
+    string_view rest = line;
+    string_view command = NextField(rest);
+    if (command.empty() || command[0] == '#') {
+        return;
+    }
+
+    if (command == "BALANCE" || command == "CATALOGUE") {
+        if (NextField(rest).empty()) {
+            ++stats.commands;
+            FlushBatch();
+            if (command == "BALANCE") {
+                char number[32];
+                char* end = to_chars(number, number + sizeof(number) - 1, store.GetBalance(), chars_format::general, 6).ptr;
+                *end++ = '\n';
+                out.WriteText(string_view(number, end - number));
+            } else {
+                out.WriteHeader();
+                store.ForEachItem([&](const StockItem& item) {
+                    out.WriteRow(item);
+                });
+            }
+            return;
+        }
+    } else {
+        StockOperation op;
+        int sku = 0, quantity = 0;
+        double price = 0;
+        bool valid = ParseField(NextField(rest), sku);
+        op.itemsku = sku;
+        op.quantity = 0;
+        op.price = 0;
+        if (command == "SELL") {
+            op.code = SELL_OP;
+            valid = valid && ParseField(NextField(rest), quantity) && NextField(rest).empty();
+            op.quantity = quantity;
+        } else if (command == "RESTOCK") {
+            op.code = RESTOCK_OP;
+            valid = valid && ParseField(NextField(rest), quantity) && ParseField(NextField(rest), op.price) && NextField(rest).empty();
+            op.quantity = quantity;
+        } else if (command == "PRICE") {
+            op.code = EDIT_PRICE_OP;
+            valid = valid && ParseField(NextField(rest), op.price) && NextField(rest).empty();
+        } else if (command == "NEW") {
+            if (valid && ParseField(NextField(rest), price)) {
+                ++stats.commands;
+                FlushBatch();
+                WriteResult(store.StockNewItem(StockItem(sku, RestOfLine(rest), price)));
+                return;
+            }
+            valid = false;
+        } else if (command == "DESC") {
+            if (valid) {
+                ++stats.commands;
+                FlushBatch();
+                WriteResult(store.EditStockItemDescription(sku, RestOfLine(rest)));
+                return;
+            }
+        } else {
+            valid = false;
+        }
+        if (valid) {
+            ++stats.commands;
+            Queue(op);
+            return;
+        }
+    }
+
+    FlushBatch();
+    char message[32] = "ERROR ";
+    char* end = to_chars(message + 6, message + sizeof(message) - 1, lineno).ptr;
+    *end++ = '\n';
+    out.WriteText(string_view(message, end - message));
+    ++stats.invalid;
+}
+
+
+
+//************************************
+// Method:    Finish.
+// FullName:  CommandRunner::Finish.
+// Access:    public.
+// Returns:   void.
+//************************************
+void CommandRunner::Finish() {
+    FlushBatch();
+}
+
+
+
+//************************************
+// Method:    Stats.
+// FullName:  CommandRunner::Stats.
+// Access:    public.
+// Returns:   const CommandStats&.
+// Qualifier: const.
+//************************************
+const CommandStats& CommandRunner::Stats() const {
+    return stats;
+}
@@ -0,0 +1,91 @@
+// File:        commandstream.h
+// Date:        2026-10-17
+// Description: Declaration of the CommandReader and CommandRunner classes,
+//              which run a text command stream against a StockSystem
+
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include "stocksystem.h"
+#include "cataloguewriter.h"
+
+#define COMMAND_BUFFER_SIZE 1048576
+#define COMMAND_BATCH_SIZE 256
+
+// Reads a file descriptor a large block at a time and splits it into lines.
+class CommandReader {
+private:
+    vector<char> buffer; // grows only for a line longer than the buffer
+    size_t start; // first byte not yet returned
+    size_t end; // end of the bytes read so far
+    int fd;
+    bool eof; // read returned 0 or failed
+
+public:
+    // reader of an open descriptor (not closed by the reader)
+    explicit CommandReader(int filedesc);
+
+    // Sets line to the next line, without its newline (or CR LF).
+    // The line points into the buffer and is only valid until the next call.
+    // Returns false once the input is exhausted.
+    bool NextLine(string_view& line);
+};
+
+// Counts kept by a CommandRunner
+struct CommandStats {
+    unsigned long long commands; // lines that held a command
+    unsigned long long failed; // commands whose StockSystem call returned false
+    unsigned long long invalid; // lines that could not be parsed
+
+    CommandStats() : commands(0), failed(0), invalid(0) {
+    }
+};
+
+// Runs one command per line against a StockSystem and writes one result
+//   line per command:
+//     NEW <sku> <price> <description>     OK or FAIL
+//     DESC <sku> <description>            OK or FAIL
+//     PRICE <sku> <price>                 OK or FAIL
+//     RESTOCK <sku> <quantity> <price>    OK or FAIL
+//     SELL <sku> <quantity>               OK or FAIL
+//     BALANCE                             the balance
+//     CATALOGUE                           the catalogue, as GetCatalogue
+// Fields are separated by spaces or tabs; a description is the rest of the
+//   line. Blank lines and lines starting with # are skipped, and any other
+//   line that cannot be parsed gets ERROR <line number>.
+// Runs of PRICE, RESTOCK and SELL are queued and applied with
+//   StockSystem::ApplyBatch, which gives the same results in the same order.
+class CommandRunner {
+private:
+    StockSystem& store;
+    CatalogueWriter& out;
+    CommandStats stats;
+    unsigned long long lineno;
+    vector<StockOperation> batch; // queued operations, at most COMMAND_BATCH_SIZE
+    bool batchresults[COMMAND_BATCH_SIZE];
+
+    // applies the queued operations and writes their results
+    void FlushBatch();
+
+    // writes OK or FAIL, counting failures
+    void WriteResult(bool done);
+
+    // queues an operation, applying the queue once it is full
+    void Queue(const StockOperation& op);
+
+public:
+    // runner writing the results of commands on mystore to results
+    CommandRunner(StockSystem& mystore, CatalogueWriter& results);
+
+    // runs the command on line (the next line of the stream)
+    void Run(string_view line);
+
+    // applies any queued operations; call once the stream has ended
+    void Finish();
+
+    // counts so far
+    const CommandStats& Stats() const;
+};
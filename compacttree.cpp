@@ -0,0 +1,1338 @@
+// File:        compacttree.cpp
+// Date:        2026-10-17
+// Description: Implementation of a CompactRedBlackTree class
+
+#ifdef _COMPACTTREE_H_
+
+#include <stdexcept>
+
+//************************************
+// Method:    CompactRedBlackTree.
+// FullName:  CompactRedBlackTree<T>::CompactRedBlackTree.
+// Access:    public.
+// Qualifier: : store(new NodeStore()), root(COMPACT_NIL), size(0),
+//            copyonwrite(false).
+// Desc:      Default constructor.
+//************************************
+template <class T, class KeyOf, class Summary>
+CompactRedBlackTree<T, KeyOf, Summary>::CompactRedBlackTree() : store(new NodeStore()), root(COMPACT_NIL), size(0), copyonwrite(false) {
+}
+
+
+
+//************************************
+// Method:    CompactRedBlackTree.
+// FullName:  CompactRedBlackTree<T>::CompactRedBlackTree.
+// Access:    public.
+// Qualifier: : store(NULL), root(rbtree.root), size(rbtree.size),
+//            copyonwrite(rbtree.copyonwrite).
+// Desc:      Copy constructor. The links are indices, so the
+//            node vector is copied as it is, free slots and all.
+// Parameter: const CompactRedBlackTree& rbtree (the tree to copy).
+//************************************
+template <class T, class KeyOf, class Summary>
+CompactRedBlackTree<T, KeyOf, Summary>::CompactRedBlackTree(const CompactRedBlackTree& rbtree) : store(NULL), root(rbtree.root), size(rbtree.size), copyonwrite(rbtree.copyonwrite) {
+    if (copyonwrite) {
+        store = rbtree.store;
+        store->refs.fetch_add(1, memory_order_relaxed);
+    } else {
+        store = new NodeStore();
+        store->nodes = rbtree.store->nodes;
+        store->freelist = rbtree.store->freelist;
+    }
+}
+
+
+
+//************************************
+// Method:    ~CompactRedBlackTree.
+// FullName:  CompactRedBlackTree<T>::~CompactRedBlackTree.
+// Access:    public.
+//************************************
+template <class T, class KeyOf, class Summary>
+CompactRedBlackTree<T, KeyOf, Summary>::~CompactRedBlackTree() {
+    ReleaseStore();
+}
+
+
+
+//************************************
+// Method:    operator=.
+// FullName:  CompactRedBlackTree<T>::operator=.
+// Access:    public.
+// Returns:   CompactRedBlackTree<T>&.
+// Desc:      Copies like the copy constructor, after checking
+//            for self assignment.
+// Parameter: const CompactRedBlackTree& rbtree.
+//************************************
+template <class T, class KeyOf, class Summary>
+CompactRedBlackTree<T, KeyOf, Summary>& CompactRedBlackTree<T, KeyOf, Summary>::operator=(const CompactRedBlackTree& rbtree) {
+    if (this != &rbtree) {
+        ReleaseStore();
+        copyonwrite = rbtree.copyonwrite;
+        root = rbtree.root;
+        size = rbtree.size;
+        if (copyonwrite) {
+            store = rbtree.store;
+            store->refs.fetch_add(1, memory_order_relaxed);
+        } else {
+            store = new NodeStore();
+            store->nodes = rbtree.store->nodes;
+            store->freelist = rbtree.store->freelist;
+        }
+    }
+    return *this;
+}
+
+
+
+//************************************
+// Method:    ReleaseStore.
+// FullName:  CompactRedBlackTree<T>::ReleaseStore.
+// Access:    private.
+// Returns:   void.
+// Desc:      The last tree holding the nodes deletes them.
+//            Leaves store dangling, the caller replaces it.
+//************************************
+template <class T, class KeyOf, class Summary>
+void CompactRedBlackTree<T, KeyOf, Summary>::ReleaseStore() {
+    if (store->refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+        delete store;
+    }
+    store = NULL;
+}
+
+
+
+//************************************
+// Method:    Unshare.
+// FullName:  CompactRedBlackTree<T>::Unshare.
+// Access:    private.
+// Returns:   void.
+// Desc:      Called first by every function that may change
+//            the tree. If other trees still hold the nodes, this
+//            one copies the vector and lets go of the shared
+//            one; the last holder simply keeps it.
+//************************************
+template <class T, class KeyOf, class Summary>
+void CompactRedBlackTree<T, KeyOf, Summary>::Unshare() {
+    if (store->refs.load(memory_order_acquire) == 1) {
+        return;
+    }
+    NodeStore* copy = new NodeStore();
+    copy->nodes = store->nodes;
+    copy->freelist = store->freelist;
+    ReleaseStore();
+    store = copy;
+}
+
+
+
+//************************************
+// Method:    SetCopyOnWrite.
+// FullName:  CompactRedBlackTree<T>::SetCopyOnWrite.
+// Access:    public.
+// Returns:   void.
+// Parameter: bool enable.
+//************************************
+template <class T, class KeyOf, class Summary>
+void CompactRedBlackTree<T, KeyOf, Summary>::SetCopyOnWrite(bool enable) {
+    copyonwrite = enable;
+}
+
+
+
+//************************************
+// Method:    IsShared.
+// FullName:  CompactRedBlackTree<T>::IsShared.
+// Access:    public.
+// Returns:   bool.
+// Qualifier: const.
+//************************************
+template <class T, class KeyOf, class Summary>
+bool CompactRedBlackTree<T, KeyOf, Summary>::IsShared() const {
+    return store->refs.load(memory_order_acquire) > 1;
+}
+
+
+
+//************************************
+// Method:    Reserve.
+// FullName:  CompactRedBlackTree<T>::Reserve.
+// Access:    public.
+// Returns:   void.
+// Parameter: unsigned int n (number of nodes to make room for).
+//************************************
+template <class T, class KeyOf, class Summary>
+void CompactRedBlackTree<T, KeyOf, Summary>::Reserve(unsigned int n) {
+    Unshare();
+    store->nodes.reserve(n);
+}
+
+
+
+//************************************
+// Method:    Compact.
+// FullName:  CompactRedBlackTree<T>::Compact.
+// Access:    public.
+// Returns:   void.
+// Desc:      Lists the nodes in their new order, then moves
+//            them into a new vector, renumbering every link.
+//            The colors move with the parent links.
+//************************************
+template <class T, class KeyOf, class Summary>
+void CompactRedBlackTree<T, KeyOf, Summary>::Compact() {
+    Unshare();
+    vector<uint32_t> order;
+    vector<uint32_t> below;
+    order.reserve(size);
+    LayOut(root, CalculateHeight(root), order, below);
+
+    vector<uint32_t> renumber(store->nodes.size(), COMPACT_NIL);
+    for (uint32_t i = 0; i < order.size(); i++) {
+        renumber[order[i]] = i;
+    }
+    auto newindex = [&](uint32_t index) { return index == COMPACT_NIL ? COMPACT_NIL : renumber[index]; };
+    vector<N> packed;
+    packed.reserve(order.size());
+    for (uint32_t index : order) {
+        packed.push_back(move(At(index)));
+        N& node = packed.back();
+        node.left = newindex(node.left);
+        node.right = newindex(node.right);
+        node.SetParent(newindex(node.Parent()));
+    }
+    store->nodes.swap(packed);
+    store->freelist = COMPACT_NIL;
+    root = newindex(root);
+}
+
+
+
+//************************************
+// Method:    LayOut.
+// FullName:  CompactRedBlackTree<T>::LayOut.
+// Access:    private.
+// Returns:   void.
+// Qualifier: const.
+// Desc:      A subtree of h levels is cut at h / 2: its top part
+//            is laid out first (recursively), then every subtree
+//            hanging below the cut, each with the remaining
+//            levels. Paths shorter than levels just end early,
+//            as red-black paths differ in length.
+// Parameter: uint32_t index (root of the subtree, may be COMPACT_NIL).
+// Parameter: unsigned int levels (number of levels to lay out).
+// Parameter: vector<uint32_t>& order (receives the nodes in layout order).
+// Parameter: vector<uint32_t>& below (receives the roots under the levels).
+//************************************
+template <class T, class KeyOf, class Summary>
+void CompactRedBlackTree<T, KeyOf, Summary>::LayOut(uint32_t index, unsigned int levels, vector<uint32_t>& order, vector<uint32_t>& below) const {
+    if (index == COMPACT_NIL) {
+        return;
+    }
+    if (levels <= 1) {
+        order.push_back(index);
+        if (At(index).left != COMPACT_NIL) {
+            below.push_back(At(index).left);
+        }
+        if (At(index).right != COMPACT_NIL) {
+            below.push_back(At(index).right);
+        }
+        return;
+    }
+    unsigned int top = levels / 2;
+    vector<uint32_t> middle; // roots of the subtrees under the top part
+    LayOut(index, top, order, middle);
+    for (uint32_t subtree : middle) {
+        LayOut(subtree, levels - top, order, below);
+    }
+}
+
+
+
+//************************************
+// Method:    NewNode.
+// FullName:  CompactRedBlackTree<T>::NewNode.
+// Access:    private.
+// Returns:   uint32_t (index of the new node).
+// Desc:      Takes the most recently freed slot, whose item is
+//            replaced, or else appends to the vector (which may
+//            move every node).
+// Parameter: Args&&... args (arguments of one of T's constructors).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class... Args>
+uint32_t CompactRedBlackTree<T, KeyOf, Summary>::NewNode(Args&&... args) {
+    uint32_t index = store->freelist;
+    if (index != COMPACT_NIL) {
+        N& node = At(index);
+        store->freelist = node.left;
+        node.data = T(forward<Args>(args)...);
+        node.left = COMPACT_NIL;
+        node.right = COMPACT_NIL;
+        node.parentcolor = COMPACT_NIL << 1;
+        node.count = 1;
+        node.summary = Summary();
+        return index;
+    }
+    if (store->nodes.size() >= COMPACT_NIL) {
+        throw length_error("CompactRedBlackTree: too many nodes for 31 bit indices");
+    }
+    store->nodes.emplace_back(in_place, forward<Args>(args)...);
+    return (uint32_t) store->nodes.size() - 1;
+}
+
+
+
+//************************************
+// Method:    FreeNode.
+// FullName:  CompactRedBlackTree<T>::FreeNode.
+// Access:    private.
+// Returns:   void.
+// Parameter: uint32_t index (a node no longer linked to the tree).
+//************************************
+template <class T, class KeyOf, class Summary>
+void CompactRedBlackTree<T, KeyOf, Summary>::FreeNode(uint32_t index) {
+    At(index).left = store->freelist;
+    store->freelist = index;
+}
+
+
+
+//************************************
+// Method:    FindNode.
+// FullName:  CompactRedBlackTree<T>::FindNode.
+// Access:    private.
+// Returns:   uint32_t (COMPACT_NIL if no node holds key).
+// Qualifier: const.
+// Desc:      The vector's base is read once, so every level is
+//            a single indexed load.
+// Parameter: const K& key (an item, or anything KeyOf::Key accepts).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class K>
+uint32_t CompactRedBlackTree<T, KeyOf, Summary>::FindNode(const K& key) const {
+    const N* nodes = store->nodes.data();
+    uint32_t index = root;
+    auto&& k = KeyOf::Key(key);
+    STATS_DESCENT(descent);
+
+    while (index != COMPACT_NIL) {
+        STATS_VISIT(descent);
+        const N& node = nodes[index];
+        if (k == KeyOf::Key(node.data)) {
+            return index;
+        }
+        index = k < KeyOf::Key(node.data) ? node.left : node.right;
+    }
+    return COMPACT_NIL;
+}
+
+
+
+//************************************
+// Method:    BoundNode.
+// FullName:  CompactRedBlackTree<T>::BoundNode.
+// Access:    private.
+// Returns:   uint32_t (COMPACT_NIL if every key is below the bound).
+// Qualifier: const.
+// Parameter: const K& key (an item, or anything KeyOf::Key accepts).
+// Parameter: bool inclusive (true for the first key >= key,
+//            false for the first key > key).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class K>
+uint32_t CompactRedBlackTree<T, KeyOf, Summary>::BoundNode(const K& key, bool inclusive) const {
+    const N* nodes = store->nodes.data();
+    uint32_t index = root;
+    uint32_t bound = COMPACT_NIL;
+    auto&& k = KeyOf::Key(key);
+    STATS_DESCENT(descent);
+
+    while (index != COMPACT_NIL) {
+        STATS_VISIT(descent);
+        const N& node = nodes[index];
+        bool above = inclusive ? !(KeyOf::Key(node.data) < k) : k < KeyOf::Key(node.data);
+        if (above) {
+            bound = index;
+            index = node.left;
+        } else {
+            index = node.right;
+        }
+    }
+    return bound;
+}
+
+
+
+//************************************
+// Method:    SelectNode.
+// FullName:  CompactRedBlackTree<T>::SelectNode.
+// Access:    private.
+// Returns:   uint32_t (COMPACT_NIL if k >= size).
+// Qualifier: const.
+// Parameter: unsigned int k (0 based position).
+//************************************
+template <class T, class KeyOf, class Summary>
+uint32_t CompactRedBlackTree<T, KeyOf, Summary>::SelectNode(unsigned int k) const {
+    uint32_t index = root;
+    STATS_DESCENT(descent);
+    while (index != COMPACT_NIL) {
+        STATS_VISIT(descent);
+        unsigned int leftsize = SubtreeSize(At(index).left);
+        if (k == leftsize) {
+            return index;
+        } else if (k < leftsize) {
+            index = At(index).left;
+        } else {
+            k -= leftsize + 1;
+            index = At(index).right;
+        }
+    }
+    return COMPACT_NIL;
+}
+
+
+
+//************************************
+// Method:    Search.
+// FullName:  CompactRedBlackTree<T>::Search.
+// Access:    public.
+// Returns:   bool.
+// Qualifier: const.
+// Parameter: const K& key (an item, or anything KeyOf::Key accepts).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class K>
+bool CompactRedBlackTree<T, KeyOf, Summary>::Search(const K& key) const {
+    return FindNode(key) != COMPACT_NIL;
+}
+
+
+
+//************************************
+// Method:    Retrieve.
+// FullName:  CompactRedBlackTree<T>::Retrieve.
+// Access:    public.
+// Returns:   T* (NULL if no item has this key).
+// Desc:      The pointer is valid until the next insertion.
+// Parameter: const K& key (an item, or anything KeyOf::Key accepts).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class K>
+T* CompactRedBlackTree<T, KeyOf, Summary>::Retrieve(const K& key) {
+    Unshare(); // the item may be modified through the pointer
+    uint32_t index = FindNode(key);
+    return index == COMPACT_NIL ? NULL : &At(index).data;
+}
+
+
+
+//************************************
+// Method:    RetrieveSorted.
+// FullName:  CompactRedBlackTree<T>::RetrieveSorted.
+// Access:    public.
+// Returns:   void.
+// Desc:      Merged descent of a batch of sorted keys, as in
+//            RedBlackTree, counted as one descent.
+// Parameter: const K* keys (the sorted keys).
+// Parameter: unsigned int count (number of keys).
+// Parameter: T** results (receives a pointer per key, NULL if absent).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class K>
+void CompactRedBlackTree<T, KeyOf, Summary>::RetrieveSorted(const K* keys, unsigned int count, T** results) {
+    Unshare();
+    StatsDescent descent;
+    RetrieveSorted(root, keys, 0, count, results, descent);
+}
+
+
+
+//************************************
+// Method:    RetrieveSorted.
+// FullName:  CompactRedBlackTree<T>::RetrieveSorted.
+// Access:    private.
+// Returns:   void.
+// Desc:      Splits the keys [lo, hi) around the node's key and
+//            sends each side down its subtree.
+// Parameter: uint32_t index (current recursion node).
+// Parameter: const K* keys (the sorted keys).
+// Parameter: unsigned int lo (first key of this subtree).
+// Parameter: unsigned int hi (one past the last key of this subtree).
+// Parameter: T** results (receives a pointer per key, NULL if absent).
+// Parameter: StatsDescent& descent (counts the nodes visited).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class K>
+void CompactRedBlackTree<T, KeyOf, Summary>::RetrieveSorted(uint32_t index, const K* keys, unsigned int lo, unsigned int hi, T** results, StatsDescent& descent) {
+    if (lo >= hi) {
+        return;
+    }
+    if (index == COMPACT_NIL) {
+        for (unsigned int i = lo; i < hi; i++) {
+            results[i] = NULL;
+        }
+        return;
+    }
+    if (hi - lo == 1) { // A single key left, finish with an ordinary descent.
+        auto&& k = KeyOf::Key(keys[lo]);
+        results[lo] = NULL;
+        while (index != COMPACT_NIL) {
+            descent.Visit();
+            N& node = At(index);
+            if (k == KeyOf::Key(node.data)) {
+                results[lo] = &node.data;
+                break;
+            }
+            index = k < KeyOf::Key(node.data) ? node.left : node.right;
+        }
+        return;
+    }
+
+    descent.Visit();
+    N& node = At(index);
+    auto&& nodekey = KeyOf::Key(node.data);
+    unsigned int mid = lo; // first key >= nodekey
+    unsigned int count = hi - lo;
+    while (count > 0) {
+        unsigned int half = count / 2;
+        if (KeyOf::Key(keys[mid + half]) < nodekey) {
+            mid += half + 1;
+            count -= half + 1;
+        } else {
+            count = half;
+        }
+    }
+    unsigned int end = mid; // first key > nodekey
+    while (end < hi && !(nodekey < KeyOf::Key(keys[end]))) {
+        results[end] = &node.data;
+        end++;
+    }
+
+    RetrieveSorted(node.left, keys, lo, mid, results, descent);
+    RetrieveSorted(node.right, keys, end, hi, results, descent);
+}
+
+
+
+//************************************
+// Method:    Insert.
+// FullName:  CompactRedBlackTree<T>::Insert.
+// Access:    public.
+// Returns:   bool (false if the item is already in the tree).
+// Parameter: const T& item (value for the node to insert).
+//************************************
+template <class T, class KeyOf, class Summary>
+bool CompactRedBlackTree<T, KeyOf, Summary>::Insert(const T& item) {
+    Unshare();
+    if (Search(item)) {
+        return false;
+    }
+    InsertNode(NewNode(item));
+    return true;
+}
+
+
+
+//************************************
+// Method:    Insert.
+// FullName:  CompactRedBlackTree<T>::Insert.
+// Access:    public.
+// Returns:   bool (false if the item is already in the tree).
+// Desc:      Same as above, but the item is moved into the node.
+// Parameter: T&& item (value for the node to insert).
+//************************************
+template <class T, class KeyOf, class Summary>
+bool CompactRedBlackTree<T, KeyOf, Summary>::Insert(T&& item) {
+    Unshare();
+    if (Search(item)) {
+        return false;
+    }
+    InsertNode(NewNode(move(item)));
+    return true;
+}
+
+
+
+//************************************
+// Method:    Emplace.
+// FullName:  CompactRedBlackTree<T>::Emplace.
+// Access:    public.
+// Returns:   bool (false if an equal item is already in the tree).
+// Desc:      The node of a duplicate goes straight back to the
+//            free list.
+// Parameter: Args&&... args (arguments of one of T's constructors).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class... Args>
+bool CompactRedBlackTree<T, KeyOf, Summary>::Emplace(Args&&... args) {
+    Unshare();
+    uint32_t x = NewNode(forward<Args>(args)...);
+    if (Search(At(x).data)) {
+        FreeNode(x);
+        return false;
+    }
+    InsertNode(x);
+    return true;
+}
+
+
+
+//************************************
+// Method:    InsertNode.
+// FullName:  CompactRedBlackTree<T>::InsertNode.
+// Access:    private.
+// Returns:   void.
+// Desc:      Binary tree insertion, counting the new node in
+//            every subtree on its way down, then the usual
+//            red-black fix-up: recolor while the uncle is red,
+//            otherwise at most two rotations.
+// Parameter: uint32_t newnode (a red node whose item is not in the tree).
+//************************************
+template <class T, class KeyOf, class Summary>
+void CompactRedBlackTree<T, KeyOf, Summary>::InsertNode(uint32_t newnode) {
+    N* nodes = store->nodes.data(); // NewNode is done, so the vector does not move below.
+    auto&& key = KeyOf::Key(nodes[newnode].data);
+    uint32_t parent = COMPACT_NIL;
+    bool left = false;
+    {
+        STATS_DESCENT(descent);
+        for (uint32_t index = root; index != COMPACT_NIL;) {
+            STATS_VISIT(descent);
+            parent = index;
+            ++nodes[index].count;
+            left = key < KeyOf::Key(nodes[index].data);
+            index = left ? nodes[index].left : nodes[index].right;
+        }
+    }
+    nodes[newnode].SetParent(parent);
+    if (parent == COMPACT_NIL) {
+        root = newnode;
+    } else if (left) {
+        nodes[parent].left = newnode;
+    } else {
+        nodes[parent].right = newnode;
+    }
+    ++size;
+    RefreshSummaries(newnode);
+
+    uint32_t x = newnode;
+    while (x != root && !nodes[nodes[x].Parent()].IsBlack()) { // A red parent is never the root, so x has a grandparent.
+        STATS_COUNT(TREE_INSERT_FIXUPS);
+        uint32_t p = nodes[x].Parent();
+        uint32_t g = nodes[p].Parent();
+        if (p == nodes[g].left) {
+            uint32_t y = nodes[g].right; // Uncle of x.
+            if (y != COMPACT_NIL && !nodes[y].IsBlack()) {
+                nodes[p].SetBlack(true);
+                nodes[y].SetBlack(true);
+                nodes[g].SetBlack(false);
+                x = g;
+            } else {
+                if (x == nodes[p].right) {
+                    x = p;
+                    LeftRotate(x);
+                    p = nodes[x].Parent();
+                }
+                nodes[p].SetBlack(true);
+                nodes[g].SetBlack(false);
+                RightRotate(g);
+            }
+        } else { // Symmetric to the case above.
+            uint32_t y = nodes[g].left;
+            if (y != COMPACT_NIL && !nodes[y].IsBlack()) {
+                nodes[p].SetBlack(true);
+                nodes[y].SetBlack(true);
+                nodes[g].SetBlack(false);
+                x = g;
+            } else {
+                if (x == nodes[p].left) {
+                    x = p;
+                    RightRotate(x);
+                    p = nodes[x].Parent();
+                }
+                nodes[p].SetBlack(true);
+                nodes[g].SetBlack(false);
+                LeftRotate(g);
+            }
+        }
+    }
+    nodes[root].SetBlack(true);
+}
+
+
+
+//************************************
+// Method:    BuildFromSorted.
+// FullName:  CompactRedBlackTree<T>::BuildFromSorted.
+// Access:    public.
+// Returns:   bool (false if the items are not in strictly
+//            ascending order).
+// Desc:      Same shape and colors as RedBlackTree's, built
+//            in one reserved vector in key order, then laid
+//            out for searching by Compact.
+// Parameter: It first (iterator to the smallest item).
+// Parameter: It last (iterator past the largest item).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class It>
+bool CompactRedBlackTree<T, KeyOf, Summary>::BuildFromSorted(It first, It last) {
+    unsigned int n = 0;
+    for (It it = first, prev = first; it != last; prev = it, ++it, ++n) {
+        if (n > 0 && !(KeyOf::Key(*prev) < KeyOf::Key(*it))) {
+            return false;
+        }
+    }
+    if (n >= COMPACT_NIL) {
+        throw length_error("CompactRedBlackTree: too many nodes for 31 bit indices");
+    }
+    RemoveAll();
+    store->nodes.reserve(n);
+
+    unsigned int reddepth = 0; // floor(log2(n + 1)), beyond the last level if it is full
+    while ((n + 1) >> (reddepth + 1) != 0) {
+        ++reddepth;
+    }
+    root = BuildSorted(first, n, 0, reddepth, COMPACT_NIL);
+    size = n;
+    Compact();
+    return true;
+}
+
+
+
+//************************************
+// Method:    BuildSorted.
+// FullName:  CompactRedBlackTree<T>::BuildSorted.
+// Access:    private.
+// Returns:   uint32_t (root of the new subtree, COMPACT_NIL if n is 0).
+// Parameter: It& it (next item to read).
+// Parameter: unsigned int n (number of items in the subtree).
+// Parameter: unsigned int depth (depth of the subtree's root).
+// Parameter: unsigned int reddepth (depth of the red nodes).
+// Parameter: uint32_t parent (parent of the subtree's root).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class It>
+uint32_t CompactRedBlackTree<T, KeyOf, Summary>::BuildSorted(It& it, unsigned int n, unsigned int depth, unsigned int reddepth, uint32_t parent) {
+    if (n == 0) {
+        return COMPACT_NIL;
+    }
+    unsigned int leftcount = (n - 1) / 2;
+    uint32_t left = BuildSorted(it, leftcount, depth + 1, reddepth, COMPACT_NIL);
+    uint32_t index = NewNode(*it);
+    ++it;
+    At(index).SetParent(parent);
+    At(index).SetBlack(depth != reddepth);
+    At(index).left = left;
+    if (left != COMPACT_NIL) {
+        At(left).SetParent(index);
+    }
+    uint32_t right = BuildSorted(it, n - 1 - leftcount, depth + 1, reddepth, index);
+    At(index).right = right;
+    Refresh(index);
+    return index;
+}
+
+
+
+//************************************
+// Method:    Remove.
+// FullName:  CompactRedBlackTree<T>::Remove.
+// Access:    public.
+// Returns:   bool (false if no item has this key).
+// Desc:      As RedBlackTree::Remove: a node with two children
+//            takes its predecessor's item, and the predecessor's
+//            node is unlinked instead. The unlinked slot goes on
+//            the free list.
+// Parameter: const K& key (item, or key of the item, to remove).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class K>
+bool CompactRedBlackTree<T, KeyOf, Summary>::Remove(const K& key) {
+    Unshare();
+    uint32_t z = FindNode(key);
+    if (z == COMPACT_NIL) {
+        return false;
+    }
+    N* nodes = store->nodes.data();
+
+    uint32_t y = z; // The node to unlink: z itself, or its predecessor.
+    if (nodes[z].left != COMPACT_NIL && nodes[z].right != COMPACT_NIL) {
+        y = nodes[z].left;
+        while (nodes[y].right != COMPACT_NIL) {
+            y = nodes[y].right;
+        }
+    }
+    uint32_t x = nodes[y].left != COMPACT_NIL ? nodes[y].left : nodes[y].right; // y's only child, or COMPACT_NIL.
+
+    uint32_t xparent = nodes[y].Parent();
+    bool xisleft = false;
+    if (x != COMPACT_NIL) {
+        nodes[x].SetParent(xparent);
+    }
+    if (xparent == COMPACT_NIL) {
+        root = x;
+    } else if (y == nodes[xparent].left) {
+        nodes[xparent].left = x;
+        xisleft = true;
+    } else {
+        nodes[xparent].right = x;
+    }
+
+    if (y != z) {
+        nodes[z].data = move(nodes[y].data);
+    }
+    for (uint32_t index = xparent; index != COMPACT_NIL; index = nodes[index].Parent()) {
+        --nodes[index].count;
+    }
+    RefreshSummaries(xparent);
+
+    if (nodes[y].IsBlack()) {
+        DeleteFixUp(x, xparent, xisleft);
+    }
+    FreeNode(y);
+    --size;
+    return true;
+}
+
+
+
+//************************************
+// Method:    DeleteFixUp.
+// FullName:  CompactRedBlackTree<T>::DeleteFixUp.
+// Access:    private.
+// Returns:   void.
+// Desc:      Same cases as RedBlackTree::RBDeleteFixUp, with
+//            COMPACT_NIL counted as black.
+// Parameter: uint32_t x (the node that replaced the removed node,
+//            it may be COMPACT_NIL).
+// Parameter: uint32_t xparent (x's parent, needed when x is COMPACT_NIL).
+// Parameter: bool xisleftchild (whether x is a left child or not).
+//************************************
+template <class T, class KeyOf, class Summary>
+void CompactRedBlackTree<T, KeyOf, Summary>::DeleteFixUp(uint32_t x, uint32_t xparent, bool xisleftchild) {
+    N* nodes = store->nodes.data();
+    auto isblack = [&](uint32_t index) { return index == COMPACT_NIL || nodes[index].IsBlack(); };
+
+    while (x != root && isblack(x)) {
+        STATS_COUNT(TREE_DELETE_FIXUPS);
+        if (xisleftchild) {
+            uint32_t w = nodes[xparent].right; // Sibling of x, never COMPACT_NIL here.
+            if (!nodes[w].IsBlack()) { // Case 1: red sibling, rotate to get a black one.
+                nodes[w].SetBlack(true);
+                nodes[xparent].SetBlack(false);
+                LeftRotate(xparent);
+                w = nodes[xparent].right;
+            }
+            if (isblack(nodes[w].left) && isblack(nodes[w].right)) { // Case 2: move the extra black up.
+                nodes[w].SetBlack(false);
+                x = xparent;
+                xparent = nodes[x].Parent();
+                if (xparent != COMPACT_NIL) {
+                    xisleftchild = (x == nodes[xparent].left);
+                }
+            } else {
+                if (isblack(nodes[w].right)) { // Case 3: turn it into case 4.
+                    nodes[nodes[w].left].SetBlack(true);
+                    nodes[w].SetBlack(false);
+                    RightRotate(w);
+                    w = nodes[xparent].right;
+                }
+                // Case 4: one rotation absorbs the extra black.
+                nodes[w].SetBlack(nodes[xparent].IsBlack());
+                nodes[xparent].SetBlack(true);
+                nodes[nodes[w].right].SetBlack(true);
+                LeftRotate(xparent);
+                x = root;
+            }
+        } else { // Symmetric to the case above.
+            uint32_t w = nodes[xparent].left;
+            if (!nodes[w].IsBlack()) {
+                nodes[w].SetBlack(true);
+                nodes[xparent].SetBlack(false);
+                RightRotate(xparent);
+                w = nodes[xparent].left;
+            }
+            if (isblack(nodes[w].left) && isblack(nodes[w].right)) {
+                nodes[w].SetBlack(false);
+                x = xparent;
+                xparent = nodes[x].Parent();
+                if (xparent != COMPACT_NIL) {
+                    xisleftchild = (x == nodes[xparent].left);
+                }
+            } else {
+                if (isblack(nodes[w].left)) {
+                    nodes[nodes[w].right].SetBlack(true);
+                    nodes[w].SetBlack(false);
+                    LeftRotate(w);
+                    w = nodes[xparent].left;
+                }
+                nodes[w].SetBlack(nodes[xparent].IsBlack());
+                nodes[xparent].SetBlack(true);
+                nodes[nodes[w].left].SetBlack(true);
+                RightRotate(xparent);
+                x = root;
+            }
+        }
+    }
+
+    if (x != COMPACT_NIL) {
+        nodes[x].SetBlack(true);
+    }
+}
+
+
+
+//************************************
+// Method:    LeftRotate.
+// FullName:  CompactRedBlackTree<T>::LeftRotate.
+// Access:    private.
+// Returns:   void.
+// Desc:      x's right child takes its place, and x becomes
+//            its left child. x must have a right child.
+// Parameter: uint32_t x (the node to rotate down).
+//************************************
+template <class T, class KeyOf, class Summary>
+void CompactRedBlackTree<T, KeyOf, Summary>::LeftRotate(uint32_t x) {
+    STATS_COUNT(TREE_LEFT_ROTATIONS);
+    N* nodes = store->nodes.data();
+    uint32_t rc = nodes[x].right;
+    uint32_t parent = nodes[x].Parent();
+
+    nodes[x].right = nodes[rc].left;
+    if (nodes[rc].left != COMPACT_NIL) {
+        nodes[nodes[rc].left].SetParent(x);
+    }
+    nodes[rc].SetParent(parent);
+    if (parent == COMPACT_NIL) {
+        root = rc;
+    } else if (x == nodes[parent].left) {
+        nodes[parent].left = rc;
+    } else {
+        nodes[parent].right = rc;
+    }
+    nodes[rc].left = x;
+    nodes[x].SetParent(rc);
+    Refresh(x); // x is now the child of rc, so it is refreshed first
+    Refresh(rc);
+}
+
+
+
+//************************************
+// Method:    RightRotate.
+// FullName:  CompactRedBlackTree<T>::RightRotate.
+// Access:    private.
+// Returns:   void.
+// Desc:      Mirror image of LeftRotate. x must have a left child.
+// Parameter: uint32_t x (the node to rotate down).
+//************************************
+template <class T, class KeyOf, class Summary>
+void CompactRedBlackTree<T, KeyOf, Summary>::RightRotate(uint32_t x) {
+    STATS_COUNT(TREE_RIGHT_ROTATIONS);
+    N* nodes = store->nodes.data();
+    uint32_t lc = nodes[x].left;
+    uint32_t parent = nodes[x].Parent();
+
+    nodes[x].left = nodes[lc].right;
+    if (nodes[lc].right != COMPACT_NIL) {
+        nodes[nodes[lc].right].SetParent(x);
+    }
+    nodes[lc].SetParent(parent);
+    if (parent == COMPACT_NIL) {
+        root = lc;
+    } else if (x == nodes[parent].left) {
+        nodes[parent].left = lc;
+    } else {
+        nodes[parent].right = lc;
+    }
+    nodes[lc].right = x;
+    nodes[x].SetParent(lc);
+    Refresh(x);
+    Refresh(lc);
+}
+
+
+
+//************************************
+// Method:    Refresh.
+// FullName:  CompactRedBlackTree<T>::Refresh.
+// Access:    private.
+// Returns:   void.
+// Parameter: uint32_t index (the node to recompute).
+//************************************
+template <class T, class KeyOf, class Summary>
+void CompactRedBlackTree<T, KeyOf, Summary>::Refresh(uint32_t index) {
+    N& node = At(index);
+    node.count = 1 + SubtreeSize(node.left) + SubtreeSize(node.right);
+    if constexpr (!is_empty<Summary>::value) {
+        Summary summary;
+        if (node.left != COMPACT_NIL) {
+            summary.Add(At(node.left).summary);
+        }
+        summary.Add(node.data);
+        if (node.right != COMPACT_NIL) {
+            summary.Add(At(node.right).summary);
+        }
+        node.summary = summary;
+    }
+}
+
+
+
+//************************************
+// Method:    RefreshSummaries.
+// FullName:  CompactRedBlackTree<T>::RefreshSummaries.
+// Access:    private.
+// Returns:   void.
+// Desc:      Does nothing for an empty Summary.
+// Parameter: uint32_t index (lowest node whose subtree changed,
+//            or COMPACT_NIL).
+//************************************
+template <class T, class KeyOf, class Summary>
+void CompactRedBlackTree<T, KeyOf, Summary>::RefreshSummaries(uint32_t index) {
+    if constexpr (!is_empty<Summary>::value) {
+        for (; index != COMPACT_NIL; index = At(index).Parent()) {
+            Refresh(index);
+        }
+    }
+}
+
+
+
+//************************************
+// Method:    RemoveAll.
+// FullName:  CompactRedBlackTree<T>::RemoveAll.
+// Access:    public.
+// Returns:   void.
+// Desc:      Destroys every item at once; the vector keeps its
+//            capacity for the next load. Shared nodes are left
+//            to the other trees.
+//************************************
+template <class T, class KeyOf, class Summary>
+void CompactRedBlackTree<T, KeyOf, Summary>::RemoveAll() {
+    if (store->refs.load(memory_order_acquire) == 1) {
+        store->nodes.clear();
+        store->freelist = COMPACT_NIL;
+    } else {
+        ReleaseStore();
+        store = new NodeStore();
+    }
+    root = COMPACT_NIL;
+    size = 0;
+}
+
+
+
+//************************************
+// Method:    Dump.
+// FullName:  CompactRedBlackTree<T>::Dump.
+// Access:    public.
+// Returns:   T* (the items in ascending order, to be deleted by
+//            the caller).
+// Qualifier: const.
+// Parameter: int& arrsize (receives the number of items).
+//************************************
+template <class T, class KeyOf, class Summary>
+T* CompactRedBlackTree<T, KeyOf, Summary>::Dump(int& arrsize) const {
+    arrsize = size;
+    T* contents = new T[size];
+    int index = 0;
+    ForEach([&](const T& item) {
+        contents[index++] = item;
+    });
+    return contents;
+}
+
+
+
+//************************************
+// Method:    begin, end.
+// FullName:  CompactRedBlackTree<T>::begin, CompactRedBlackTree<T>::end.
+// Access:    public.
+// Returns:   iterator or const_iterator.
+// Desc:      begin() descends to the smallest item, end() is
+//            past the largest one.
+//************************************
+template <class T, class KeyOf, class Summary>
+typename CompactRedBlackTree<T, KeyOf, Summary>::iterator CompactRedBlackTree<T, KeyOf, Summary>::begin() {
+    Unshare();
+    return iterator(&store->nodes, &root, SelectNode(0));
+}
+
+template <class T, class KeyOf, class Summary>
+typename CompactRedBlackTree<T, KeyOf, Summary>::iterator CompactRedBlackTree<T, KeyOf, Summary>::end() {
+    return iterator(&store->nodes, &root, COMPACT_NIL);
+}
+
+template <class T, class KeyOf, class Summary>
+typename CompactRedBlackTree<T, KeyOf, Summary>::const_iterator CompactRedBlackTree<T, KeyOf, Summary>::begin() const {
+    return const_iterator(&store->nodes, &root, SelectNode(0));
+}
+
+template <class T, class KeyOf, class Summary>
+typename CompactRedBlackTree<T, KeyOf, Summary>::const_iterator CompactRedBlackTree<T, KeyOf, Summary>::end() const {
+    return const_iterator(&store->nodes, &root, COMPACT_NIL);
+}
+
+
+
+//************************************
+// Method:    ForEach.
+// FullName:  CompactRedBlackTree<T>::ForEach.
+// Access:    public.
+// Returns:   void.
+// Qualifier: const.
+// Parameter: F visit (called with a const T& for every item, in order).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class F>
+void CompactRedBlackTree<T, KeyOf, Summary>::ForEach(F visit) const {
+    for (const_iterator it = begin(); it != end(); ++it) {
+        visit(*it);
+    }
+}
+
+
+
+//************************************
+// Method:    LowerBound, UpperBound.
+// FullName:  CompactRedBlackTree<T>::LowerBound, CompactRedBlackTree<T>::UpperBound.
+// Access:    public.
+// Returns:   iterator or const_iterator (end() if there is no such item).
+// Parameter: const K& key (an item, or anything KeyOf::Key accepts).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class K>
+typename CompactRedBlackTree<T, KeyOf, Summary>::iterator CompactRedBlackTree<T, KeyOf, Summary>::LowerBound(const K& key) {
+    Unshare();
+    return iterator(&store->nodes, &root, BoundNode(key, true));
+}
+
+template <class T, class KeyOf, class Summary>
+template <class K>
+typename CompactRedBlackTree<T, KeyOf, Summary>::const_iterator CompactRedBlackTree<T, KeyOf, Summary>::LowerBound(const K& key) const {
+    return const_iterator(&store->nodes, &root, BoundNode(key, true));
+}
+
+template <class T, class KeyOf, class Summary>
+template <class K>
+typename CompactRedBlackTree<T, KeyOf, Summary>::iterator CompactRedBlackTree<T, KeyOf, Summary>::UpperBound(const K& key) {
+    Unshare();
+    return iterator(&store->nodes, &root, BoundNode(key, false));
+}
+
+template <class T, class KeyOf, class Summary>
+template <class K>
+typename CompactRedBlackTree<T, KeyOf, Summary>::const_iterator CompactRedBlackTree<T, KeyOf, Summary>::UpperBound(const K& key) const {
+    return const_iterator(&store->nodes, &root, BoundNode(key, false));
+}
+
+
+
+//************************************
+// Method:    Select.
+// FullName:  CompactRedBlackTree<T>::Select.
+// Access:    public.
+// Returns:   iterator or const_iterator (end() if k >= Size()).
+// Parameter: unsigned int k (0 based position).
+//************************************
+template <class T, class KeyOf, class Summary>
+typename CompactRedBlackTree<T, KeyOf, Summary>::iterator CompactRedBlackTree<T, KeyOf, Summary>::Select(unsigned int k) {
+    Unshare();
+    return iterator(&store->nodes, &root, SelectNode(k));
+}
+
+template <class T, class KeyOf, class Summary>
+typename CompactRedBlackTree<T, KeyOf, Summary>::const_iterator CompactRedBlackTree<T, KeyOf, Summary>::Select(unsigned int k) const {
+    return const_iterator(&store->nodes, &root, SelectNode(k));
+}
+
+
+
+//************************************
+// Method:    Rank.
+// FullName:  CompactRedBlackTree<T>::Rank.
+// Access:    public.
+// Returns:   unsigned int (number of items with a smaller key).
+// Qualifier: const.
+// Parameter: const K& key (an item, or anything KeyOf::Key accepts).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class K>
+unsigned int CompactRedBlackTree<T, KeyOf, Summary>::Rank(const K& key) const {
+    uint32_t index = root;
+    unsigned int rank = 0;
+    auto&& k = KeyOf::Key(key);
+
+    while (index != COMPACT_NIL) {
+        const N& node = At(index);
+        if (KeyOf::Key(node.data) < k) {
+            rank += SubtreeSize(node.left) + 1;
+            index = node.right;
+        } else {
+            index = node.left;
+        }
+    }
+    return rank;
+}
+
+
+
+//************************************
+// Method:    Range.
+// FullName:  CompactRedBlackTree<T>::Range.
+// Access:    public.
+// Returns:   void.
+// Qualifier: const.
+// Desc:      O(log n + k) for k visited items.
+// Parameter: const K& lo (smallest key to visit).
+// Parameter: const K& hi (largest key to visit).
+// Parameter: F visit (called with a const T& for every item).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class K, class F>
+void CompactRedBlackTree<T, KeyOf, Summary>::Range(const K& lo, const K& hi, F visit) const {
+    auto&& last = KeyOf::Key(hi);
+    for (const_iterator it = LowerBound(lo); it != end() && !(last < KeyOf::Key(*it)); ++it) {
+        visit(*it);
+    }
+}
+
+
+
+//************************************
+// Method:    Update.
+// FullName:  CompactRedBlackTree<T>::Update.
+// Access:    public.
+// Returns:   bool (false if no item has this key).
+// Parameter: const K& key (an item, or anything KeyOf::Key accepts).
+// Parameter: F mutate (called with a T& to the item, must not
+//            change its key).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class K, class F>
+bool CompactRedBlackTree<T, KeyOf, Summary>::Update(const K& key, F mutate) {
+    Unshare();
+    uint32_t index = FindNode(key);
+    if (index == COMPACT_NIL) {
+        return false;
+    }
+    mutate(At(index).data);
+    RefreshSummaries(index);
+    return true;
+}
+
+
+
+//************************************
+// Method:    RangeSummary.
+// FullName:  CompactRedBlackTree<T>::RangeSummary.
+// Access:    public.
+// Returns:   Summary (the empty Summary if no key is in range).
+// Qualifier: const.
+// Desc:      Split node, then the two boundary paths, as in
+//            RedBlackTree::RangeSummary. O(log n).
+// Parameter: const K& lo (smallest key to include).
+// Parameter: const K& hi (largest key to include).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class K>
+Summary CompactRedBlackTree<T, KeyOf, Summary>::RangeSummary(const K& lo, const K& hi) const {
+    Summary total;
+    auto&& first = KeyOf::Key(lo);
+    auto&& last = KeyOf::Key(hi);
+    uint32_t split = root;
+    while (split != COMPACT_NIL) {
+        if (KeyOf::Key(At(split).data) < first) {
+            split = At(split).right;
+        } else if (last < KeyOf::Key(At(split).data)) {
+            split = At(split).left;
+        } else {
+            break;
+        }
+    }
+    if (split == COMPACT_NIL) {
+        return total;
+    }
+
+    total.Add(At(split).data);
+    for (uint32_t index = At(split).left; index != COMPACT_NIL;) { // lo side.
+        const N& node = At(index);
+        if (KeyOf::Key(node.data) < first) {
+            index = node.right;
+        } else {
+            total.Add(node.data);
+            if (node.right != COMPACT_NIL) {
+                total.Add(At(node.right).summary);
+            }
+            index = node.left;
+        }
+    }
+    for (uint32_t index = At(split).right; index != COMPACT_NIL;) { // hi side.
+        const N& node = At(index);
+        if (last < KeyOf::Key(node.data)) {
+            index = node.left;
+        } else {
+            total.Add(node.data);
+            if (node.left != COMPACT_NIL) {
+                total.Add(At(node.left).summary);
+            }
+            index = node.right;
+        }
+    }
+    return total;
+}
+
+
+
+//************************************
+// Method:    Size.
+// FullName:  CompactRedBlackTree<T>::Size.
+// Access:    public.
+// Returns:   unsigned int.
+// Qualifier: const.
+//************************************
+template <class T, class KeyOf, class Summary>
+unsigned int CompactRedBlackTree<T, KeyOf, Summary>::Size() const {
+    return size;
+}
+
+
+
+//************************************
+// Method:    Height.
+// FullName:  CompactRedBlackTree<T>::Height.
+// Access:    public.
+// Returns:   unsigned int.
+// Qualifier: const.
+//************************************
+template <class T, class KeyOf, class Summary>
+unsigned int CompactRedBlackTree<T, KeyOf, Summary>::Height() const {
+    unsigned int height = CalculateHeight(root);
+    return height > 0 ? height - 1 : 0;
+}
+
+
+
+//************************************
+// Method:    CalculateHeight.
+// FullName:  CompactRedBlackTree<T>::CalculateHeight.
+// Access:    private.
+// Returns:   unsigned int.
+// Qualifier: const.
+// Parameter: uint32_t index (root of the subtree).
+//************************************
+template <class T, class KeyOf, class Summary>
+unsigned int CompactRedBlackTree<T, KeyOf, Summary>::CalculateHeight(uint32_t index) const {
+    if (index == COMPACT_NIL) {
+        return 0;
+    }
+    unsigned int leftheight = CalculateHeight(At(index).left);
+    unsigned int rightheight = CalculateHeight(At(index).right);
+    return 1 + (leftheight > rightheight ? leftheight : rightheight);
+}
+
+#endif
@@ -0,0 +1,380 @@
+// File:        compacttree.h
+// Date:        2026-10-17
+// Description: Declaration of a CompactRedBlackTree class and template CompactNode class,
+//              a red-black tree whose nodes live in one vector and link by 32 bit indices
+
+#ifndef _COMPACTTREE_H_
+#define _COMPACTTREE_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "redblacktree.h"
+#include "stockstats.h"
+
+using namespace std;
+
+// Index of no node (a missing child, the root's parent). It fits the 31 bits
+//   of a parent index, so a tree holds at most COMPACT_NIL nodes.
+#define COMPACT_NIL 0x7FFFFFFFu
+
+// A node of a CompactRedBlackTree. The links are positions in the tree's node
+//   vector, and the color is the low bit of the parent link, so the links,
+//   color and subtree size take 16 bytes instead of the 32 to 40 of a Node.
+template <class T, class Summary = NoSummary>
+class CompactNode {
+public:
+    T data;
+    uint32_t left; // COMPACT_NIL if none
+    uint32_t right;
+    uint32_t parentcolor; // parent index << 1, | 1 if the node is black
+    uint32_t count; // number of nodes in the subtree rooted here, this one included
+    [[no_unique_address]] Summary summary; // aggregate of the subtree rooted here (see NoSummary)
+
+    // data is constructed in place from args
+    template <class... Args>
+    explicit CompactNode(in_place_t, Args&&... args) : data(forward<Args>(args)...), left(COMPACT_NIL), right(COMPACT_NIL), parentcolor(COMPACT_NIL << 1), count(1), summary() {
+    }
+
+    uint32_t Parent() const {
+        return parentcolor >> 1;
+    }
+
+    void SetParent(uint32_t parent) {
+        parentcolor = parent << 1 | (parentcolor & 1);
+    }
+
+    bool IsBlack() const {
+        return (parentcolor & 1) != 0;
+    }
+
+    void SetBlack(bool black) {
+        parentcolor = (parentcolor & ~1u) | (black ? 1u : 0u);
+    }
+};
+
+// Bidirectional in-order iterator over a CompactRedBlackTree, as TreeIterator.
+// It holds the tree's node vector and an index, so it stays valid when the
+//   vector grows.
+template <class N, class V>
+class CompactTreeIterator {
+private:
+    vector<N>* nodes; // the tree's nodes
+    const uint32_t* root; // the tree's root member, needed to step back from end()
+    uint32_t index; // current node, COMPACT_NIL at end()
+
+    uint32_t Leftmost(uint32_t x) const {
+        while (x != COMPACT_NIL && (*nodes)[x].left != COMPACT_NIL) {
+            x = (*nodes)[x].left;
+        }
+        return x;
+    }
+
+    uint32_t Rightmost(uint32_t x) const {
+        while (x != COMPACT_NIL && (*nodes)[x].right != COMPACT_NIL) {
+            x = (*nodes)[x].right;
+        }
+        return x;
+    }
+
+public:
+    typedef bidirectional_iterator_tag iterator_category;
+    typedef typename remove_const<V>::type value_type;
+    typedef ptrdiff_t difference_type;
+    typedef V* pointer;
+    typedef V& reference;
+
+    CompactTreeIterator() : nodes(NULL), root(NULL), index(COMPACT_NIL) {
+    }
+
+    CompactTreeIterator(vector<N>* n, const uint32_t* r, uint32_t i) : nodes(n), root(r), index(i) {
+    }
+
+    // a mutable iterator converts to a read-only one
+    operator CompactTreeIterator<N, const V>() const {
+        return CompactTreeIterator<N, const V>(nodes, root, index);
+    }
+
+    V& operator*() const {
+        return (*nodes)[index].data;
+    }
+
+    V* operator->() const {
+        return &(*nodes)[index].data;
+    }
+
+    CompactTreeIterator& operator++() {
+        if ((*nodes)[index].right != COMPACT_NIL) {
+            index = Leftmost((*nodes)[index].right);
+        } else {
+            uint32_t child = index;
+            index = (*nodes)[index].Parent();
+            while (index != COMPACT_NIL && child == (*nodes)[index].right) {
+                child = index;
+                index = (*nodes)[index].Parent();
+            }
+        }
+        return *this;
+    }
+
+    CompactTreeIterator operator++(int) {
+        CompactTreeIterator old = *this;
+        ++*this;
+        return old;
+    }
+
+    CompactTreeIterator& operator--() {
+        if (index == COMPACT_NIL) {
+            index = Rightmost(*root);
+        } else if ((*nodes)[index].left != COMPACT_NIL) {
+            index = Rightmost((*nodes)[index].left);
+        } else {
+            uint32_t child = index;
+            index = (*nodes)[index].Parent();
+            while (index != COMPACT_NIL && child == (*nodes)[index].left) {
+                child = index;
+                index = (*nodes)[index].Parent();
+            }
+        }
+        return *this;
+    }
+
+    CompactTreeIterator operator--(int) {
+        CompactTreeIterator old = *this;
+        --*this;
+        return old;
+    }
+
+    bool operator==(const CompactTreeIterator& it) const {
+        return index == it.index;
+    }
+
+    bool operator!=(const CompactTreeIterator& it) const {
+        return index != it.index;
+    }
+};
+
+// Red-black tree with the API of RedBlackTree, for small items and large
+//   trees: every node is an element of one vector, so the nodes are packed
+//   together instead of spread over the heap, and a descent follows 4 byte
+//   indices into one array. For an int, a node takes 20 bytes instead of 40.
+// The differences with RedBlackTree:
+// - There is no Alloc parameter, the vector owns the nodes. Reserve sizes it
+//   ahead of a load.
+// - Insert and Emplace may grow the vector, which invalidates the pointers
+//   returned by Retrieve and RetrieveSorted (not the iterators).
+// - A removed node's slot is kept for the next insertion, with its item
+//   still in it until then; RemoveAll empties the vector but keeps its
+//   capacity.
+// - GetRoot returns the root's index, and GetNode the node at an index.
+// KeyOf and Summary work as in RedBlackTree. Copy-on-write copies share the
+//   whole node vector.
+template <class T, class KeyOf = IdentityKeyOf, class Summary = NoSummary>
+class CompactRedBlackTree {
+private:
+    typedef CompactNode<T, Summary> N;
+
+    // The nodes, and the free slots left by Remove linked through their left
+    //   index. refs counts the trees sharing them (see SetCopyOnWrite); it is
+    //   atomic so copies may be released from different threads.
+    struct NodeStore {
+        vector<N> nodes;
+        uint32_t freelist;
+        atomic<unsigned int> refs;
+
+        NodeStore() : freelist(COMPACT_NIL), refs(1) {
+        }
+    };
+
+    NodeStore* store; // never NULL
+    uint32_t root;
+    unsigned int size;
+    bool copyonwrite; // copies share the nodes instead of cloning them
+
+    N& At(uint32_t index) const {
+        return store->nodes[index];
+    }
+
+    // subtree size of a node, 0 for COMPACT_NIL
+    unsigned int SubtreeSize(uint32_t index) const {
+        return index == COMPACT_NIL ? 0 : store->nodes[index].count;
+    }
+
+    // returns the index of a new, red, unlinked node holding T(args...),
+    //   reusing a free slot if there is one
+    template <class... Args>
+    uint32_t NewNode(Args&&... args);
+
+    // puts a node that is no longer linked on the free list
+    void FreeNode(uint32_t index);
+
+    // drops this tree's reference to its nodes, deleting them if it was the last
+    void ReleaseStore();
+
+    // gives this tree nodes of its own before it is changed
+    void Unshare();
+
+    // recursive helper for BuildFromSorted, as RedBlackTree::BuildSorted
+    template <class It>
+    uint32_t BuildSorted(It& it, unsigned int n, unsigned int depth, unsigned int reddepth, uint32_t parent);
+
+    // links a new node whose item is not in the tree yet, increments size
+    //   and fixes the tree
+    void InsertNode(uint32_t newnode);
+
+    // recomputes a node's count and summary from its children
+    void Refresh(uint32_t index);
+
+    // recomputes the summaries of a node and of all its ancestors
+    void RefreshSummaries(uint32_t index);
+
+    // rotation functions, keeping the sizes and summaries of the two rotated nodes
+    void LeftRotate(uint32_t x);
+    void RightRotate(uint32_t x);
+
+    // tree fix after the removal of a black node; x may be COMPACT_NIL
+    void DeleteFixUp(uint32_t x, uint32_t xparent, bool xisleftchild);
+
+    // recursive helper for RetrieveSorted
+    template <class K>
+    void RetrieveSorted(uint32_t index, const K* keys, unsigned int lo, unsigned int hi, T** results, StatsDescent& descent);
+
+    // index of the node holding key, or COMPACT_NIL
+    template <class K>
+    uint32_t FindNode(const K& key) const;
+
+    // as RedBlackTree::BoundNode
+    template <class K>
+    uint32_t BoundNode(const K& key, bool inclusive) const;
+
+    // index of the k-th smallest node, or COMPACT_NIL if k >= size
+    uint32_t SelectNode(unsigned int k) const;
+
+    // number of nodes on the longest path down from index
+    unsigned int CalculateHeight(uint32_t index) const;
+
+    // helper for Compact
+    // appends to order the nodes of the top levels of index's subtree, in
+    //   van Emde Boas order, and to below the roots of the subtrees under them
+    void LayOut(uint32_t index, unsigned int levels, vector<uint32_t>& order, vector<uint32_t>& below) const;
+
+public:
+
+    typedef CompactTreeIterator<N, T> iterator;
+    typedef CompactTreeIterator<N, const T> const_iterator;
+
+    CompactRedBlackTree();
+
+    // copy constructor, copies the node vector (O(n), no insertions), or
+    //   shares it with copy-on-write on
+    CompactRedBlackTree(const CompactRedBlackTree<T, KeyOf, Summary>& rbtree);
+
+    ~CompactRedBlackTree();
+
+    // as RedBlackTree::SetCopyOnWrite; a clone copies the node vector
+    void SetCopyOnWrite(bool enable);
+
+    // true if the nodes of this tree are currently shared with a copy
+    bool IsShared() const;
+
+    // makes room for n nodes, so loading that many does not grow the vector
+    void Reserve(unsigned int n);
+
+    // Repacks the nodes in van Emde Boas order: the top half of the levels
+    //   first, then each subtree below them, each laid out the same way, so
+    //   a descent stays within a few cache lines per half of its levels. The
+    //   free slots are dropped. O(n) time and space; invalidates iterators
+    //   and Retrieve pointers. BuildFromSorted calls it, and a tree grown by
+    //   random insertions searches faster after it.
+    void Compact();
+
+    // Mutators, as in RedBlackTree------------------------------------------
+
+    bool Insert(const T& item);
+    bool Insert(T&& item);
+
+    template <class... Args>
+    bool Emplace(Args&&... args);
+
+    // The new tree is laid out by Compact.
+    template <class It>
+    bool BuildFromSorted(It first, It last);
+
+    template <class K>
+    bool Remove(const K& key);
+
+    void RemoveAll();
+
+    // Accessors, as in RedBlackTree-----------------------------------------
+
+    template <class K>
+    bool Search(const K& key) const;
+
+    template <class K>
+    T* Retrieve(const K& key);
+
+    template <class K>
+    void RetrieveSorted(const K* keys, unsigned int count, T** results);
+
+    T* Dump(int& arrsize) const;
+
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    template <class F>
+    void ForEach(F visit) const;
+
+    template <class K>
+    iterator LowerBound(const K& key);
+    template <class K>
+    const_iterator LowerBound(const K& key) const;
+
+    template <class K>
+    iterator UpperBound(const K& key);
+    template <class K>
+    const_iterator UpperBound(const K& key) const;
+
+    iterator Select(unsigned int k);
+    const_iterator Select(unsigned int k) const;
+
+    template <class K>
+    unsigned int Rank(const K& key) const;
+
+    template <class K, class F>
+    void Range(const K& lo, const K& hi, F visit) const;
+
+    template <class K, class F>
+    bool Update(const K& key, F mutate);
+
+    template <class K>
+    Summary RangeSummary(const K& lo, const K& hi) const;
+
+    unsigned int Size() const;
+
+    // as RedBlackTree::Height, 0 for an empty tree or a root alone
+    unsigned int Height() const;
+
+    // index of the root, COMPACT_NIL for an empty tree
+    // NOTE: as RedBlackTree::GetRoot, for checking the tree's shape.
+    uint32_t GetRoot() const {
+        return root;
+    }
+
+    // the node at index (below the vector's size)
+    const N& GetNode(uint32_t index) const {
+        return store->nodes[index];
+    }
+
+    CompactRedBlackTree<T, KeyOf, Summary>& operator=(const CompactRedBlackTree<T, KeyOf, Summary>& rbtree);
+};
+
+#include "compacttree.cpp"
+
+#endif
@@ -0,0 +1,228 @@
+// File:        inventorykernels.cpp
+// Date:        2026-10-17
+// Description: Implementation of the aggregation kernels run over StockColumns
+
+#include "inventorykernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_HAVE_AVX2 // AVX2 versions are compiled, and used if the CPU has AVX2
+#include <immintrin.h>
+#endif
+
+// The scalar kernels, also used for the tails left by the AVX2 loops.
+
+static double SumPriceTimesStockScalar(const double* prices, const int* stocks, size_t n) {
+    double total = 0;
+    for (size_t i = 0; i < n; i++) {
+        total += prices[i] * stocks[i];
+    }
+    return total;
+}
+
+static long long SumUnitsScalar(const int* stocks, size_t n) {
+    long long total = 0;
+    for (size_t i = 0; i < n; i++) {
+        total += stocks[i];
+    }
+    return total;
+}
+
+static size_t CountBelowScalar(const int* stocks, size_t n, int threshold) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (stocks[i] < threshold) {
+            count++;
+        }
+    }
+    return count;
+}
+
+#ifdef KERNELS_HAVE_AVX2
+
+//************************************
+// Method:    SumPriceTimesStockAVX2.
+// FullName:  SumPriceTimesStockAVX2.
+// Access:    private.
+// Returns:   double.
+// Desc:      Total value of the inventory. Two accumulators of
+//            4 doubles each are kept so consecutive additions
+//            do not wait on each other.
+// Parameter: const double* prices.
+// Parameter: const int* stocks.
+// Parameter: size_t n (number of items in both arrays).
+//************************************
+__attribute__((target("avx2")))
+static double SumPriceTimesStockAVX2(const double* prices, const int* stocks, size_t n) {
+    size_t i = 0;
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+    for (; i + 8 <= n; i += 8) {
+        __m256d s0 = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*) (stocks + i)));
+        __m256d s1 = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*) (stocks + i + 4)));
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_loadu_pd(prices + i), s0));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_loadu_pd(prices + i + 4), s1));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+    double total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < n; i++) { // The tail left over by the vector loop.
+        total += prices[i] * stocks[i];
+    }
+    return total;
+}
+
+
+
+//************************************
+// Method:    SumUnitsAVX2.
+// FullName:  SumUnitsAVX2.
+// Access:    private.
+// Returns:   long long.
+// Desc:      Total number of units. Stocks are widened to
+//            64 bits before they are added up.
+// Parameter: const int* stocks.
+// Parameter: size_t n (number of items in the array).
+//************************************
+__attribute__((target("avx2")))
+static long long SumUnitsAVX2(const int* stocks, size_t n) {
+    size_t i = 0;
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_add_epi64(acc0, _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*) (stocks + i))));
+        acc1 = _mm256_add_epi64(acc1, _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*) (stocks + i + 4))));
+    }
+    long long lanes[4];
+    _mm256_storeu_si256((__m256i*) lanes, _mm256_add_epi64(acc0, acc1));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + SumUnitsScalar(stocks + i, n - i);
+}
+
+
+
+//************************************
+// Method:    CountBelowAVX2.
+// FullName:  CountBelowAVX2.
+// Access:    private.
+// Returns:   size_t.
+// Desc:      Counts the stocks below a threshold. A vector
+//            compare yields -1 in every matching lane, which
+//            is subtracted from per-lane counters.
+// Parameter: const int* stocks.
+// Parameter: size_t n (number of items in the array).
+// Parameter: int threshold.
+//************************************
+__attribute__((target("avx2")))
+static size_t CountBelowAVX2(const int* stocks, size_t n, int threshold) {
+    size_t i = 0;
+    size_t count = 0;
+    const __m256i limit = _mm256_set1_epi32(threshold);
+    while (i + 8 <= n) {
+        // The 32 bit lane counters are flushed before they can overflow.
+        size_t blockend = n - (n - i) % 8;
+        if (blockend - i > ((size_t) 1 << 31)) {
+            blockend = i + ((size_t) 1 << 31);
+        }
+        __m256i acc = _mm256_setzero_si256();
+        for (; i < blockend; i += 8) {
+            __m256i v = _mm256_loadu_si256((const __m256i*) (stocks + i));
+            acc = _mm256_sub_epi32(acc, _mm256_cmpgt_epi32(limit, v));
+        }
+        unsigned int lanes[8];
+        _mm256_storeu_si256((__m256i*) lanes, acc);
+        for (int lane = 0; lane < 8; lane++) {
+            count += lanes[lane];
+        }
+    }
+    return count + CountBelowScalar(stocks + i, n - i, threshold);
+}
+
+#endif
+
+// The version of every kernel in use
+struct KernelTable {
+    double (*sumpricetimesstock)(const double*, const int*, size_t);
+    long long (*sumunits)(const int*, size_t);
+    size_t (*countbelow)(const int*, size_t, int);
+    bool avx2;
+};
+
+//************************************
+// Method:    Kernels.
+// FullName:  Kernels.
+// Access:    private.
+// Returns:   const KernelTable&.
+// Desc:      Picks the kernels on the first call, from what
+//            the CPU supports, so one build runs everywhere.
+//            A local static rather than a global, so kernels
+//            called from another file's static constructors
+//            are already picked.
+//************************************
+static const KernelTable& Kernels() {
+    static const KernelTable table = [] {
+#ifdef KERNELS_HAVE_AVX2
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return KernelTable{SumPriceTimesStockAVX2, SumUnitsAVX2, CountBelowAVX2, true};
+        }
+#endif
+        return KernelTable{SumPriceTimesStockScalar, SumUnitsScalar, CountBelowScalar, false};
+    }();
+    return table;
+}
+
+
+
+//************************************
+// Method:    SumPriceTimesStock.
+// FullName:  SumPriceTimesStock.
+// Access:    public.
+// Returns:   double.
+// Parameter: const double* prices.
+// Parameter: const int* stocks.
+// Parameter: size_t n (number of items in both arrays).
+//************************************
+double SumPriceTimesStock(const double* prices, const int* stocks, size_t n) {
+    return Kernels().sumpricetimesstock(prices, stocks, n);
+}
+
+
+
+//************************************
+// Method:    SumUnits.
+// FullName:  SumUnits.
+// Access:    public.
+// Returns:   long long.
+// Parameter: const int* stocks.
+// Parameter: size_t n (number of items in the array).
+//************************************
+long long SumUnits(const int* stocks, size_t n) {
+    return Kernels().sumunits(stocks, n);
+}
+
+
+
+//************************************
+// Method:    CountBelow.
+// FullName:  CountBelow.
+// Access:    public.
+// Returns:   size_t.
+// Parameter: const int* stocks.
+// Parameter: size_t n (number of items in the array).
+// Parameter: int threshold.
+//************************************
+size_t CountBelow(const int* stocks, size_t n, int threshold) {
+    return Kernels().countbelow(stocks, n, threshold);
+}
+
+
+
+//************************************
+// Method:    KernelsUseAVX2.
+// FullName:  KernelsUseAVX2.
+// Access:    public.
+// Returns:   bool.
+// Desc:      Reports which version of the kernels was picked.
+//************************************
+bool KernelsUseAVX2() {
+    return Kernels().avx2;
+}
@@ -0,0 +1,25 @@
+// File:        inventorykernels.h
+// Date:        2026-10-17
+// Description: Declaration of the aggregation kernels run over StockColumns
+
+#pragma once
+
+#include <cstddef>
+
+// Each kernel works on plain arrays of n elements.
+// On x86 an AVX2 version of each kernel, processing 8 items per iteration, is
+//   always compiled in, and used if the CPU supports AVX2 (checked once, on
+//   the first call); otherwise the scalar loops are used. No build flag is
+//   needed.
+
+// returns the sum of prices[i] * stocks[i]
+double SumPriceTimesStock(const double* prices, const int* stocks, size_t n);
+
+// returns the sum of stocks[i]
+long long SumUnits(const int* stocks, size_t n);
+
+// returns the number of i for which stocks[i] < threshold
+size_t CountBelow(const int* stocks, size_t n, int threshold);
+
+// true if the AVX2 kernels are in use
+bool KernelsUseAVX2();
@@ -2,18 +2,41 @@
 #include <string.h>
 #include "time.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
 #include <iostream>
 #include <cstdlib>
 #include <string>
 
 #include "stocksystem.h"
+#include "commandstream.h"
+#include "wireformat.h"
 
 using namespace std;
 
 void PrintMenu();
+void PrintStats();
+int RunBatch(const char* path);
+int RunReplay(const char* path, const char* resultpath);
+
 
+// Usage: simulator                  interactive menu
+//        simulator --batch [file]   runs the commands in file (or stdin, also for "-"),
+//                                   see commandstream.h for the command format
+//        simulator --replay file [results]
+//                                   applies binary command records from file (or stdin
+//                                   for "-"), writing binary results to results (stdout
+//                                   for "-"), see wireformat.h for the record formats
+int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--batch") == 0) {
+        return RunBatch(argc > 2 ? argv[2] : "-");
+    }
+    if (argc > 2 && strcmp(argv[1], "--replay") == 0) {
+        return RunReplay(argv[2], argc > 3 ? argv[3] : NULL);
+    }
 
-int main() {
     int choice = 0;
     string inputchoice;
     int asku;
@@ -126,4 +149,87 @@ void PrintMenu() {
             << "* 5. Edit item price           8. Quit             *\n"
             << "****************************************************\n" << endl;
     cout << "Enter your choice: ";
-}
\ No newline at end of file
+}
+
+// Writes the instrumentation counters to stderr, if the build has them (STOCK_STATS).
+void PrintStats() {
+    StockStats counters = StockSystem::Stats();
+    if (counters.enabled) {
+        counters.Write(cerr);
+    }
+}
+
+// Runs a command stream against a new store, writing the results to stdout
+//   and the throughput to stderr. Returns the exit status.
+int RunBatch(const char* path) {
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) {
+        cerr << "Cannot open " << path << endl;
+        return 1;
+    }
+
+    StockSystem mystore;
+    CatalogueWriter results(STDOUT_FILENO);
+    CommandReader reader(fd);
+    CommandRunner runner(mystore, results);
+    string_view line;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    while (reader.NextLine(line)) {
+        runner.Run(line);
+    }
+    runner.Finish();
+    bool written = results.Flush();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    const CommandStats& stats = runner.Stats();
+    cerr << stats.commands << " commands (" << stats.failed << " failed, " << stats.invalid << " invalid lines) in "
+        << seconds << " s, " << (seconds > 0 ? stats.commands / seconds : 0) << " commands/s" << endl;
+    PrintStats();
+    return written && stats.invalid == 0 ? 0 : 1;
+}
+
+// Replays binary command records against a new store, writing binary results
+//   to resultpath if it is not NULL and the throughput to stderr. Returns the
+//   exit status.
+int RunReplay(const char* path, const char* resultpath) {
+    WireReader reader;
+    if (strcmp(path, "-") == 0) {
+        reader.OpenDescriptor(STDIN_FILENO);
+    } else if (!reader.Open(path)) {
+        cerr << "Cannot open " << path << endl;
+        return 1;
+    }
+    int resultfd = -1;
+    if (resultpath != NULL) {
+        resultfd = strcmp(resultpath, "-") == 0 ? STDOUT_FILENO : open(resultpath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (resultfd < 0) {
+            cerr << "Cannot create " << resultpath << endl;
+            return 1;
+        }
+    }
+
+    StockSystem mystore;
+    CatalogueWriter results(resultfd);
+    WireReplayer replayer(mystore, resultfd >= 0 ? &results : NULL);
+    WireCommand command;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    while (reader.Next(command)) {
+        replayer.Run(command);
+    }
+    bool written = results.Flush();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (resultfd >= 0 && resultfd != STDOUT_FILENO) {
+        written = close(resultfd) == 0 && written;
+    }
+    const CommandStats& stats = replayer.Stats();
+    cerr << stats.commands << " commands (" << stats.failed << " failed, " << stats.invalid << " invalid records) in "
+        << seconds << " s, " << (seconds > 0 ? stats.commands / seconds : 0) << " commands/s" << endl;
+    PrintStats();
+    return written && stats.invalid == 0 ? 0 : 1;
+}
@@ -0,0 +1,246 @@
+// File:        nodeallocator.cpp
+// Date:        2026-10-17
+// Description: Implementation of the node allocators used by RedBlackTree
+
+#ifdef _NODEALLOCATOR_H_
+
+//************************************
+// Method:    Create.
+// FullName:  NewDeleteNodeAllocator<N>::Create.
+// Access:    public.
+// Returns:   N* (the newly constructed node).
+// Desc:      Allocates a node on the heap.
+// Parameter: Args&&... args (forwarded to the node's constructor).
+//************************************
+template <class N>
+template <class... Args>
+N* NewDeleteNodeAllocator<N>::Create(Args&&... args) {
+    return new N(forward<Args>(args)...);
+}
+
+//************************************
+// Method:    Destroy.
+// FullName:  NewDeleteNodeAllocator<N>::Destroy.
+// Access:    public.
+// Returns:   void.
+// Desc:      Deletes a single node.
+// Parameter: N* node (node to be deleted).
+//************************************
+template <class N>
+void NewDeleteNodeAllocator<N>::Destroy(N* node) {
+    delete node;
+}
+
+//************************************
+// Method:    DestroyAll.
+// FullName:  NewDeleteNodeAllocator<N>::DestroyAll.
+// Access:    public.
+// Returns:   void.
+// Desc:      Deletes every node of a subtree
+//            using post order traversal.
+// Parameter: N* node (current recursion node).
+//************************************
+template <class N>
+void NewDeleteNodeAllocator<N>::DestroyAll(N* node) {
+    if (node != NULL) {
+        DestroyAll(node->left);
+        DestroyAll(node->right);
+        delete node;
+    }
+}
+
+//************************************
+// Method:    Swap.
+// FullName:  NewDeleteNodeAllocator<N>::Swap.
+// Access:    public.
+// Returns:   void.
+// Desc:      Nothing to exchange, every node belongs to the heap.
+// Parameter: NewDeleteNodeAllocator& other (unused).
+//************************************
+template <class N>
+void NewDeleteNodeAllocator<N>::Swap(NewDeleteNodeAllocator&) {
+}
+
+
+
+//************************************
+// Method:    PoolNodeAllocator.
+// FullName:  PoolNodeAllocator<N, NODES_PER_SLAB>::PoolNodeAllocator.
+// Access:    public.
+// Desc:      Default constructor, starts with no slabs.
+//************************************
+template <class N, size_t NODES_PER_SLAB>
+PoolNodeAllocator<N, NODES_PER_SLAB>::PoolNodeAllocator() : used(NODES_PER_SLAB), freelist(NULL) {
+}
+
+//************************************
+// Method:    PoolNodeAllocator.
+// FullName:  PoolNodeAllocator<N, NODES_PER_SLAB>::PoolNodeAllocator.
+// Access:    public.
+// Desc:      Copy constructor. Nodes are never shared between
+//            pools, so the copy starts empty.
+//************************************
+template <class N, size_t NODES_PER_SLAB>
+PoolNodeAllocator<N, NODES_PER_SLAB>::PoolNodeAllocator(const PoolNodeAllocator& pool) : used(NODES_PER_SLAB), freelist(NULL) {
+}
+
+//************************************
+// Method:    operator=.
+// FullName:  PoolNodeAllocator<N, NODES_PER_SLAB>::operator=.
+// Access:    public.
+// Desc:      Keeps this pool's own slabs, they belong to
+//            the tree that owns this pool.
+//************************************
+template <class N, size_t NODES_PER_SLAB>
+PoolNodeAllocator<N, NODES_PER_SLAB>& PoolNodeAllocator<N, NODES_PER_SLAB>::operator=(const PoolNodeAllocator& pool) {
+    return *this;
+}
+
+//************************************
+// Method:    ~PoolNodeAllocator.
+// FullName:  PoolNodeAllocator<N, NODES_PER_SLAB>::~PoolNodeAllocator.
+// Access:    public.
+// Desc:      Releases every slab. The owning tree has
+//            already destructed its nodes by then.
+//************************************
+template <class N, size_t NODES_PER_SLAB>
+PoolNodeAllocator<N, NODES_PER_SLAB>::~PoolNodeAllocator() {
+    for (size_t i = 0; i < slabs.size(); i++) {
+        ::operator delete(slabs[i]);
+    }
+}
+
+//************************************
+// Method:    Allocate.
+// FullName:  PoolNodeAllocator<N, NODES_PER_SLAB>::Allocate.
+// Access:    private.
+// Returns:   void* (storage for one node).
+// Desc:      Pops a recycled slot from the free list, or carves
+//            the next slot out of the current slab, starting
+//            a new slab when the current one is full.
+//************************************
+template <class N, size_t NODES_PER_SLAB>
+void* PoolNodeAllocator<N, NODES_PER_SLAB>::Allocate() {
+    if (freelist != NULL) {
+        Slot* slot = freelist;
+        freelist = slot->next;
+        return slot;
+    }
+    if (used == NODES_PER_SLAB) {
+        slabs.push_back(static_cast<Slot*>(::operator new(sizeof(Slot) * NODES_PER_SLAB)));
+        used = 0;
+    }
+    return &slabs.back()[used++];
+}
+
+//************************************
+// Method:    Create.
+// FullName:  PoolNodeAllocator<N, NODES_PER_SLAB>::Create.
+// Access:    public.
+// Returns:   N* (the newly constructed node).
+// Desc:      Constructs a node in a pooled slot.
+// Parameter: Args&&... args (forwarded to the node's constructor).
+//************************************
+template <class N, size_t NODES_PER_SLAB>
+template <class... Args>
+N* PoolNodeAllocator<N, NODES_PER_SLAB>::Create(Args&&... args) {
+    void* storage = Allocate();
+    try {
+        return new (storage) N(forward<Args>(args)...);
+    } catch (...) { // Give the slot back if the value's constructor throws.
+        Slot* slot = static_cast<Slot*>(storage);
+        slot->next = freelist;
+        freelist = slot;
+        throw;
+    }
+}
+
+//************************************
+// Method:    Destroy.
+// FullName:  PoolNodeAllocator<N, NODES_PER_SLAB>::Destroy.
+// Access:    public.
+// Returns:   void.
+// Desc:      Destructs a node and pushes its slot on the free
+//            list so the next Create reuses it.
+// Parameter: N* node (node to be destroyed).
+//************************************
+template <class N, size_t NODES_PER_SLAB>
+void PoolNodeAllocator<N, NODES_PER_SLAB>::Destroy(N* node) {
+    if (node != NULL) {
+        node->~N();
+        Slot* slot = reinterpret_cast<Slot*>(node);
+        slot->next = freelist;
+        freelist = slot;
+    }
+}
+
+//************************************
+// Method:    DestructAll.
+// FullName:  PoolNodeAllocator<N, NODES_PER_SLAB>::DestructAll.
+// Access:    private.
+// Returns:   void.
+// Desc:      Runs the destructor of every node of a subtree
+//            in post order, without releasing any storage.
+// Parameter: N* node (current recursion node).
+//************************************
+template <class N, size_t NODES_PER_SLAB>
+void PoolNodeAllocator<N, NODES_PER_SLAB>::DestructAll(N* node) {
+    if (node != NULL) {
+        DestructAll(node->left);
+        DestructAll(node->right);
+        node->~N();
+    }
+}
+
+//************************************
+// Method:    DestroyAll.
+// FullName:  PoolNodeAllocator<N, NODES_PER_SLAB>::DestroyAll.
+// Access:    public.
+// Returns:   void.
+// Desc:      Destroys a whole tree at once by dropping every
+//            slab. Node destructors only need to run when
+//            they actually do something.
+// Parameter: N* node (root of the tree using this pool).
+//************************************
+template <class N, size_t NODES_PER_SLAB>
+void PoolNodeAllocator<N, NODES_PER_SLAB>::DestroyAll(N* node) {
+    if (!is_trivially_destructible<N>::value) {
+        DestructAll(node);
+    }
+    for (size_t i = 0; i < slabs.size(); i++) {
+        ::operator delete(slabs[i]);
+    }
+    slabs.clear();
+    used = NODES_PER_SLAB;
+    freelist = NULL;
+}
+
+//************************************
+// Method:    Swap.
+// FullName:  PoolNodeAllocator<N, NODES_PER_SLAB>::Swap.
+// Access:    public.
+// Returns:   void.
+// Desc:      Hands every slab, and the nodes in them, over to
+//            the other pool and takes the other pool's.
+// Parameter: PoolNodeAllocator& pool (the pool to swap with).
+//************************************
+template <class N, size_t NODES_PER_SLAB>
+void PoolNodeAllocator<N, NODES_PER_SLAB>::Swap(PoolNodeAllocator& pool) {
+    slabs.swap(pool.slabs);
+    swap(used, pool.used);
+    swap(freelist, pool.freelist);
+}
+
+//************************************
+// Method:    SlabCount.
+// FullName:  PoolNodeAllocator<N, NODES_PER_SLAB>::SlabCount.
+// Access:    public.
+// Returns:   size_t.
+// Desc:      Returns the number of slabs held by the pool.
+//************************************
+template <class N, size_t NODES_PER_SLAB>
+size_t PoolNodeAllocator<N, NODES_PER_SLAB>::SlabCount() const {
+    return slabs.size();
+}
+
+#endif
@@ -0,0 +1,102 @@
+// File:        nodeallocator.h
+// Date:        2026-10-17
+// Description: Declaration of the node allocators used by RedBlackTree
+
+#ifndef _NODEALLOCATOR_H_
+#define _NODEALLOCATOR_H_
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Allocates every node with its own new/delete.
+// This is the behaviour RedBlackTree always had, and it is still its default.
+template <class N>
+class NewDeleteNodeAllocator {
+public:
+    // the same allocator for another node type
+    template <class M>
+    struct Rebind {
+        typedef NewDeleteNodeAllocator<M> Other;
+    };
+
+    // allocates a node and constructs it from args (forwarded to N's constructor)
+    template <class... Args>
+    N* Create(Args&&... args);
+
+    // destructs and deallocates a single node
+    void Destroy(N* node);
+
+    // destructs and deallocates every node of the subtree rooted at node
+    // (post-order, one delete per node)
+    void DestroyAll(N* node);
+
+    // exchanges the nodes owned by two allocators (nothing to do, the heap owns them)
+    void Swap(NewDeleteNodeAllocator& other);
+};
+
+// Slab/arena allocator owned by a single tree.
+// Nodes are carved out of contiguous slabs of NODES_PER_SLAB nodes, freed nodes
+//   are recycled through a free list, and DestroyAll releases whole slabs at once.
+template <class N, size_t NODES_PER_SLAB = 1024 >
+class PoolNodeAllocator {
+private:
+    // a freed slot is reused to hold the free list link
+    union Slot {
+        Slot* next;
+        alignas(N) unsigned char storage[sizeof(N)];
+    };
+
+    vector<Slot*> slabs; // every slab allocated so far, the last one is being carved
+    size_t used; // number of slots handed out from the last slab
+    Slot* freelist; // slots returned by Destroy
+
+    // returns raw storage for one node
+    void* Allocate();
+
+    // runs the node destructors of a subtree without releasing storage
+    void DestructAll(N* node);
+
+public:
+    // the same allocator (and slab size) for another node type
+    template <class M>
+    struct Rebind {
+        typedef PoolNodeAllocator<M, NODES_PER_SLAB> Other;
+    };
+
+    PoolNodeAllocator();
+
+    // a pool is never shared, a copied tree starts with its own empty pool
+    PoolNodeAllocator(const PoolNodeAllocator& pool);
+    PoolNodeAllocator& operator=(const PoolNodeAllocator& pool);
+
+    // releases every slab
+    ~PoolNodeAllocator();
+
+    // allocates a node and constructs it from args (forwarded to N's constructor)
+    template <class... Args>
+    N* Create(Args&&... args);
+
+    // destructs a single node and puts its slot on the free list
+    void Destroy(N* node);
+
+    // destructs the subtree rooted at node and releases all slabs.
+    // The walk is skipped entirely when N is trivially destructible,
+    //   so the cost is O(number of slabs).
+    // node must be the root of the only tree using this pool.
+    void DestroyAll(N* node);
+
+    // exchanges the slabs (and so the nodes) of two pools
+    void Swap(PoolNodeAllocator& pool);
+
+    // number of slabs currently held
+    size_t SlabCount() const;
+};
+
+#include "nodeallocator.cpp"
+
+#endif
@@ -0,0 +1,674 @@
+// File:        persistenttree.cpp
+// Date:        2026-10-17
+// Description: Implementation of a PersistentTree class
+
+#ifdef _PERSISTENTTREE_H_
+
+//************************************
+// Method:    PersistentTree.
+// FullName:  PersistentTree<T>::PersistentTree.
+// Access:    public.
+// Qualifier: : root(NULL), size(0).
+// Desc:      Default constructor, an empty tree.
+//************************************
+template <class T, class KeyOf, class Summary>
+PersistentTree<T, KeyOf, Summary>::PersistentTree() : root(NULL), size(0) {
+}
+
+
+
+//************************************
+// Method:    PersistentTree.
+// FullName:  PersistentTree<T>::PersistentTree.
+// Access:    public.
+// Qualifier: : root(tree.root), size(tree.size).
+// Desc:      Copy constructor. Both trees hold the same
+//            version, nothing is copied.
+// Parameter: const PersistentTree& tree (the version to hold).
+//************************************
+template <class T, class KeyOf, class Summary>
+PersistentTree<T, KeyOf, Summary>::PersistentTree(const PersistentTree& tree) : root(tree.root), size(tree.size) {
+    Retain(root);
+}
+
+
+
+//************************************
+// Method:    operator=.
+// FullName:  PersistentTree<T>::operator=.
+// Access:    public.
+// Returns:   PersistentTree<T>&.
+// Desc:      Holds the version of tree instead of this one.
+//            The new root is retained before the old one is
+//            released, so self assignment is harmless.
+// Parameter: const PersistentTree& tree (the version to hold).
+//************************************
+template <class T, class KeyOf, class Summary>
+PersistentTree<T, KeyOf, Summary>& PersistentTree<T, KeyOf, Summary>::operator=(const PersistentTree& tree) {
+    Retain(tree.root);
+    Release(root);
+    root = tree.root;
+    size = tree.size;
+    return *this;
+}
+
+
+
+//************************************
+// Method:    ~PersistentTree.
+// FullName:  PersistentTree<T>::~PersistentTree.
+// Access:    public.
+// Desc:      Releases this version; the nodes no other
+//            version reaches are deleted.
+//************************************
+template <class T, class KeyOf, class Summary>
+PersistentTree<T, KeyOf, Summary>::~PersistentTree() {
+    Release(root);
+}
+
+
+
+//************************************
+// Method:    Retain, Release.
+// FullName:  PersistentTree<T>::Retain, PersistentTree<T>::Release.
+// Access:    private.
+// Returns:   void.
+// Desc:      Reference counting of a node. The count drops to
+//            zero exactly once, on whichever thread lets go
+//            last, which then releases the children.
+// Parameter: PersistentNode<T, Summary>* node (may be NULL).
+//************************************
+template <class T, class KeyOf, class Summary>
+void PersistentTree<T, KeyOf, Summary>::Retain(PersistentNode<T, Summary>* node) {
+    if (node != NULL) {
+        node->refs.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+template <class T, class KeyOf, class Summary>
+void PersistentTree<T, KeyOf, Summary>::Release(PersistentNode<T, Summary>* node) {
+    if (node != NULL && node->refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+        Release(node->left);
+        Release(node->right);
+        delete node;
+    }
+}
+
+
+
+//************************************
+// Method:    Refresh.
+// FullName:  PersistentTree<T>::Refresh.
+// Access:    private.
+// Returns:   void.
+// Desc:      Recomputes count and summary of a node that is
+//            still being built (and so not visible yet).
+// Parameter: PersistentNode<T, Summary>* node.
+//************************************
+template <class T, class KeyOf, class Summary>
+void PersistentTree<T, KeyOf, Summary>::Refresh(PersistentNode<T, Summary>* node) {
+    node->count = 1 + SubtreeSize(node->left) + SubtreeSize(node->right);
+    if constexpr (!is_empty<Summary>::value) {
+        Summary summary;
+        if (node->left != NULL) {
+            summary.Add(node->left->summary);
+        }
+        summary.Add(node->data);
+        if (node->right != NULL) {
+            summary.Add(node->right->summary);
+        }
+        node->summary = summary;
+    }
+}
+
+
+
+//************************************
+// Method:    Insert.
+// FullName:  PersistentTree<T>::Insert.
+// Access:    public.
+// Returns:   bool (false if the item is already in the tree).
+// Desc:      Looks for the item first, so a duplicate copies
+//            nothing. The new path then replaces the old root,
+//            which is released (and freed along with the old
+//            path, unless another version holds it).
+// Parameter: const T& item (value for the node to insert).
+//************************************
+template <class T, class KeyOf, class Summary>
+bool PersistentTree<T, KeyOf, Summary>::Insert(const T& item) {
+    if (Search(item)) {
+        return false;
+    }
+    PersistentNode<T, Summary>* newnode = new PersistentNode<T, Summary>(item);
+    Refresh(newnode);
+    StatsDescent descent;
+    PersistentNode<T, Summary>* newroot = InsertPath(root, newnode, descent);
+    newroot->is_black = true; // Balance may leave a red root.
+    Release(root);
+    root = newroot;
+    ++size;
+    return true;
+}
+
+
+
+//************************************
+// Method:    InsertPath.
+// FullName:  PersistentTree<T>::InsertPath.
+// Access:    private.
+// Returns:   PersistentNode<T, Summary>* (new root of the subtree).
+// Desc:      Functional red-black insertion: each node on the
+//            search path is copied, the copy takes the new
+//            subtree on one side and shares the old one on the
+//            other, then Balance repairs the colors.
+// Parameter: const PersistentNode<T, Summary>* node (subtree of the old version).
+// Parameter: PersistentNode<T, Summary>* newnode (the red node to insert).
+// Parameter: StatsDescent& descent (counts the nodes copied).
+//************************************
+template <class T, class KeyOf, class Summary>
+PersistentNode<T, Summary>* PersistentTree<T, KeyOf, Summary>::InsertPath(const PersistentNode<T, Summary>* node, PersistentNode<T, Summary>* newnode, StatsDescent& descent) {
+    if (node == NULL) {
+        return newnode;
+    }
+    descent.Visit();
+    PersistentNode<T, Summary>* copy = new PersistentNode<T, Summary>(node->data);
+    copy->is_black = node->is_black;
+    if (KeyOf::Key(newnode->data) < KeyOf::Key(node->data)) {
+        copy->left = InsertPath(node->left, newnode, descent);
+        copy->right = node->right;
+        Retain(copy->right);
+    } else {
+        copy->left = node->left;
+        Retain(copy->left);
+        copy->right = InsertPath(node->right, newnode, descent);
+    }
+    Refresh(copy);
+    return Balance(copy);
+}
+
+
+
+//************************************
+// Method:    Balance.
+// FullName:  PersistentTree<T>::Balance.
+// Access:    private.
+// Returns:   PersistentNode<T, Summary>* (new root of the subtree).
+// Desc:      A red node with a red child can only appear on
+//            the copied path, so all three nodes involved are
+//            new and are relinked in place. Whichever of the
+//            four shapes the black node z, its red child and
+//            red grandchild form, the middle key becomes a red
+//            root with two black children (as in Okasaki's
+//            functional insertion). The shared subtrees below
+//            only change parent, so no count changes.
+// Parameter: PersistentNode<T, Summary>* node (a new node).
+//************************************
+template <class T, class KeyOf, class Summary>
+PersistentNode<T, Summary>* PersistentTree<T, KeyOf, Summary>::Balance(PersistentNode<T, Summary>* node) {
+    if (!node->is_black) {
+        return node;
+    }
+    PersistentNode<T, Summary>* z = node;
+    PersistentNode<T, Summary>* x;
+    PersistentNode<T, Summary>* y;
+    PersistentNode<T, Summary>* red = z->left;
+    if (red != NULL && !red->is_black && red->left != NULL && !red->left->is_black) { // left-left
+        y = red;
+        x = red->left;
+        z->left = y->right;
+        y->left = x;
+        y->right = z;
+    } else if (red != NULL && !red->is_black && red->right != NULL && !red->right->is_black) { // left-right
+        x = red;
+        y = red->right;
+        x->right = y->left;
+        z->left = y->right;
+        y->left = x;
+        y->right = z;
+    } else if ((red = z->right) != NULL && !red->is_black && red->right != NULL && !red->right->is_black) { // right-right
+        y = red;
+        x = red->right;
+        z->right = y->left;
+        y->left = z;
+        y->right = x;
+    } else if (red != NULL && !red->is_black && red->left != NULL && !red->left->is_black) { // right-left
+        x = red;
+        y = red->left;
+        x->left = y->right;
+        z->right = y->left;
+        y->left = z;
+        y->right = x;
+    } else {
+        return node;
+    }
+    y->left->is_black = true;
+    y->right->is_black = true;
+    y->is_black = false;
+    Refresh(y->left);
+    Refresh(y->right);
+    Refresh(y);
+    return y;
+}
+
+
+
+//************************************
+// Method:    Update.
+// FullName:  PersistentTree<T>::Update.
+// Access:    public.
+// Returns:   bool (false if no item has this key).
+// Desc:      Copies the path down to the item and changes the
+//            copy, so O(log n) new nodes per update and no
+//            rebalancing (the shape does not change).
+// Parameter: const K& key (an item, or anything KeyOf::Key accepts).
+// Parameter: F mutate (called with a T& to the new copy of the
+//            item, must not change its key).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class K, class F>
+bool PersistentTree<T, KeyOf, Summary>::Update(const K& key, F mutate) {
+    if (FindNode(key) == NULL) {
+        return false;
+    }
+    auto&& target = KeyOf::Key(key);
+    StatsDescent descent;
+    PersistentNode<T, Summary>* newroot = UpdatePath(root, target, mutate, descent);
+    Release(root);
+    root = newroot;
+    return true;
+}
+
+
+
+//************************************
+// Method:    UpdatePath.
+// FullName:  PersistentTree<T>::UpdatePath.
+// Access:    private.
+// Returns:   PersistentNode<T, Summary>* (the copy of node).
+// Desc:      Copies node, recursing toward the key, and shares
+//            the child off the path.
+// Parameter: const PersistentNode<T, Summary>* node (on the path, not NULL).
+// Parameter: const K& key (the key of the item to change).
+// Parameter: F& mutate.
+// Parameter: StatsDescent& descent (counts the nodes copied).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class K, class F>
+PersistentNode<T, Summary>* PersistentTree<T, KeyOf, Summary>::UpdatePath(const PersistentNode<T, Summary>* node, const K& key, F& mutate, StatsDescent& descent) {
+    descent.Visit();
+    PersistentNode<T, Summary>* copy = new PersistentNode<T, Summary>(node->data);
+    copy->is_black = node->is_black;
+    copy->left = node->left;
+    copy->right = node->right;
+    if (key < KeyOf::Key(node->data)) {
+        copy->left = UpdatePath(node->left, key, mutate, descent);
+        Retain(copy->right);
+    } else if (KeyOf::Key(node->data) < key) {
+        copy->right = UpdatePath(node->right, key, mutate, descent);
+        Retain(copy->left);
+    } else {
+        mutate(copy->data);
+        Retain(copy->left);
+        Retain(copy->right);
+    }
+    Refresh(copy);
+    return copy;
+}
+
+
+
+//************************************
+// Method:    BuildFromSorted.
+// FullName:  PersistentTree<T>::BuildFromSorted.
+// Access:    public.
+// Returns:   bool (false if the items are not in strictly
+//            ascending order).
+// Desc:      Same construction as RedBlackTree::BuildFromSorted.
+//            The old version is released once the new one is
+//            complete.
+// Parameter: It first (iterator to the smallest item).
+// Parameter: It last (iterator past the largest item).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class It>
+bool PersistentTree<T, KeyOf, Summary>::BuildFromSorted(It first, It last) {
+    unsigned int n = 0;
+    for (It it = first, prev = first; it != last; prev = it, ++it, ++n) {
+        if (n > 0 && !(KeyOf::Key(*prev) < KeyOf::Key(*it))) {
+            return false;
+        }
+    }
+    unsigned int reddepth = 0; // floor(log2(n + 1)), beyond the last level if it is full
+    while ((n + 1) >> (reddepth + 1) != 0) {
+        ++reddepth;
+    }
+    PersistentNode<T, Summary>* newroot = BuildSorted(first, n, 0, reddepth);
+    Release(root);
+    root = newroot;
+    size = n;
+    return true;
+}
+
+
+
+//************************************
+// Method:    BuildSorted.
+// FullName:  PersistentTree<T>::BuildSorted.
+// Access:    private.
+// Returns:   PersistentNode<T, Summary>* (root of the new subtree, NULL if n is 0).
+// Parameter: It& it (next item to read).
+// Parameter: unsigned int n (number of items in the subtree).
+// Parameter: unsigned int depth (depth of the subtree's root).
+// Parameter: unsigned int reddepth (depth of the red nodes).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class It>
+PersistentNode<T, Summary>* PersistentTree<T, KeyOf, Summary>::BuildSorted(It& it, unsigned int n, unsigned int depth, unsigned int reddepth) {
+    if (n == 0) {
+        return NULL;
+    }
+    unsigned int leftcount = (n - 1) / 2;
+    PersistentNode<T, Summary>* left = BuildSorted(it, leftcount, depth + 1, reddepth);
+    PersistentNode<T, Summary>* node = new PersistentNode<T, Summary>(*it);
+    ++it;
+    node->is_black = depth != reddepth;
+    node->left = left;
+    node->right = BuildSorted(it, n - 1 - leftcount, depth + 1, reddepth);
+    Refresh(node);
+    return node;
+}
+
+
+
+//************************************
+// Method:    RemoveAll.
+// FullName:  PersistentTree<T>::RemoveAll.
+// Access:    public.
+// Returns:   void.
+//************************************
+template <class T, class KeyOf, class Summary>
+void PersistentTree<T, KeyOf, Summary>::RemoveAll() {
+    Release(root);
+    root = NULL;
+    size = 0;
+}
+
+
+
+//************************************
+// Method:    FindNode.
+// FullName:  PersistentTree<T>::FindNode.
+// Access:    private.
+// Returns:   const PersistentNode<T, Summary>* (NULL if not found).
+// Qualifier: const.
+// Parameter: const K& key (an item, or anything KeyOf::Key accepts).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class K>
+const PersistentNode<T, Summary>* PersistentTree<T, KeyOf, Summary>::FindNode(const K& key) const {
+    auto&& target = KeyOf::Key(key);
+    const PersistentNode<T, Summary>* node = root;
+    STATS_DESCENT(descent);
+    while (node != NULL) {
+        STATS_VISIT(descent);
+        if (target < KeyOf::Key(node->data)) {
+            node = node->left;
+        } else if (KeyOf::Key(node->data) < target) {
+            node = node->right;
+        } else {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+
+
+//************************************
+// Method:    Search, Retrieve.
+// FullName:  PersistentTree<T>::Search, PersistentTree<T>::Retrieve.
+// Access:    public.
+// Qualifier: const.
+// Desc:      Lookups, O(log n).
+// Parameter: const K& key (an item, or anything KeyOf::Key accepts).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class K>
+bool PersistentTree<T, KeyOf, Summary>::Search(const K& key) const {
+    return FindNode(key) != NULL;
+}
+
+template <class T, class KeyOf, class Summary>
+template <class K>
+const T* PersistentTree<T, KeyOf, Summary>::Retrieve(const K& key) const {
+    const PersistentNode<T, Summary>* node = FindNode(key);
+    return node == NULL ? NULL : &node->data;
+}
+
+
+
+//************************************
+// Method:    ForEach.
+// FullName:  PersistentTree<T>::ForEach.
+// Access:    public.
+// Returns:   void.
+// Qualifier: const.
+// Desc:      In-order traversal. There are no parent pointers
+//            to walk, so it recurses (depth O(log n)).
+// Parameter: F visit (called with a const T& for every item).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class F>
+void PersistentTree<T, KeyOf, Summary>::ForEach(F visit) const {
+    InOrder(root, visit);
+}
+
+template <class T, class KeyOf, class Summary>
+template <class F>
+void PersistentTree<T, KeyOf, Summary>::InOrder(const PersistentNode<T, Summary>* node, F& visit) {
+    if (node != NULL) {
+        InOrder(node->left, visit);
+        visit(static_cast<const T&>(node->data));
+        InOrder(node->right, visit);
+    }
+}
+
+
+
+//************************************
+// Method:    Range.
+// FullName:  PersistentTree<T>::Range.
+// Access:    public.
+// Returns:   void.
+// Qualifier: const.
+// Desc:      In-order traversal that only enters subtrees which
+//            can hold keys in [lo, hi], O(log n + k).
+// Parameter: const K& lo (smallest key to visit).
+// Parameter: const K& hi (largest key to visit).
+// Parameter: F visit (called with a const T& for every item).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class K, class F>
+void PersistentTree<T, KeyOf, Summary>::Range(const K& lo, const K& hi, F visit) const {
+    auto&& first = KeyOf::Key(lo);
+    auto&& last = KeyOf::Key(hi);
+    RangeFrom(root, first, last, visit);
+}
+
+template <class T, class KeyOf, class Summary>
+template <class K, class F>
+void PersistentTree<T, KeyOf, Summary>::RangeFrom(const PersistentNode<T, Summary>* node, const K& first, const K& last, F& visit) {
+    if (node == NULL) {
+        return;
+    }
+    bool abovefirst = first < KeyOf::Key(node->data);
+    bool belowlast = KeyOf::Key(node->data) < last;
+    if (abovefirst) {
+        RangeFrom(node->left, first, last, visit);
+    }
+    if (!(KeyOf::Key(node->data) < first) && !(last < KeyOf::Key(node->data))) {
+        visit(static_cast<const T&>(node->data));
+    }
+    if (belowlast) {
+        RangeFrom(node->right, first, last, visit);
+    }
+}
+
+
+
+//************************************
+// Method:    ForEachInPage.
+// FullName:  PersistentTree<T>::ForEachInPage.
+// Access:    public.
+// Returns:   void.
+// Qualifier: const.
+// Desc:      Skips whole subtrees that end before offset, using
+//            their sizes, then visits in order until count
+//            items are done. O(log n + count).
+// Parameter: unsigned int offset (0 based position of the first item).
+// Parameter: unsigned int count (maximum number of items).
+// Parameter: F visit (called with a const T& for every item).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class F>
+void PersistentTree<T, KeyOf, Summary>::ForEachInPage(unsigned int offset, unsigned int count, F visit) const {
+    PageFrom(root, offset, count, visit);
+}
+
+template <class T, class KeyOf, class Summary>
+template <class F>
+void PersistentTree<T, KeyOf, Summary>::PageFrom(const PersistentNode<T, Summary>* node, unsigned int& offset, unsigned int& count, F& visit) {
+    if (node == NULL || count == 0) {
+        return;
+    }
+    unsigned int leftsize = SubtreeSize(node->left);
+    if (offset >= leftsize) {
+        offset -= leftsize;
+    } else {
+        PageFrom(node->left, offset, count, visit);
+    }
+    if (count == 0) {
+        return;
+    }
+    if (offset > 0) {
+        --offset;
+    } else {
+        visit(static_cast<const T&>(node->data));
+        --count;
+    }
+    PageFrom(node->right, offset, count, visit);
+}
+
+
+
+//************************************
+// Method:    RangeSummary.
+// FullName:  PersistentTree<T>::RangeSummary.
+// Access:    public.
+// Returns:   Summary (the empty Summary if no key is in range).
+// Qualifier: const.
+// Desc:      Same walk as RedBlackTree::RangeSummary: the split
+//            node, then the two boundary paths below it.
+// Parameter: const K& lo (smallest key to include).
+// Parameter: const K& hi (largest key to include).
+//************************************
+template <class T, class KeyOf, class Summary>
+template <class K>
+Summary PersistentTree<T, KeyOf, Summary>::RangeSummary(const K& lo, const K& hi) const {
+    Summary total;
+    auto&& first = KeyOf::Key(lo);
+    auto&& last = KeyOf::Key(hi);
+    const PersistentNode<T, Summary>* split = root;
+    while (split != NULL) {
+        if (KeyOf::Key(split->data) < first) {
+            split = split->right;
+        } else if (last < KeyOf::Key(split->data)) {
+            split = split->left;
+        } else {
+            break;
+        }
+    }
+    if (split == NULL) {
+        return total;
+    }
+
+    total.Add(split->data);
+    for (const PersistentNode<T, Summary>* node = split->left; node != NULL;) { // lo side.
+        if (KeyOf::Key(node->data) < first) {
+            node = node->right;
+        } else {
+            total.Add(node->data);
+            if (node->right != NULL) {
+                total.Add(node->right->summary);
+            }
+            node = node->left;
+        }
+    }
+    for (const PersistentNode<T, Summary>* node = split->right; node != NULL;) { // hi side.
+        if (last < KeyOf::Key(node->data)) {
+            node = node->left;
+        } else {
+            total.Add(node->data);
+            if (node->left != NULL) {
+                total.Add(node->left->summary);
+            }
+            node = node->right;
+        }
+    }
+    return total;
+}
+
+
+
+//************************************
+// Method:    Total.
+// FullName:  PersistentTree<T>::Total.
+// Access:    public.
+// Returns:   Summary (the root's summary).
+// Qualifier: const.
+//************************************
+template <class T, class KeyOf, class Summary>
+Summary PersistentTree<T, KeyOf, Summary>::Total() const {
+    return root == NULL ? Summary() : root->summary;
+}
+
+
+
+//************************************
+// Method:    Size.
+// FullName:  PersistentTree<T>::Size.
+// Access:    public.
+// Returns:   unsigned int.
+// Qualifier: const.
+//************************************
+template <class T, class KeyOf, class Summary>
+unsigned int PersistentTree<T, KeyOf, Summary>::Size() const {
+    return size;
+}
+
+
+
+//************************************
+// Method:    Height.
+// FullName:  PersistentTree<T>::Height.
+// Access:    public.
+// Returns:   unsigned int.
+// Qualifier: const.
+//************************************
+template <class T, class KeyOf, class Summary>
+unsigned int PersistentTree<T, KeyOf, Summary>::Height() const {
+    unsigned int height = CalculateHeight(root);
+    return height > 0 ? height - 1 : 0;
+}
+
+template <class T, class KeyOf, class Summary>
+unsigned int PersistentTree<T, KeyOf, Summary>::CalculateHeight(const PersistentNode<T, Summary>* node) {
+    if (node == NULL) {
+        return 0;
+    }
+    unsigned int leftheight = CalculateHeight(node->left);
+    unsigned int rightheight = CalculateHeight(node->right);
+    return 1 + (leftheight > rightheight ? leftheight : rightheight);
+}
+
+#endif
@@ -0,0 +1,179 @@
+// File:        persistenttree.h
+// Date:        2026-10-17
+// Description: Declaration of a PersistentTree class and template PersistentNode class,
+//              a red-black tree whose versions share their unchanged nodes
+
+#ifndef _PERSISTENTTREE_H_
+#define _PERSISTENTTREE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+#include "redblacktree.h"
+
+using namespace std;
+
+// A node is immutable once it is reachable from a published version.
+// It has no parent pointer, since it may be the child of nodes of many
+//   versions; refs counts those parents and the trees whose root it is.
+template <class T, class Summary = NoSummary>
+class PersistentNode {
+public:
+    T data;
+    PersistentNode<T, Summary>* left;
+    PersistentNode<T, Summary>* right;
+    atomic<unsigned int> refs; // parents and trees holding this node
+    unsigned int count; // number of nodes in the subtree rooted here, this one included
+    bool is_black;
+    [[no_unique_address]] Summary summary; // aggregate of the subtree rooted here (see NoSummary)
+
+    // data is constructed in place from args
+    template <class... Args>
+    explicit PersistentNode(Args&&... args) : data(forward<Args>(args)...), left(NULL), right(NULL), refs(1), count(1), is_black(false), summary() {
+    }
+};
+
+// Red-black tree with path copying: a change never writes to an existing node.
+//   It copies the O(log n) nodes on the path to the changed item and links the
+//   copies to the untouched subtrees, so the previous version stays intact.
+// A version is just a PersistentTree object. Copying one is O(1) (it only
+//   holds a reference to the root), and the nodes of a version are released
+//   with the last tree that can reach them.
+// Nodes are allocated with new/delete, since the last holder of a node may
+//   let go of it on any thread. Reading copies of a tree on other threads
+//   while it is changed is safe; each tree object is changed by one thread
+//   at a time.
+// KeyOf and Summary work as in RedBlackTree. There is no Remove, the
+//   catalogue never removes single items.
+template <class T, class KeyOf = IdentityKeyOf, class Summary = NoSummary>
+class PersistentTree {
+private:
+    PersistentNode<T, Summary>* root; // this tree holds one reference to it
+    unsigned int size;
+
+    // adds a reference to node (NULL is ignored)
+    static void Retain(PersistentNode<T, Summary>* node);
+
+    // drops a reference to node, deleting it (and dropping its references to
+    //   its children) if it was the last one
+    static void Release(PersistentNode<T, Summary>* node);
+
+    // recomputes a new node's count and summary from its children
+    static void Refresh(PersistentNode<T, Summary>* node);
+
+    // subtree size of node, 0 for NULL
+    static unsigned int SubtreeSize(const PersistentNode<T, Summary>* node) {
+        return node == NULL ? 0 : node->count;
+    }
+
+    // recursive helper for Insert
+    // returns a new version of the subtree of node holding newnode, with red-red
+    //   violations below the returned node already fixed
+    static PersistentNode<T, Summary>* InsertPath(const PersistentNode<T, Summary>* node, PersistentNode<T, Summary>* newnode, StatsDescent& descent);
+
+    // fixes a red-red violation between the new children of a new black node,
+    //   returns the new root of its subtree
+    static PersistentNode<T, Summary>* Balance(PersistentNode<T, Summary>* node);
+
+    // recursive helper for Update, copies the path down to the node holding key
+    template <class K, class F>
+    static PersistentNode<T, Summary>* UpdatePath(const PersistentNode<T, Summary>* node, const K& key, F& mutate, StatsDescent& descent);
+
+    // recursive helper for BuildFromSorted, see RedBlackTree::BuildSorted
+    template <class It>
+    static PersistentNode<T, Summary>* BuildSorted(It& it, unsigned int n, unsigned int depth, unsigned int reddepth);
+
+    // returns the node holding key, or NULL if there is none
+    template <class K>
+    const PersistentNode<T, Summary>* FindNode(const K& key) const;
+
+    // recursive helpers for ForEach, Range and ForEachInPage
+    template <class F>
+    static void InOrder(const PersistentNode<T, Summary>* node, F& visit);
+    template <class K, class F>
+    static void RangeFrom(const PersistentNode<T, Summary>* node, const K& first, const K& last, F& visit);
+    template <class F>
+    static void PageFrom(const PersistentNode<T, Summary>* node, unsigned int& offset, unsigned int& count, F& visit);
+
+    // recursive helper for Height
+    static unsigned int CalculateHeight(const PersistentNode<T, Summary>* node);
+
+public:
+    // empty tree
+    PersistentTree();
+
+    // O(1): the copy is another reference to the same version
+    PersistentTree(const PersistentTree<T, KeyOf, Summary>& tree);
+    PersistentTree<T, KeyOf, Summary>& operator=(const PersistentTree<T, KeyOf, Summary>& tree);
+
+    // releases this version
+    ~PersistentTree();
+
+    // Mutator functions-----------------------------------------------------
+    // Each one makes this tree a new version; copies taken earlier keep
+    //   seeing the old one.
+
+    // If item already exists, do not insert and return false.
+    // Otherwise copies O(log n) nodes, inserts, increments size and returns true.
+    bool Insert(const T& item);
+
+    // Calls mutate(item) on a new copy of the item holding key, and copies the
+    //   path above it. mutate must not change the key.
+    // Returns false (and copies nothing) if there is no such item.
+    template <class K, class F>
+    bool Update(const K& key, F mutate);
+
+    // Replaces the contents with [first, last), in strictly ascending key order.
+    // O(n), see RedBlackTree::BuildFromSorted; returns false and leaves the
+    //   tree unchanged if the items are not sorted or contain duplicates.
+    template <class It>
+    bool BuildFromSorted(It first, It last);
+
+    // releases this version and leaves the tree empty
+    void RemoveAll();
+
+    // Accessor functions------------------------------------------------------
+
+    template <class K>
+    bool Search(const K& key) const;
+
+    // pointer to the item holding key, or NULL; read only, items change through Update
+    template <class K>
+    const T* Retrieve(const K& key) const;
+
+    // Calls visit(item) for every item in ascending order, without copying.
+    template <class F>
+    void ForEach(F visit) const;
+
+    // Calls visit(item) for every item with lo <= key <= hi, in ascending order.
+    template <class K, class F>
+    void Range(const K& lo, const K& hi, F visit) const;
+
+    // Calls visit(item) for at most count items, starting with the offset-th
+    //   smallest (0 based). Whole subtrees before offset are skipped by size.
+    template <class F>
+    void ForEachInPage(unsigned int offset, unsigned int count, F visit) const;
+
+    // Aggregate of the items with lo <= key <= hi, in O(log n).
+    template <class K>
+    Summary RangeSummary(const K& lo, const K& hi) const;
+
+    // aggregate of every item, O(1)
+    Summary Total() const;
+
+    // returns the number of items in the tree
+    unsigned int Size() const;
+
+    // returns the height of the tree (0 for an empty tree or a single node, as RedBlackTree::Height)
+    unsigned int Height() const;
+
+    // returns a pointer to the root of the tree, for checking its shape
+    const PersistentNode<T, Summary>* GetRoot() const {
+        return root;
+    }
+};
+
+#include "persistenttree.cpp"
+
+#endif
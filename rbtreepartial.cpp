@@ -5,36 +5,41 @@
 
 #ifdef _REDBLACKTREE_H_
 
-// performs BST insertion and returns pointer to inserted node
+// performs BST insertion of an already constructed node and returns it
 // Note that this should only be called if item does not already exist in the tree
 // Does not increase tree size.
 
-template <class T>
-Node<T>* RedBlackTree<T>::BSTInsert(T item) {
-    Node<T>* refnode; // will be pointer to parent of inserted node
-    Node<T>* newnode; // will be pointer to inserted node
+template <class T, class KeyOf, class Alloc, class Summary>
+Node<T, Summary>* RedBlackTree<T, KeyOf, Alloc, Summary>::BSTInsert(Node<T, Summary>* newnode) {
+    Node<T, Summary>* refnode; // will be pointer to parent of inserted node
     // special case: empty tree
     if (size <= 0) {
-        root = new Node<T>(item);
-        newnode = root;
+        root = newnode;
     } else // general case: non-empty tree
     {
+        auto&& key = KeyOf::Key(newnode->data);
         refnode = root;
+        STATS_DESCENT(descent);
         // find the insertion location
-        while ((item < refnode->data && refnode->left != NULL) || (item > refnode->data && refnode->right != NULL)) {
-            if (item < refnode->data)
+        // every node on the way gains newnode in its subtree
+        while ((key < KeyOf::Key(refnode->data) && refnode->left != NULL) || (KeyOf::Key(refnode->data) < key && refnode->right != NULL)) {
+            ++refnode->count;
+            STATS_VISIT(descent);
+            if (key < KeyOf::Key(refnode->data))
                 refnode = refnode->left;
-            else if (item > refnode->data)
+            else if (KeyOf::Key(refnode->data) < key)
                 refnode = refnode->right;
         }
         // exited while loop, refnode points to the parent of the insertion location and has a null location to insert
-        newnode = new Node<T>(item);
+        ++refnode->count;
+        STATS_VISIT(descent);
         newnode->p = refnode;
-        if (item < refnode->data)
+        if (key < KeyOf::Key(refnode->data))
             refnode->left = newnode;
         else
             refnode->right = newnode;
     }
+    RefreshSummaries(newnode);
 
     return newnode;
 }
@@ -42,20 +47,10 @@ Node<T>* RedBlackTree<T>::BSTInsert(T item) {
 // Returns existence of item in the tree.
 // Return true if found, false otherwise.
 
-template <class T>
-bool RedBlackTree<T>::Search(T item) const {
-    Node<T>* node = root;
-
-    while (node != NULL) {
-        if (item == node->data)
-            return true;
-        else if (item < node->data)
-            node = node->left;
-        else
-            node = node->right;
-    }
-    // if exit while loop, item is not found
-    return false;
+template <class T, class KeyOf, class Alloc, class Summary>
+template <class K>
+bool RedBlackTree<T, KeyOf, Alloc, Summary>::Search(const K& key) const {
+    return FindNode(key) != NULL;
 }
 
 // Searches for item and returns a pointer to the node contents so the
@@ -63,30 +58,20 @@ bool RedBlackTree<T>::Search(T item) const {
 // Use with caution! Do not modify the item's key value such that the
 //   red-black /BST properties are violated.
 
-template <class T>
-T* RedBlackTree<T>::Retrieve(T item) {
-    T* value = NULL;
-
-    // search for the item
-    Node<T>* node = root;
-
-    while (node != NULL) {
-        if (item == node->data) {
-            value = &(node->data);
-            break; // item has been found, exit while loop
-        } else if (item < node->data)
-            node = node->left;
-        else
-            node = node->right;
-    }
-    // if exit while loop without breaking, item is not found
-    return value;
+template <class T, class KeyOf, class Alloc, class Summary>
+template <class K>
+T* RedBlackTree<T, KeyOf, Alloc, Summary>::Retrieve(const K& key) {
+    Unshare(); // the item may be modified through the pointer
+    Node<T, Summary>* node = FindNode(key);
+    if (node == NULL) // item is not found
+        return NULL;
+    return &(node->data);
 }
 
 // helper function for in-order traversal
 
-template <class T>
-void RedBlackTree<T>::InOrder(const Node<T>* node, T* arr, int arrsize, int& index) const {
+template <class T, class KeyOf, class Alloc, class Summary>
+void RedBlackTree<T, KeyOf, Alloc, Summary>::InOrder(const Node<T, Summary>* node, T* arr, int arrsize, int& index) const {
     if (node != NULL) {
         // recurse on left child
         if (node->left != NULL)
@@ -102,13 +87,79 @@ void RedBlackTree<T>::InOrder(const Node<T>* node, T* arr, int arrsize, int& ind
     }
 }
 
+// iterators over the items in ascending order
+// begin() descends to the smallest item, end() is past the largest one
+
+template <class T, class KeyOf, class Alloc, class Summary>
+typename RedBlackTree<T, KeyOf, Alloc, Summary>::iterator RedBlackTree<T, KeyOf, Alloc, Summary>::begin() {
+    Unshare();
+    Node<T, Summary>* node = root;
+    while (node != NULL && node->left != NULL)
+        node = node->left;
+    return iterator(node, &root);
+}
+
+template <class T, class KeyOf, class Alloc, class Summary>
+typename RedBlackTree<T, KeyOf, Alloc, Summary>::iterator RedBlackTree<T, KeyOf, Alloc, Summary>::end() {
+    return iterator(NULL, &root);
+}
+
+template <class T, class KeyOf, class Alloc, class Summary>
+typename RedBlackTree<T, KeyOf, Alloc, Summary>::const_iterator RedBlackTree<T, KeyOf, Alloc, Summary>::begin() const {
+    Node<T, Summary>* node = root;
+    while (node != NULL && node->left != NULL)
+        node = node->left;
+    return const_iterator(node, &root);
+}
+
+template <class T, class KeyOf, class Alloc, class Summary>
+typename RedBlackTree<T, KeyOf, Alloc, Summary>::const_iterator RedBlackTree<T, KeyOf, Alloc, Summary>::end() const {
+    return const_iterator(NULL, &root);
+}
+
+// calls visit(item) for every item in ascending order, without copying
+
+template <class T, class KeyOf, class Alloc, class Summary>
+template <class F>
+void RedBlackTree<T, KeyOf, Alloc, Summary>::ForEach(F visit) const {
+    for (const_iterator it = begin(); it != end(); ++it)
+        visit(*it);
+}
+
+// recomputes a node's subtree size and summary from its children
+
+template <class T, class KeyOf, class Alloc, class Summary>
+void RedBlackTree<T, KeyOf, Alloc, Summary>::Refresh(Node<T, Summary>* node) {
+    node->count = 1 + SubtreeSize(node->left) + SubtreeSize(node->right);
+    if constexpr (!is_empty<Summary>::value) {
+        Summary summary;
+        if (node->left != NULL)
+            summary.Add(node->left->summary);
+        summary.Add(node->data);
+        if (node->right != NULL)
+            summary.Add(node->right->summary);
+        node->summary = summary;
+    }
+}
+
+// recomputes the summaries from node up to the root
+
+template <class T, class KeyOf, class Alloc, class Summary>
+void RedBlackTree<T, KeyOf, Alloc, Summary>::RefreshSummaries(Node<T, Summary>* node) {
+    if constexpr (!is_empty<Summary>::value) {
+        for (; node != NULL; node = node->p)
+            Refresh(node);
+    }
+}
+
 // rotation functions
 // These functions are tested and working.
 // If you experience a crash in these functions, most likely some child/parent pointers
 // in your tree are broken due to incorrect insertion/removal logic
 
-template <class T>
-void RedBlackTree<T>::LeftRotate(Node<T>* node) {
+template <class T, class KeyOf, class Alloc, class Summary>
+void RedBlackTree<T, KeyOf, Alloc, Summary>::LeftRotate(Node<T, Summary>* node) {
+    STATS_COUNT(TREE_LEFT_ROTATIONS);
     if (node != NULL) {
         // if root
         if (node == root) {
@@ -116,14 +167,16 @@ void RedBlackTree<T>::LeftRotate(Node<T>* node) {
             if (node->right == NULL) {
                 // do nothing, do not allow the rotation
             } else {
-                Node<T>* rc = node->right; // right child
-                Node<T>* rclc = node->right->left; // right child's left child
+                Node<T, Summary>* rc = node->right; // right child
+                Node<T, Summary>* rclc = node->right->left; // right child's left child
                 rc->p = NULL;
                 rc->left = node;
                 node->p = rc;
                 node->right = rclc;
                 if (rclc != NULL)
                     rclc->p = node;
+                Refresh(node); // node is now the child of rc, so it is refreshed first
+                Refresh(rc);
 
                 root = rc;
             }
@@ -133,9 +186,9 @@ void RedBlackTree<T>::LeftRotate(Node<T>* node) {
             if (node->right == NULL) {
                 // do nothing, do not allow the rotation
             } else {
-                Node<T>* parent = node->p; // parent
-                Node<T>* rc = node->right; // right child
-                Node<T>* rclc = node->right->left; // right child's left child
+                Node<T, Summary>* parent = node->p; // parent
+                Node<T, Summary>* rc = node->right; // right child
+                Node<T, Summary>* rclc = node->right->left; // right child's left child
 
                 if (node == node->p->left)
                     node->p->left = rc;
@@ -148,13 +201,16 @@ void RedBlackTree<T>::LeftRotate(Node<T>* node) {
                 node->right = rclc;
                 if (rclc != NULL)
                     rclc->p = node;
+                Refresh(node); // node is now the child of rc, so it is refreshed first
+                Refresh(rc);
             }
         }
     }
 }
 
-template <class T>
-void RedBlackTree<T>::RightRotate(Node<T>* node) {
+template <class T, class KeyOf, class Alloc, class Summary>
+void RedBlackTree<T, KeyOf, Alloc, Summary>::RightRotate(Node<T, Summary>* node) {
+    STATS_COUNT(TREE_RIGHT_ROTATIONS);
     if (node != NULL) {
         // if root
         if (node == root) {
@@ -162,14 +218,16 @@ void RedBlackTree<T>::RightRotate(Node<T>* node) {
             if (node->left == NULL) {
                 // do nothing, do not allow the rotation
             } else {
-                Node<T>* lc = node->left; // left child
-                Node<T>* lcrc = node->left->right; // left child's right child
+                Node<T, Summary>* lc = node->left; // left child
+                Node<T, Summary>* lcrc = node->left->right; // left child's right child
                 lc->p = NULL;
                 lc->right = node;
                 node->p = lc;
                 node->left = lcrc;
                 if (lcrc != NULL)
                     lcrc->p = node;
+                Refresh(node); // node is now the child of lc, so it is refreshed first
+                Refresh(lc);
 
                 root = lc;
             }
@@ -179,9 +237,9 @@ void RedBlackTree<T>::RightRotate(Node<T>* node) {
             if (node->left == NULL) {
                 // do nothing, do not allow the rotation
             } else {
-                Node<T>* parent = node->p; // parent
-                Node<T>* lc = node->left; // left child
-                Node<T>* lcrc = node->left->right; // left child's right child
+                Node<T, Summary>* parent = node->p; // parent
+                Node<T, Summary>* lc = node->left; // left child
+                Node<T, Summary>* lcrc = node->left->right; // left child's right child
 
                 if (node == node->p->left)
                     node->p->left = lc;
@@ -194,6 +252,8 @@ void RedBlackTree<T>::RightRotate(Node<T>* node) {
                 node->left = lcrc;
                 if (lcrc != NULL)
                     lcrc->p = node;
+                Refresh(node); // node is now the child of lc, so it is refreshed first
+                Refresh(lc);
             }
         }
     }
@@ -202,9 +262,9 @@ void RedBlackTree<T>::RightRotate(Node<T>* node) {
 
 // get the predecessor of a node
 
-template <class T>
-Node<T>* RedBlackTree<T>::Predecessor(Node<T>* node) {
-    Node<T>* pre = NULL;
+template <class T, class KeyOf, class Alloc, class Summary>
+Node<T, Summary>* RedBlackTree<T, KeyOf, Alloc, Summary>::Predecessor(Node<T, Summary>* node) {
+    Node<T, Summary>* pre = NULL;
     // do not allow operation on a null node
     if (node != NULL) {
         // case: node has no left child
@@ -225,8 +285,8 @@ Node<T>* RedBlackTree<T>::Predecessor(Node<T>* node) {
 // performs an in-order traversal of the tree
 // arrsize is the size of the returned array (equal to tree size attribute)
 
-template <class T>
-T* RedBlackTree<T>::Dump(int& arrsize) const {
+template <class T, class KeyOf, class Alloc, class Summary>
+T* RedBlackTree<T, KeyOf, Alloc, Summary>::Dump(int& arrsize) const {
     int index = 0;
     arrsize = size;
     T* contents = new T[size];
@@ -0,0 +1,103 @@
+// File:        recoverytest.cpp
+// Date:        2026-10-17
+// Description: Checks that StockSystem::Recover rebuilds the live state after
+//              the journal and checkpoint sequences that have gone wrong before
+
+#include <stdio.h>
+
+#include <iostream>
+#include <string>
+
+#include "stocksystem.h"
+
+using namespace std;
+
+#define JOURNAL_PATH "recoverytest.journal"
+#define SNAPSHOT_PATH "recoverytest.snapshot"
+
+static int failures = 0;
+
+// Recovers a new system from the test files and compares it with live.
+static void ExpectRecovers(const char* name, const StockSystem& live) {
+    StockSystem recovered;
+    if (!recovered.Recover(JOURNAL_PATH, SNAPSHOT_PATH)) {
+        cout << "FAIL " << name << ": Recover returned false" << endl;
+        failures++;
+    } else if (recovered.GetCatalogue() != live.GetCatalogue() || recovered.GetBalance() != live.GetBalance()) {
+        cout << "FAIL " << name << ": recovered balance " << recovered.GetBalance() << ", live " << live.GetBalance() << endl;
+        cout << recovered.GetCatalogue() << "live:" << endl << live.GetCatalogue();
+        failures++;
+    } else {
+        cout << "ok   " << name << endl;
+    }
+}
+
+// Starts a test from no journal and no snapshot.
+static void RemoveFiles() {
+    remove(JOURNAL_PATH);
+    remove(SNAPSHOT_PATH);
+}
+
+// A snapshot saved after the journal was disabled holds the journal's records.
+static void TestSnapshotAfterDisable() {
+    RemoveFiles();
+    StockSystem live;
+    live.EnableJournal(JOURNAL_PATH);
+    live.StockNewItem(StockItem(12345, "widget", 2.50));
+    live.Restock(12345, 10, 1.0);
+    live.DisableJournal();
+    live.SaveSnapshot(SNAPSHOT_PATH);
+    ExpectRecovers("snapshot saved with the journal disabled", live);
+
+    // and the records appended once it is enabled again are not
+    live.EnableJournal(JOURNAL_PATH);
+    live.Sell(12345, 3);
+    live.DisableJournal();
+    ExpectRecovers("journal enabled again after the snapshot", live);
+}
+
+// A crash after the checkpoint's snapshot is in place, before the journal is
+//   emptied, leaves records the snapshot already holds.
+static void TestCheckpointCrash() {
+    RemoveFiles();
+    StockSystem live;
+    live.EnableJournal(JOURNAL_PATH);
+    live.StockNewItem(StockItem(12345, "widget", 2.50));
+    live.Restock(12345, 10, 1.0);
+    live.Sell(12345, 4);
+    live.SaveSnapshot(SNAPSHOT_PATH); // the first half of Checkpoint
+    live.CommitJournal();
+    ExpectRecovers("crash between snapshot and truncate", live);
+
+    live.Sell(12345, 1);
+    live.CommitJournal();
+    ExpectRecovers("records appended after the snapshot", live);
+
+    live.Checkpoint(SNAPSHOT_PATH);
+    live.Restock(12345, 2, 0.5);
+    live.CommitJournal();
+    ExpectRecovers("records appended after a checkpoint", live);
+}
+
+// A SINGLE_THREADED balance holding a fraction of a cent comes back exactly
+//   from a checkpoint, so the journal replays from the same balance.
+static void TestFractionalBalance() {
+    RemoveFiles();
+    StockSystem live;
+    live.EnableJournal(JOURNAL_PATH);
+    live.StockNewItem(StockItem(12345, "widget", 2.50));
+    live.StockNewItem(StockItem(12346, "gadget", 1.00));
+    live.Restock(12345, 1, 99999.996); // leaves $0.004
+    live.Checkpoint(SNAPSHOT_PATH);
+    live.Restock(12346, 1, 0.004); // only affordable with the exact balance
+    live.CommitJournal();
+    ExpectRecovers("balance with a fraction of a cent", live);
+}
+
+int main() {
+    TestSnapshotAfterDisable();
+    TestCheckpointCrash();
+    TestFractionalBalance();
+    RemoveFiles();
+    return failures == 0 ? 0 : 1;
+}
@@ -10,35 +10,388 @@
 #include <string>
 #include <iostream>
 
-///************************************
-// Method:    getNodeFromTree.
-// FullName:  getNodeFromTree.
-// Access:    public.
-// Returns:   Node<T>*.
-// Desk:      Search for a node with a T value (parameter),
+//************************************
+// Method:    FindNode.
+// FullName:  RedBlackTree<T>::FindNode.
+// Access:    private.
+// Returns:   Node<T, Summary>*.
+// Qualifier: const (it does not modify the tree).
+// Desc:      Search for a node with a certain key,
 //            and return a pointer to that node. It will
 //            return a NULL as an indication of the non-
 //            existence of the node.
-// Parameter: Node<T>* nd (the current node of the recursive search
-//            - it should begin with the root of the tree).
-// Parameter: T value (the value for searching).
-//************************************
-template<class T>
-Node<T>* getNodeFromTree(Node<T>* nd, T value) {
-    if (nd != NULL) { // Making sure that no access violation will occur.
-        if (nd->data == value) { // Data was found.
-            return nd;
+// Parameter: const K& key (an item, or anything KeyOf::Key
+//            accepts, e.g. a bare key).
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+template <class K>
+Node<T, Summary>* RedBlackTree<T, KeyOf, Alloc, Summary>::FindNode(const K& key) const {
+    Node<T, Summary>* node = root;
+    auto&& k = KeyOf::Key(key); // Extract the key once, not at every level.
+    STATS_DESCENT(descent);
+
+    while (node != NULL) {
+        STATS_VISIT(descent);
+        if (k == KeyOf::Key(node->data)) { // Data was found.
+            return node;
+        } else if (k < KeyOf::Key(node->data)) { // Go left if the key is less than the current node's key.
+            node = node->left;
+        } else { // Go right if the key is greater than the current node's key.
+            node = node->right;
+        }
+    }
+    // If exit while loop, return NULL as an indication of the non-existence of that item
+    //   in the tree.
+    return NULL;
+}
+
+//************************************
+// Method:    BoundNode.
+// FullName:  RedBlackTree<T>::BoundNode.
+// Access:    private.
+// Returns:   Node<T, Summary>* (NULL if every key is below the bound).
+// Qualifier: const.
+// Desc:      Single descent shared by LowerBound and UpperBound.
+//            Every node that satisfies the bound is remembered
+//            before going left to look for a smaller one.
+// Parameter: const K& key (an item, or anything KeyOf::Key accepts).
+// Parameter: bool inclusive (true for the first key >= key,
+//            false for the first key > key).
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+template <class K>
+Node<T, Summary>* RedBlackTree<T, KeyOf, Alloc, Summary>::BoundNode(const K& key, bool inclusive) const {
+    Node<T, Summary>* node = root;
+    Node<T, Summary>* bound = NULL;
+    auto&& k = KeyOf::Key(key);
+    STATS_DESCENT(descent);
+
+    while (node != NULL) {
+        STATS_VISIT(descent);
+        bool above = inclusive ? !(KeyOf::Key(node->data) < k) : k < KeyOf::Key(node->data);
+        if (above) { // node satisfies the bound, a smaller one can only be on the left.
+            bound = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return bound;
+}
+
+//************************************
+// Method:    LowerBound, UpperBound.
+// FullName:  RedBlackTree<T>::LowerBound, RedBlackTree<T>::UpperBound.
+// Access:    public.
+// Returns:   iterator or const_iterator (end() if there is no such item).
+// Desc:      Iterator to the first item whose key is not less
+//            than (LowerBound) or greater than (UpperBound) key.
+// Parameter: const K& key (an item, or anything KeyOf::Key accepts).
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+template <class K>
+typename RedBlackTree<T, KeyOf, Alloc, Summary>::iterator RedBlackTree<T, KeyOf, Alloc, Summary>::LowerBound(const K& key) {
+    Unshare();
+    return iterator(BoundNode(key, true), &root);
+}
+
+template <class T, class KeyOf, class Alloc, class Summary>
+template <class K>
+typename RedBlackTree<T, KeyOf, Alloc, Summary>::const_iterator RedBlackTree<T, KeyOf, Alloc, Summary>::LowerBound(const K& key) const {
+    return const_iterator(BoundNode(key, true), &root);
+}
+
+template <class T, class KeyOf, class Alloc, class Summary>
+template <class K>
+typename RedBlackTree<T, KeyOf, Alloc, Summary>::iterator RedBlackTree<T, KeyOf, Alloc, Summary>::UpperBound(const K& key) {
+    Unshare();
+    return iterator(BoundNode(key, false), &root);
+}
+
+template <class T, class KeyOf, class Alloc, class Summary>
+template <class K>
+typename RedBlackTree<T, KeyOf, Alloc, Summary>::const_iterator RedBlackTree<T, KeyOf, Alloc, Summary>::UpperBound(const K& key) const {
+    return const_iterator(BoundNode(key, false), &root);
+}
+
+//************************************
+// Method:    SelectNode.
+// FullName:  RedBlackTree<T>::SelectNode.
+// Access:    private.
+// Returns:   Node<T, Summary>* (NULL if k >= size).
+// Qualifier: const.
+// Desc:      Finds the k-th smallest node with the subtree
+//            sizes: the left subtree holds the smallest
+//            SubtreeSize(left) items, so each level either
+//            stops, goes left, or skips them and goes right.
+// Parameter: unsigned int k (0 based position).
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+Node<T, Summary>* RedBlackTree<T, KeyOf, Alloc, Summary>::SelectNode(unsigned int k) const {
+    Node<T, Summary>* node = root;
+    STATS_DESCENT(descent);
+    while (node != NULL) {
+        STATS_VISIT(descent);
+        unsigned int leftsize = SubtreeSize(node->left);
+        if (k == leftsize) {
+            return node;
+        } else if (k < leftsize) {
+            node = node->left;
+        } else {
+            k -= leftsize + 1;
+            node = node->right;
+        }
+    }
+    return NULL;
+}
+
+//************************************
+// Method:    Select.
+// FullName:  RedBlackTree<T>::Select.
+// Access:    public.
+// Returns:   iterator or const_iterator (end() if k >= Size()).
+// Desc:      Iterator to the k-th smallest item, from which
+//            the following items can be walked in order.
+// Parameter: unsigned int k (0 based position).
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+typename RedBlackTree<T, KeyOf, Alloc, Summary>::iterator RedBlackTree<T, KeyOf, Alloc, Summary>::Select(unsigned int k) {
+    Unshare();
+    return iterator(SelectNode(k), &root);
+}
+
+template <class T, class KeyOf, class Alloc, class Summary>
+typename RedBlackTree<T, KeyOf, Alloc, Summary>::const_iterator RedBlackTree<T, KeyOf, Alloc, Summary>::Select(unsigned int k) const {
+    return const_iterator(SelectNode(k), &root);
+}
+
+//************************************
+// Method:    Rank.
+// FullName:  RedBlackTree<T>::Rank.
+// Access:    public.
+// Returns:   unsigned int (number of items with a smaller key).
+// Qualifier: const.
+// Desc:      Every time the descent goes right, the node and
+//            its left subtree are all smaller than key.
+// Parameter: const K& key (an item, or anything KeyOf::Key accepts).
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+template <class K>
+unsigned int RedBlackTree<T, KeyOf, Alloc, Summary>::Rank(const K& key) const {
+    Node<T, Summary>* node = root;
+    unsigned int rank = 0;
+    auto&& k = KeyOf::Key(key);
+
+    while (node != NULL) {
+        if (KeyOf::Key(node->data) < k) {
+            rank += SubtreeSize(node->left) + 1;
+            node = node->right;
+        } else {
+            node = node->left;
+        }
+    }
+    return rank;
+}
+
+//************************************
+// Method:    Range.
+// FullName:  RedBlackTree<T>::Range.
+// Access:    public.
+// Returns:   void.
+// Qualifier: const.
+// Desc:      Visits the items with keys in [lo, hi] in place.
+//            One descent finds the first item, and every
+//            further step is O(1) amortised, so the cost is
+//            O(log n + k) for k visited items.
+// Parameter: const K& lo (smallest key to visit).
+// Parameter: const K& hi (largest key to visit).
+// Parameter: F visit (called with a const T& for every item).
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+template <class K, class F>
+void RedBlackTree<T, KeyOf, Alloc, Summary>::Range(const K& lo, const K& hi, F visit) const {
+    auto&& last = KeyOf::Key(hi);
+    for (const_iterator it = LowerBound(lo); it != end() && !(last < KeyOf::Key(*it)); ++it) {
+        visit(*it);
+    }
+}
+
+//************************************
+// Method:    Update.
+// FullName:  RedBlackTree<T>::Update.
+// Access:    public.
+// Returns:   bool (false if no item has this key).
+// Desc:      Changes an item in place, then walks back up
+//            the parent pointers recomputing the summaries
+//            that include it. O(log n).
+// Parameter: const K& key (an item, or anything KeyOf::Key accepts).
+// Parameter: F mutate (called with a T& to the item, must not
+//            change its key).
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+template <class K, class F>
+bool RedBlackTree<T, KeyOf, Alloc, Summary>::Update(const K& key, F mutate) {
+    Unshare();
+    Node<T, Summary>* node = FindNode(key);
+    if (node == NULL) {
+        return false;
+    }
+    mutate(node->data);
+    RefreshSummaries(node);
+    return true;
+}
+
+//************************************
+// Method:    RangeSummary.
+// FullName:  RedBlackTree<T>::RangeSummary.
+// Access:    public.
+// Returns:   Summary (the empty Summary if no key is in range).
+// Qualifier: const.
+// Desc:      Descends to the highest node inside [lo, hi] (the
+//            split node), then follows the two boundary paths
+//            below it. On the lo side every node in range has
+//            its whole right subtree in range, on the hi side
+//            its whole left subtree, so each level adds at
+//            most one item and one summary.
+// Parameter: const K& lo (smallest key to include).
+// Parameter: const K& hi (largest key to include).
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+template <class K>
+Summary RedBlackTree<T, KeyOf, Alloc, Summary>::RangeSummary(const K& lo, const K& hi) const {
+    Summary total;
+    auto&& first = KeyOf::Key(lo);
+    auto&& last = KeyOf::Key(hi);
+    Node<T, Summary>* split = root;
+    while (split != NULL) {
+        if (KeyOf::Key(split->data) < first) {
+            split = split->right;
+        } else if (last < KeyOf::Key(split->data)) {
+            split = split->left;
+        } else {
+            break;
+        }
+    }
+    if (split == NULL) {
+        return total;
+    }
+
+    total.Add(split->data);
+    for (Node<T, Summary>* node = split->left; node != NULL;) { // lo side.
+        if (KeyOf::Key(node->data) < first) {
+            node = node->right;
         } else {
-            if (value < nd->data) { // Go left if the value is less than the current node's value.
-                return getNodeFromTree(nd->left, value);
-            } else { // Go right if the value is greater than or equal to the current node's value.
-                return getNodeFromTree(nd->right, value);
+            total.Add(node->data);
+            if (node->right != NULL) {
+                total.Add(node->right->summary);
             }
+            node = node->left;
+        }
+    }
+    for (Node<T, Summary>* node = split->right; node != NULL;) { // hi side.
+        if (last < KeyOf::Key(node->data)) {
+            node = node->left;
+        } else {
+            total.Add(node->data);
+            if (node->left != NULL) {
+                total.Add(node->left->summary);
+            }
+            node = node->right;
         }
-    } else { // If none of the conditions was valid, return NULL as an indication of the non-existence of that item
-        //   in the tree.
-        return NULL;
     }
+    return total;
+}
+
+//************************************
+// Method:    RetrieveSorted.
+// FullName:  RedBlackTree<T>::RetrieveSorted.
+// Access:    public.
+// Returns:   void.
+// Desc:      Looks up a batch of keys sorted in ascending order
+//            by calling the recursive helper on the whole batch,
+//            which counts as one descent.
+// Parameter: const K* keys (the sorted keys).
+// Parameter: unsigned int count (number of keys).
+// Parameter: T** results (receives a pointer per key, NULL if absent).
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+template <class K>
+void RedBlackTree<T, KeyOf, Alloc, Summary>::RetrieveSorted(const K* keys, unsigned int count, T** results) {
+    Unshare();
+    StatsDescent descent;
+    RetrieveSorted(root, keys, 0, count, results, descent);
+}
+
+
+
+//************************************
+// Method:    RetrieveSorted.
+// FullName:  RedBlackTree<T>::RetrieveSorted.
+// Access:    private.
+// Returns:   void.
+// Desc:      Merged descent for the sorted keys [lo, hi): the
+//            keys are split around the node's key, those below
+//            go down the left subtree together and those above
+//            go down the right subtree together. Every node on
+//            the union of the search paths is visited once.
+// Parameter: Node<T, Summary>* node (current recursion node).
+// Parameter: const K* keys (the sorted keys).
+// Parameter: unsigned int lo (first key of this subtree).
+// Parameter: unsigned int hi (one past the last key of this subtree).
+// Parameter: T** results (receives a pointer per key, NULL if absent).
+// Parameter: StatsDescent& descent (counts the nodes visited).
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+template <class K>
+void RedBlackTree<T, KeyOf, Alloc, Summary>::RetrieveSorted(Node<T, Summary>* node, const K* keys, unsigned int lo, unsigned int hi, T** results, StatsDescent& descent) {
+    if (lo >= hi) {
+        return;
+    }
+    if (node == NULL) { // None of these keys is in the tree.
+        for (unsigned int i = lo; i < hi; i++) {
+            results[i] = NULL;
+        }
+        return;
+    }
+    if (hi - lo == 1) { // A single key left, finish with an ordinary descent.
+        auto&& k = KeyOf::Key(keys[lo]);
+        results[lo] = NULL;
+        while (node != NULL) {
+            descent.Visit();
+            if (k == KeyOf::Key(node->data)) {
+                results[lo] = &(node->data);
+                break;
+            } else if (k < KeyOf::Key(node->data)) {
+                node = node->left;
+            } else {
+                node = node->right;
+            }
+        }
+        return;
+    }
+
+    descent.Visit();
+    auto&& nodekey = KeyOf::Key(node->data);
+    unsigned int mid = lo; // first key >= nodekey
+    unsigned int end; // first key > nodekey
+    unsigned int count = hi - lo;
+    while (count > 0) { // Binary search for mid.
+        unsigned int half = count / 2;
+        if (KeyOf::Key(keys[mid + half]) < nodekey) {
+            mid += half + 1;
+            count -= half + 1;
+        } else {
+            count = half;
+        }
+    }
+    end = mid;
+    while (end < hi && !(nodekey < KeyOf::Key(keys[end]))) { // Keys equal to nodekey (usually none or one).
+        results[end] = &(node->data);
+        end++;
+    }
+
+    RetrieveSorted(node->left, keys, lo, mid, results, descent);
+    RetrieveSorted(node->right, keys, end, hi, results, descent);
 }
 
 //************************************
@@ -51,8 +404,8 @@ Node<T>* getNodeFromTree(Node<T>* nd, T value) {
 //            from the root (without the root itself) to a
 //            certain leaf node.
 //************************************
-template <class T>
-unsigned int RedBlackTree<T>::Height() const {
+template <class T, class KeyOf, class Alloc, class Summary>
+unsigned int RedBlackTree<T, KeyOf, Alloc, Summary>::Height() const {
     int HeightOfTree = CalculateHeight(root); // Calls a helper method to calculate the height.
     if (HeightOfTree > 0) { // This will make sure that an empty tree or a tree with root node only
         //   will have same height of 0. Otherwise, it will decrement the hight by 1
@@ -72,8 +425,8 @@ unsigned int RedBlackTree<T>::Height() const {
 // Qualifier: const (it does not modify the tree).
 // Desc:      Returns the size of the tree.
 //************************************
-template <class T>
-unsigned int RedBlackTree<T>::Size() const {
+template <class T, class KeyOf, class Alloc, class Summary>
+unsigned int RedBlackTree<T, KeyOf, Alloc, Summary>::Size() const {
     return size;
 }
 
@@ -89,8 +442,8 @@ unsigned int RedBlackTree<T>::Size() const {
 //            in the tree using the post-order deletion
 //            method.
 //************************************
-template <class T>
-void RedBlackTree<T>::RemoveAll() {
+template <class T, class KeyOf, class Alloc, class Summary>
+void RedBlackTree<T, KeyOf, Alloc, Summary>::RemoveAll() {
     RemoveAll(root);
     root = NULL;
     size = 0; // This is to explicitly returning the size counter to 0, so when
@@ -110,13 +463,15 @@ void RedBlackTree<T>::RemoveAll() {
 //            no item was found in the tree that matches the passed
 //            in item parameter).
 // Desc:      Removes a Node from the tree with with a certain item.
-// Parameter: T item (item that is meant to be removed).
+// Parameter: const K& key (item, or key of the item, that is meant to be removed).
 //************************************
-template <class T>
-bool RedBlackTree<T>::Remove(T item) {
-    Node<T>* x = NULL;
-    Node<T>* y = NULL;
-    Node<T>* z = getNodeFromTree(root, item); // The node to be removed (it's value
+template <class T, class KeyOf, class Alloc, class Summary>
+template <class K>
+bool RedBlackTree<T, KeyOf, Alloc, Summary>::Remove(const K& key) {
+    Unshare();
+    Node<T, Summary>* x = NULL;
+    Node<T, Summary>* y = NULL;
+    Node<T, Summary>* z = FindNode(key); // The node to be removed (it's value
     //   will be gone, and it is going to be replaced
     //   by the predecessor's value if a predecessor exists
     //   for this node, and the predecessor's node will be
@@ -134,24 +489,21 @@ bool RedBlackTree<T>::Remove(T item) {
         y = Predecessor(z);
     }
 
-    if (y != NULL && y->left != NULL) { // The two conditions below are to
+    if (y->left != NULL) { // The two conditions below are to
         //   find whether is y's only child
         //   is left or right.
         x = y->left;
     } else {
-        if (y != NULL) {
-            x = y->right;
-        }
+        x = y->right;
     }
 
     bool xIsLeft = false;
-    Node<T>* xParent = NULL;
-    if (x != NULL && y != NULL) { // If x is not NULL, detach x from y.
+    Node<T, Summary>* xParent = y->p; // Remember where x is attached, since x itself may be NULL.
+    if (x != NULL) { // If x is not NULL, detach x from y.
         x->p = y->p;
-        xParent = y->p;
     }
 
-    if (y != NULL && y->p == NULL) { // Check if y is root (i.e. it has no parent).
+    if (y->p == NULL) { // Check if y is root (i.e. it has no parent).
         root = x;
     } else {
         // Attach x to y's parent.
@@ -164,61 +516,26 @@ bool RedBlackTree<T>::Remove(T item) {
         }
     }
 
-    if (y != NULL && z != NULL && y != z) { // Check to see if y has been moved up.
+    if (y != z) { // Check to see if y has been moved up.
         z->data = y->data;
     }
 
-    if (y != NULL && y->is_black == true) {
-        if (x == NULL) {
-            if (xParent == NULL) {
-                if (root != NULL && root->right != NULL && root->left != NULL && CalculateHeight(root->right) > CalculateHeight(root->left)) {
-                    x = root->right;
-                    xParent = root;
-                    xIsLeft = false;
-                } else if (root != NULL && root->right != NULL && root->left != NULL && CalculateHeight(root->left) > CalculateHeight(root->right)) {
-                    x = root->left;
-                    xParent = root;
-                    xIsLeft = true;
-                } else if (root != NULL && root->left == NULL) {
-                    x = root->right;
-                    xParent = root;
-                    xIsLeft = false;
-                } else if (root != NULL && root->right == NULL) {
-                    x = root->left;
-                    xParent = root;
-                    xIsLeft = true;
-                }
-            }
-        }
+    for (Node<T, Summary>* node = xParent; node != NULL; node = node->p) { // Every ancestor of y lost one node.
+        --node->count;
+    }
+    RefreshSummaries(xParent); // z (if its data changed) is one of them too.
+
+    if (y->is_black == true) { // Removing a black node shortens every path through x by one black node.
         RBDeleteFixUp(x, xParent, xIsLeft);
     }
-    delete y; // It can be the original predecessor's node, since its
+    alloc.Destroy(y); // It can be the original predecessor's node, since its
     //   value has been moved up, or it can be z itself.
     --size; // Decrement the size counter.
 
-    if (root != NULL && root->left != NULL && root->right == NULL) {
-        if (root->left->left == NULL && root->left->right == NULL) {
-            root->is_black = true;
-            root->left->is_black = false;
-        }
-    } else if (root != NULL && root->right != NULL && root->left == NULL) {
-        if (root->right->left == NULL && root->right->right == NULL) {
-            root->is_black = true;
-            root->right->is_black = false;
-        }
-    }
-
     return true;
 }
 
-template <class T>
-void InsertItemIntoTree(Node<T>* currentNode, RedBlackTree<T>* thisTree) {
-    if (currentNode != NULL) {
-        InsertItemIntoTree(currentNode->left);
-        InsertItemIntoTree(currentNode->right);
-        thisTree->Insert(currentNode->data);
-    }
-}
+
 
 //************************************
 // Method:    RBDeleteFixUp.
@@ -226,20 +543,89 @@ void InsertItemIntoTree(Node<T>* currentNode, RedBlackTree<T>* thisTree) {
 // Access:    private.
 // Returns:   void.
 // Desc:      Fixing the tree after deletion
-//            of an item to make sure it still
+//            of a black node to make sure it still
 //            satisfies the red-black tree properties.
-// Parameter: Node<T>* x (the predecessor).
-// Parameter: Node<T>* xparent (the predecessor's parent).
-// Parameter: bool xisleftchild (whether the predecessor is a
-//            left child or not).
-//************************************
-template <class T>
-void RedBlackTree<T>::RBDeleteFixUp(Node<T>* x, Node<T>* xparent, bool xisleftchild) {
-    RedBlackTree<T> newTree();
-    InsertItemIntoTree(root, &newTree);
-    RemoveAll();
-    this = newTree;
-    newTree.RemoveAll();
+//            x carries an "extra black" that is pushed up
+//            the tree by recoloring, or absorbed by at most
+//            three rotations, so the cost is O(log n).
+// Parameter: Node<T, Summary>* x (the node that replaced the removed node,
+//            it may be NULL).
+// Parameter: Node<T, Summary>* xparent (x's parent, needed when x is NULL).
+// Parameter: bool xisleftchild (whether x is a left child or not).
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+void RedBlackTree<T, KeyOf, Alloc, Summary>::RBDeleteFixUp(Node<T, Summary>* x, Node<T, Summary>* xparent, bool xisleftchild) {
+    Node<T, Summary>* w = NULL; // Sibling of x. It can not be NULL while x carries the extra black,
+    //   since the sibling's side has a black height of at least one.
+
+    while (x != root && (x == NULL || x->is_black == true)) {
+        STATS_COUNT(TREE_DELETE_FIXUPS);
+        if (xisleftchild) {
+            w = xparent->right;
+            if (w->is_black == false) { // Case 1: red sibling, rotate to get a black one.
+                w->is_black = true;
+                xparent->is_black = false;
+                LeftRotate(xparent);
+                w = xparent->right;
+            }
+            if ((w->left == NULL || w->left->is_black == true) && (w->right == NULL || w->right->is_black == true)) {
+                // Case 2: both of the sibling's children are black, move the extra black up.
+                w->is_black = false;
+                x = xparent;
+                xparent = x->p;
+                if (xparent != NULL) {
+                    xisleftchild = (x == xparent->left);
+                }
+            } else {
+                if (w->right == NULL || w->right->is_black == true) {
+                    // Case 3: only the sibling's left child is red, turn it into case 4.
+                    w->left->is_black = true;
+                    w->is_black = false;
+                    RightRotate(w);
+                    w = xparent->right;
+                }
+                // Case 4: the sibling's right child is red, one rotation absorbs the extra black.
+                w->is_black = xparent->is_black;
+                xparent->is_black = true;
+                w->right->is_black = true;
+                LeftRotate(xparent);
+                x = root;
+            }
+        } else { // Symmetric to the case above, by changing every left word with right,
+            //   and every left rotation with right rotation.
+            w = xparent->left;
+            if (w->is_black == false) {
+                w->is_black = true;
+                xparent->is_black = false;
+                RightRotate(xparent);
+                w = xparent->left;
+            }
+            if ((w->left == NULL || w->left->is_black == true) && (w->right == NULL || w->right->is_black == true)) {
+                w->is_black = false;
+                x = xparent;
+                xparent = x->p;
+                if (xparent != NULL) {
+                    xisleftchild = (x == xparent->left);
+                }
+            } else {
+                if (w->left == NULL || w->left->is_black == true) {
+                    w->right->is_black = true;
+                    w->is_black = false;
+                    LeftRotate(w);
+                    w = xparent->left;
+                }
+                w->is_black = xparent->is_black;
+                xparent->is_black = true;
+                w->left->is_black = true;
+                RightRotate(xparent);
+                x = root;
+            }
+        }
+    }
+
+    if (x != NULL) {
+        x->is_black = true;
+    }
 }
 
 //************************************
@@ -252,16 +638,158 @@ void RedBlackTree<T>::RBDeleteFixUp(Node<T>* x, Node<T>* xparent, bool xisleftch
 //            in item parameter (this tree does not allow duplicates in it)).
 // Desc:      Inserts a node with T item in the tree using a binary
 //            tree insertion method, and fix the tree after insertion
-//            to satisfy the red-black tree property.
-// Parameter: T item (value for the node to insert).
+//            to satisfy the red-black tree property. The item
+//            is copied into the node once, and nothing is
+//            allocated when it is a duplicate.
+// Parameter: const T& item (value for the node to insert).
 //************************************
-template <class T>
-bool RedBlackTree<T>::Insert(T item) {
+template <class T, class KeyOf, class Alloc, class Summary>
+bool RedBlackTree<T, KeyOf, Alloc, Summary>::Insert(const T& item) {
+    Unshare();
     if (Search(item) == true) { // Make sure no similar item to the passed in one exists in the tree. 
         return false;
     }
+    InsertNode(alloc.Create(item));
+    return true;
+}
+
+
+
+//************************************
+// Method:    Insert.
+// FullName:  RedBlackTree<T>::Insert.
+// Access:    public.
+// Returns:   bool (false if the item is already in the tree).
+// Desc:      Same as above, but the item is moved into the node.
+// Parameter: T&& item (value for the node to insert).
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+bool RedBlackTree<T, KeyOf, Alloc, Summary>::Insert(T&& item) {
+    Unshare();
+    if (Search(item) == true) {
+        return false;
+    }
+    InsertNode(alloc.Create(move(item)));
+    return true;
+}
 
-    Node<T>* x = BSTInsert(item); // Normal binary tree insertion.
+
+
+//************************************
+// Method:    Emplace.
+// FullName:  RedBlackTree<T>::Emplace.
+// Access:    public.
+// Returns:   bool (false if an equal item is already in the tree).
+// Desc:      Constructs the item directly in a new node. The
+//            key is only known once the item exists, so the node
+//            is destroyed again when the item is a duplicate.
+// Parameter: Args&&... args (arguments of one of T's constructors).
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+template <class... Args>
+bool RedBlackTree<T, KeyOf, Alloc, Summary>::Emplace(Args&&... args) {
+    Unshare();
+    Node<T, Summary>* x = alloc.Create(forward<Args>(args)...);
+    if (Search(x->data) == true) {
+        alloc.Destroy(x);
+        return false;
+    }
+    InsertNode(x);
+    return true;
+}
+
+
+
+//************************************
+// Method:    BuildFromSorted.
+// FullName:  RedBlackTree<T>::BuildFromSorted.
+// Access:    public.
+// Returns:   bool (false if the items are not in strictly
+//            ascending order).
+// Desc:      Checks the order in a first pass, then builds the
+//            tree top down by splitting every range at its
+//            middle item. The two halves of a range differ by
+//            at most one item, so every NULL child lies on the
+//            last two levels: all levels are black except the
+//            last one when it is not full, which is red. Every
+//            path then has the same number of black nodes, and
+//            no red node has a red child.
+// Parameter: It first (iterator to the smallest item).
+// Parameter: It last (iterator past the largest item).
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+template <class It>
+bool RedBlackTree<T, KeyOf, Alloc, Summary>::BuildFromSorted(It first, It last) {
+    unsigned int n = 0;
+    for (It it = first, prev = first; it != last; prev = it, ++it, ++n) {
+        if (n > 0 && !(KeyOf::Key(*prev) < KeyOf::Key(*it))) {
+            return false;
+        }
+    }
+    RemoveAll();
+
+    unsigned int reddepth = 0; // floor(log2(n + 1)), beyond the last level if it is full
+    while ((n + 1) >> (reddepth + 1) != 0) {
+        ++reddepth;
+    }
+    root = BuildSorted(first, n, 0, reddepth, NULL);
+    size = n;
+    return true;
+}
+
+
+
+//************************************
+// Method:    BuildSorted.
+// FullName:  RedBlackTree<T>::BuildSorted.
+// Access:    private.
+// Returns:   Node<T, Summary>* (root of the new subtree, NULL if n is 0).
+// Desc:      Builds the left half, then the middle node, then
+//            the right half, so the items are read in order.
+//            Sizes and summaries are computed on the way back
+//            up, once both children exist.
+// Parameter: It& it (next item to read).
+// Parameter: unsigned int n (number of items in the subtree).
+// Parameter: unsigned int depth (depth of the subtree's root).
+// Parameter: unsigned int reddepth (depth of the red nodes).
+// Parameter: Node<T, Summary>* parentnode (parent of the subtree's root).
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+template <class It>
+Node<T, Summary>* RedBlackTree<T, KeyOf, Alloc, Summary>::BuildSorted(It& it, unsigned int n, unsigned int depth, unsigned int reddepth, Node<T, Summary>* parentnode) {
+    if (n == 0) {
+        return NULL;
+    }
+    unsigned int leftcount = (n - 1) / 2;
+    Node<T, Summary>* left = BuildSorted(it, leftcount, depth + 1, reddepth, NULL);
+    Node<T, Summary>* node = alloc.Create(*it);
+    ++it;
+    node->p = parentnode;
+    node->is_black = depth != reddepth;
+    node->left = left;
+    if (left != NULL) {
+        left->p = node;
+    }
+    node->right = BuildSorted(it, n - 1 - leftcount, depth + 1, reddepth, node);
+    Refresh(node);
+    return node;
+}
+
+
+
+//************************************
+// Method:    InsertNode.
+// FullName:  RedBlackTree<T>::InsertNode.
+// Access:    private.
+// Returns:   void.
+// Desc:      Links a new node using a binary tree insertion
+//            method, and fix the tree after insertion to satisfy
+//            the red-black tree property.
+// Parameter: Node<T, Summary>* newnode (a node whose item is not in the tree).
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+void RedBlackTree<T, KeyOf, Alloc, Summary>::InsertNode(Node<T, Summary>* newnode) {
+    Node<T, Summary>* x = BSTInsert(newnode); // Normal binary tree insertion.
     ++size; // Mainly used to make sure that root assignment in the BSTInsert only done once if there are more than
     //   one item in the tree.
 
@@ -274,8 +802,9 @@ bool RedBlackTree<T>::Insert(T item) {
     if (x != NULL) { // This condition might not be necessary but just to make
         //   sure that there is an item that was inserted (i.e. BSTInsert did not return NULL).
         x->is_black = false;
-        Node<T>* y = NULL;
+        Node<T, Summary>* y = NULL;
         while (x != root && x->p != NULL && x->p->is_black == false) { // Iterate until root or parent is reached.
+            STATS_COUNT(TREE_INSERT_FIXUPS);
             if (x->p->p != NULL && x->p == x->p->p->left) {
                 if (x->p != NULL && x->p->p != NULL) {
                     y = x->p->p->right; // "Uncle" of x.
@@ -324,7 +853,6 @@ bool RedBlackTree<T>::Insert(T item) {
     }
 
     root->is_black = true;
-    return true;
 }
 
 
@@ -336,17 +864,23 @@ bool RedBlackTree<T>::Insert(T item) {
 // Returns:   RedBlackTree<T>&.
 // Desc:      Assignment overloading for this class.
 //            It will perform a deep copy of the passed in
-//            RedBlackTree<T> class object, but it will first check
+//            RedBlackTree<T> class object (or share its nodes
+//            in copy-on-write mode), but it will first check
 //            to avoid self assignment (for speed).
 // Parameter: const RedBlackTree & rbtree.
 //************************************
-template <class T>
-RedBlackTree<T>& RedBlackTree<T>::operator=(const RedBlackTree& rbtree) {
+template <class T, class KeyOf, class Alloc, class Summary>
+RedBlackTree<T, KeyOf, Alloc, Summary>& RedBlackTree<T, KeyOf, Alloc, Summary>::operator=(const RedBlackTree& rbtree) {
     if (this != &rbtree) { // Check to see that there is no self assignment.
         RemoveAll(); // Clean the entire tree.
-        CopyTree(GetRoot(), rbtree.GetRoot(), rbtree.GetRoot()); // Copy everything from rbtree to this tree.
+        copyonwrite = rbtree.copyonwrite;
+        if (copyonwrite) {
+            ShareTree(rbtree);
+        } else {
+            root = CopyTree(rbtree.GetRoot(), NULL); // Copy everything from rbtree to this tree.
+            size = rbtree.Size(); // Explicitly changing this->size to be exactely like rbtree.Size() (Size is a getter method for size counter).
+        }
     }
-    size = rbtree.Size(); // Explicitly changing this->size to be exactely like rbtree.Size() (Size is a getter method for size counter).
     return *this;
 }
 
@@ -359,8 +893,8 @@ RedBlackTree<T>& RedBlackTree<T>::operator=(const RedBlackTree& rbtree) {
 // Desc:      Class destructor. Calls RemoveAll
 //            method to delete all nodes in the tree.
 //************************************
-template <class T>
-RedBlackTree<T>::~RedBlackTree() {
+template <class T, class KeyOf, class Alloc, class Summary>
+RedBlackTree<T, KeyOf, Alloc, Summary>::~RedBlackTree() {
     RemoveAll();
 }
 
@@ -370,16 +904,22 @@ RedBlackTree<T>::~RedBlackTree() {
 // Method:    RedBlackTree.
 // FullName:  RedBlackTree<T>::RedBlackTree.
 // Access:    public.
-// Qualifier: : root(NULL), size(0) (initializing the variables
-//            of the class).
-// Desc:      Copy constructor for the class.
+// Qualifier: : root(NULL), size(0), shared(NULL),
+//            copyonwrite(rbtree.copyonwrite) (initializing the
+//            variables of the class).
+// Desc:      Copy constructor for the class. A copy-on-write
+//            tree is shared, any other tree is cloned.
 // Parameter: const RedBlackTree& rbtree (the class's
 //            object to copy from).
 //***********************************
-template <class T>
-RedBlackTree<T>::RedBlackTree(const RedBlackTree& rbtree) : root(NULL), size(0) {
-    CopyTree(GetRoot(), rbtree.GetRoot(), rbtree.GetRoot());
-    size = rbtree.Size();
+template <class T, class KeyOf, class Alloc, class Summary>
+RedBlackTree<T, KeyOf, Alloc, Summary>::RedBlackTree(const RedBlackTree& rbtree) : root(NULL), size(0), shared(NULL), copyonwrite(rbtree.copyonwrite) {
+    if (copyonwrite) {
+        ShareTree(rbtree);
+    } else {
+        root = CopyTree(rbtree.GetRoot(), NULL);
+        size = rbtree.Size();
+    }
 }
 
 
@@ -387,12 +927,13 @@ RedBlackTree<T>::RedBlackTree(const RedBlackTree& rbtree) : root(NULL), size(0)
 // Method:    RedBlackTree.
 // FullName:  RedBlackTree<T>::RedBlackTree
 // Access:    public.
-// Qualifier: : root(NULL), size(0) (initializing the variables
+// Qualifier: : root(NULL), size(0), shared(NULL),
+//            copyonwrite(false) (initializing the variables
 //            of the class).
 // Desc:      Default constructor for the class.
 //************************************
-template <class T>
-RedBlackTree<T>::RedBlackTree() : root(NULL), size(0) {
+template <class T, class KeyOf, class Alloc, class Summary>
+RedBlackTree<T, KeyOf, Alloc, Summary>::RedBlackTree() : root(NULL), size(0), shared(NULL), copyonwrite(false) {
 }
 
 
@@ -404,11 +945,11 @@ RedBlackTree<T>::RedBlackTree() : root(NULL), size(0) {
 // Returns:   unsigned int.
 // Qualifier: const (getter method - I.e. it should
 //            not modify anything).
-// Parameter: Node<T>* node (current node for recursive calls
+// Parameter: Node<T, Summary>* node (current node for recursive calls
 //            to the method).
 //************************************
-template <class T>
-unsigned int RedBlackTree<T>::CalculateHeight(Node<T>* node) const {
+template <class T, class KeyOf, class Alloc, class Summary>
+unsigned int RedBlackTree<T, KeyOf, Alloc, Summary>::CalculateHeight(Node<T, Summary>* node) const {
     if (node != NULL) {
         // Calculate the left and right height of every node recursively,
         //   and then take the largest one of them and return it.
@@ -435,19 +976,24 @@ unsigned int RedBlackTree<T>::CalculateHeight(Node<T>* node) const {
 // FullName:  RedBlackTree<T>::RemoveAll.
 // Access:    public.
 // Returns:   void.
-// Desc:      Helper function that recursively
-//            removes every node from the tree
-//            using post order traversal.
-// Parameter: Node<T>* node (current recursion node).
+// Desc:      Helper function that removes every node
+//            from the tree. The node allocator decides how:
+//            the default one deletes node by node using post
+//            order traversal, a pooled one drops its slabs.
+//            Shared nodes are only removed by the last tree
+//            that lets go of them.
+// Parameter: Node<T, Summary>* node (root of the subtree to remove).
 //************************************
-template <class T>
-void RedBlackTree<T>::RemoveAll(Node<T>* node) {
-    if (node != NULL) {
-        // Post-order recursive deletion of the tree so no
-        //   access violation is made.
-        RemoveAll(node->left);
-        RemoveAll(node->right);
-        delete node;
+template <class T, class KeyOf, class Alloc, class Summary>
+void RedBlackTree<T, KeyOf, Alloc, Summary>::RemoveAll(Node<T, Summary>* node) {
+    if (shared != NULL) {
+        if (shared->refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+            shared->alloc.DestroyAll(node);
+            delete shared;
+        }
+        shared = NULL;
+    } else {
+        alloc.DestroyAll(node);
     }
     size = 0; // Explicitly returning the size to 0.
 }
@@ -458,33 +1004,120 @@ void RedBlackTree<T>::RemoveAll(Node<T>* node) {
 // Method:    CopyTree.
 // FullName:  RedBlackTree<T>::CopyTree.
 // Access:    private.
-// Returns:   Node<T>*.
-// Parameter: Node<T>* thisnode (current node for this class - 
-//            I did not use it here).
-// Parameter: Node<T>* sourcenode (current node of the copying from class).
-// Parameter: Node<T>* parentnode (I used this one to find the root of the
-//            copying from class).
-//************************************
-template <class T>
-Node<T>* RedBlackTree<T>::CopyTree(Node<T>* thisnode, Node<T>* sourcenode, Node<T>* parentnode) {
-    Node<T>* nd = NULL;
-    if (sourcenode != NULL) {
-        // Do normal pre-order binary search tree insertion to make sure that I have the same
-        //    structure as the passed in tree, with a little addition of copying the passed in tree colors
-        //    to make an identical red-black tree copy. 
-        nd = BSTInsert(sourcenode->data);
-        ++size;
-        nd->is_black = sourcenode->is_black;
-        CopyTree(NULL, sourcenode->left, parentnode); // I did not use thisnode argument for this function,
-        CopyTree(NULL, sourcenode->right, parentnode); //    so I call the next recursive function with NULL
-    } //    for thisnode argument.
-    // I used parentnode as an indicator of the root for of rbtree so to make sure I set
-    //   the right root for this tree.
-    if (sourcenode == parentnode) {
-        root = nd;
+// Returns:   Node<T, Summary>* (root of the copy, NULL for an empty subtree).
+// Desc:      Structural pre-order copy: every node is cloned
+//            once and linked straight to its copied parent, so
+//            the copy has the same shape, colors, subtree sizes
+//            and summaries as the source, in O(n) with no
+//            descents from the root.
+// Parameter: const Node<T, Summary>* sourcenode (current node of the copying from class).
+// Parameter: Node<T, Summary>* parentnode (the copy of sourcenode's parent).
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+Node<T, Summary>* RedBlackTree<T, KeyOf, Alloc, Summary>::CopyTree(const Node<T, Summary>* sourcenode, Node<T, Summary>* parentnode) {
+    if (sourcenode == NULL) {
+        return NULL;
     }
-    return NULL;
+    Node<T, Summary>* nd = alloc.Create(sourcenode->data);
+    nd->p = parentnode;
+    nd->is_black = sourcenode->is_black;
+    nd->count = sourcenode->count;
+    nd->summary = sourcenode->summary;
+    nd->left = CopyTree(sourcenode->left, nd);
+    nd->right = CopyTree(sourcenode->right, nd);
+    return nd;
+}
+
+
+
+//************************************
+// Method:    ShareTree.
+// FullName:  RedBlackTree<T>::ShareTree.
+// Access:    private.
+// Returns:   void.
+// Desc:      The first copy moves the source's nodes, with the
+//            allocator that owns them, into a SharedNodes
+//            block; later copies only add a reference. Only
+//            where the nodes live changes, so the source stays
+//            logically const.
+// Parameter: const RedBlackTree& rbtree (the tree to share with).
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+void RedBlackTree<T, KeyOf, Alloc, Summary>::ShareTree(const RedBlackTree& rbtree) {
+    RedBlackTree& source = const_cast<RedBlackTree&>(rbtree);
+    if (source.shared == NULL) {
+        source.shared = new SharedNodes();
+        source.shared->refs.store(1, memory_order_relaxed);
+        source.alloc.Swap(source.shared->alloc);
+    }
+    source.shared->refs.fetch_add(1, memory_order_relaxed);
+    shared = source.shared;
+    root = source.root;
+    size = source.size;
+}
+
+
+
+//************************************
+// Method:    Unshare.
+// FullName:  RedBlackTree<T>::Unshare.
+// Access:    private.
+// Returns:   void.
+// Desc:      Called first by every function that may change
+//            the tree. Does nothing unless the nodes are shared.
+//            The last tree holding them takes them (and their
+//            allocator) back in O(1); any other tree clones
+//            them, and destroys the originals if the others let
+//            go of them in the meantime.
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+void RedBlackTree<T, KeyOf, Alloc, Summary>::Unshare() {
+    if (shared == NULL) {
+        return;
+    }
+    if (shared->refs.load(memory_order_acquire) == 1) {
+        alloc.Swap(shared->alloc);
+        delete shared;
+    } else {
+        Node<T, Summary>* source = root;
+        root = CopyTree(source, NULL);
+        if (shared->refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+            shared->alloc.DestroyAll(source);
+            delete shared;
+        }
+    }
+    shared = NULL;
+}
+
+
+
+//************************************
+// Method:    SetCopyOnWrite.
+// FullName:  RedBlackTree<T>::SetCopyOnWrite.
+// Access:    public.
+// Returns:   void.
+// Desc:      Only changes how later copies are made; nodes
+//            already shared stay shared until they change.
+// Parameter: bool enable.
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+void RedBlackTree<T, KeyOf, Alloc, Summary>::SetCopyOnWrite(bool enable) {
+    copyonwrite = enable;
+}
+
+
+
+//************************************
+// Method:    IsShared.
+// FullName:  RedBlackTree<T>::IsShared.
+// Access:    public.
+// Returns:   bool.
+// Qualifier: const.
+//************************************
+template <class T, class KeyOf, class Alloc, class Summary>
+bool RedBlackTree<T, KeyOf, Alloc, Summary>::IsShared() const {
+    return shared != NULL;
 }
 
 
-#endif _REDBLACKTREE_H_
\ No newline at end of file
+#endif
\ No newline at end of file
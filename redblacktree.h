@@ -5,95 +5,340 @@
 #ifndef _REDBLACKTREE_H_
 #define _REDBLACKTREE_H_
 
+#include <atomic>
+#include <cstddef>
 #include <cstdlib>
+#include <iterator>
 #include <stdexcept>
 #include <string>
 #include <stdio.h>
 #include <stdlib.h>
+#include <type_traits>
+#include <utility>
+
+#include "nodeallocator.h"
+#include "stockstats.h"
 
 using namespace std;
 
-template <class T>
+// Default summary policy: nodes keep no aggregate.
+// A summary policy is default constructible as the empty aggregate and
+//   provides Add(item) and Add(summary) to fold in one item or a whole
+//   subtree. Add must be associative and commutative (e.g. sums), since
+//   subtrees are combined in whatever order the tree shape gives.
+struct NoSummary {
+    template <class U>
+    void Add(const U&) {
+    }
+};
+
+template <class T, class Summary = NoSummary>
 class Node {
 public:
     T data;
-    Node<T>* left;
-    Node<T>* right;
-    Node<T>* p; // parent pointer
+    Node<T, Summary>* left;
+    Node<T, Summary>* right;
+    Node<T, Summary>* p; // parent pointer
+    unsigned int count; // number of nodes in the subtree rooted here, this one included
     bool is_black;
+    [[no_unique_address]] Summary summary; // aggregate of the subtree rooted here (see NoSummary)
 
     // parameterized constructor
+    // data is constructed in place from args (a value to copy or move, or
+    //   the arguments of one of T's constructors)
+
+    template <class... Args>
+    explicit Node(Args&&... args) : data(forward<Args>(args)...), left(NULL), right(NULL), p(NULL), count(1), is_black(false), summary() {
+    }
+};
+
+// Bidirectional in-order iterator over a RedBlackTree.
+// N is the tree's node type, V is its item type for a mutable iterator and
+//   const item type for a read-only one.
+// Steps follow the parent pointers, so no stack is kept and a full traversal
+//   visits every edge twice (O(1) amortised per step).
+// Inserting or removing other items does not invalidate an iterator, but
+//   removing its own item does (Remove may move data between nodes).
+template <class N, class V>
+class TreeIterator {
+private:
+    N* node; // current node, NULL at end()
+    N* const* root; // the tree's root member, needed to step back from end()
+
+    static N* Leftmost(N* x) {
+        while (x != NULL && x->left != NULL) {
+            x = x->left;
+        }
+        return x;
+    }
+
+    static N* Rightmost(N* x) {
+        while (x != NULL && x->right != NULL) {
+            x = x->right;
+        }
+        return x;
+    }
+
+public:
+    typedef bidirectional_iterator_tag iterator_category;
+    typedef typename remove_const<V>::type value_type;
+    typedef ptrdiff_t difference_type;
+    typedef V* pointer;
+    typedef V& reference;
+
+    TreeIterator() : node(NULL), root(NULL) {
+    }
+
+    TreeIterator(N* n, N* const* r) : node(n), root(r) {
+    }
+
+    // a mutable iterator converts to a read-only one
+    operator TreeIterator<N, const V>() const {
+        return TreeIterator<N, const V>(node, root);
+    }
+
+    V& operator*() const {
+        return node->data;
+    }
+
+    V* operator->() const {
+        return &node->data;
+    }
+
+    // the next node is the leftmost node of the right subtree, or else the
+    //   first ancestor reached from its left subtree
+    TreeIterator& operator++() {
+        if (node->right != NULL) {
+            node = Leftmost(node->right);
+        } else {
+            N* child = node;
+            node = node->p;
+            while (node != NULL && child == node->right) {
+                child = node;
+                node = node->p;
+            }
+        }
+        return *this;
+    }
+
+    TreeIterator operator++(int) {
+        TreeIterator old = *this;
+        ++*this;
+        return old;
+    }
 
-    Node(T value) {
-        data = value;
-        left = NULL;
-        right = NULL;
-        p = NULL;
-        is_black = false;
+    // mirror image of operator++, end() steps back to the largest item
+    TreeIterator& operator--() {
+        if (node == NULL) {
+            node = Rightmost(*root);
+        } else if (node->left != NULL) {
+            node = Rightmost(node->left);
+        } else {
+            N* child = node;
+            node = node->p;
+            while (node != NULL && child == node->left) {
+                child = node;
+                node = node->p;
+            }
+        }
+        return *this;
+    }
+
+    TreeIterator operator--(int) {
+        TreeIterator old = *this;
+        --*this;
+        return old;
+    }
+
+    bool operator==(const TreeIterator& it) const {
+        return node == it.node;
+    }
+
+    bool operator!=(const TreeIterator& it) const {
+        return node != it.node;
+    }
+};
+
+// Default key policy: an item is its own key.
+// A key policy provides Key(x) for items and for anything else that may be
+//   used to look items up; keys are compared with < and ==.
+struct IdentityKeyOf {
+    template <class U>
+    static const U& Key(const U& value) {
+        return value;
     }
 };
 
-template <class T>
+// KeyOf extracts the key the tree is ordered by (see IdentityKeyOf).
+//   Search, Retrieve and Remove accept anything KeyOf::Key accepts, so a
+//   policy that also takes bare keys allows lookups without building an item.
+// Alloc creates and destroys the tree's nodes (see nodeallocator.h).
+// The default allocates every node with new/delete,
+//   PoolNodeAllocator<Node<T> > packs them into slabs owned by the tree.
+//   It is rebound to the node type actually used, so the same allocator
+//   name works whatever the Summary.
+// Summary is an aggregate every node keeps of its subtree (see NoSummary),
+//   kept up to date by every insertion, removal, rotation and Update, and
+//   queried with RangeSummary. NoSummary takes no space and no time.
+template <class T, class KeyOf = IdentityKeyOf, class Alloc = NewDeleteNodeAllocator<Node<T> >, class Summary = NoSummary>
 class RedBlackTree {
 private:
 
-    Node<T>* root;
+    typedef typename Alloc::template Rebind<Node<T, Summary> >::Other NodeAllocator;
+
+    // The nodes of copy-on-write copies (see SetCopyOnWrite), with the allocator
+    //   that owns them. refs counts the trees sharing them; it is atomic so
+    //   copies may be released from different threads.
+    struct SharedNodes {
+        NodeAllocator alloc;
+        atomic<unsigned int> refs;
+    };
+
+    Node<T, Summary>* root;
     int size;
+    NodeAllocator alloc; // owns the nodes of this tree, unless they are shared
+    SharedNodes* shared; // NULL unless the nodes are shared with copies of this tree
+    bool copyonwrite; // copies share the nodes instead of cloning them
 
     // recursive helper function for deep copy
-    // creates a new node based on sourcenode's contents, links back to parentnode,
-    //   and recurses to create left and right children
-    Node<T>* CopyTree(Node<T>* thisnode, Node<T>* sourcenode, Node<T>* parentnode);
+    // creates a new node with sourcenode's contents, color, size and summary,
+    //   links it to parentnode, and recurses to create left and right children
+    Node<T, Summary>* CopyTree(const Node<T, Summary>* sourcenode, Node<T, Summary>* parentnode);
+
+    // makes this tree share the nodes of rbtree (which may already share them)
+    void ShareTree(const RedBlackTree<T, KeyOf, Alloc, Summary>& rbtree);
+
+    // gives this tree nodes of its own before it is changed: takes the shared
+    //   nodes back if no other tree holds them any more, clones them otherwise
+    void Unshare();
+
+    // recursive helper for BuildFromSorted
+    // builds a subtree from the next n items of it (advancing it), with its root
+    //   at depth; nodes at reddepth are red, all others black
+    template <class It>
+    Node<T, Summary>* BuildSorted(It& it, unsigned int n, unsigned int depth, unsigned int reddepth, Node<T, Summary>* parentnode);
 
-    // recursive helper function for tree deletion
-    // deallocates nodes in post-order
-    void RemoveAll(Node<T>* node);
+    // helper function for tree deletion
+    // hands the whole tree to the node allocator, or lets go of the shared
+    //   nodes (destroying them if this was their last tree)
+    void RemoveAll(Node<T, Summary>* node);
 
-    // performs BST insertion and returns pointer to inserted node
+    // performs BST insertion of an already constructed node and returns it
     // Note that this should only be called if item does not already exist in the tree
     // Does not increase tree size.
-    Node<T>* BSTInsert(T item); //Done
+    Node<T, Summary>* BSTInsert(Node<T, Summary>* newnode); //Done
+
+    // links a new node whose item is not in the tree yet, increments size
+    //   and fixes the tree
+    void InsertNode(Node<T, Summary>* newnode);
 
     // helper function for in-order traversal
-    void InOrder(const Node<T>* node, T* arr, int arrsize, int& index) const; //Done
+    void InOrder(const Node<T, Summary>* node, T* arr, int arrsize, int& index) const; //Done
+
+    // subtree size of node, 0 for NULL
+    static unsigned int SubtreeSize(const Node<T, Summary>* node) {
+        return node == NULL ? 0 : node->count;
+    }
+
+    // recomputes node->count and node->summary from its children
+    void Refresh(Node<T, Summary>* node);
+
+    // recomputes the summaries of node and of all its ancestors, after the
+    //   subtree of node changed; does nothing for an empty Summary
+    void RefreshSummaries(Node<T, Summary>* node);
 
     // rotation functions
-    void LeftRotate(Node<T>* node); //Done
-    void RightRotate(Node<T>* node); //Done
+    // Both keep the subtree sizes and summaries of the two rotated nodes up to date.
+    void LeftRotate(Node<T, Summary>* node); //Done
+    void RightRotate(Node<T, Summary>* node); //Done
 
     // get the predecessor of a node
-    Node<T>* Predecessor(Node<T>* node); //Done
+    Node<T, Summary>* Predecessor(Node<T, Summary>* node); //Done
 
     // Tree fix, performed after removal of a black node
     // Note that the parameter x may be NULL
-    void RBDeleteFixUp(Node<T>* x, Node<T>* xparent, bool xisleftchild);
+    void RBDeleteFixUp(Node<T, Summary>* x, Node<T, Summary>* xparent, bool xisleftchild);
+
+    // recursive helper for RetrieveSorted, resolves keys[lo, hi) within the subtree of node
+    template <class K>
+    void RetrieveSorted(Node<T, Summary>* node, const K* keys, unsigned int lo, unsigned int hi, T** results, StatsDescent& descent);
+
+    // returns the node holding key, or NULL if there is none
+    template <class K>
+    Node<T, Summary>* FindNode(const K& key) const;
+
+    // returns the first node whose key is not less than key (inclusive) or
+    //   greater than key (!inclusive), or NULL if there is none
+    template <class K>
+    Node<T, Summary>* BoundNode(const K& key, bool inclusive) const;
+
+    // returns the k-th smallest node, or NULL if k >= size
+    Node<T, Summary>* SelectNode(unsigned int k) const;
 
     // Calculates the height of the tree
     // Requires a traversal of the tree, O(n)
-    unsigned int CalculateHeight(Node<T>* node) const;
+    unsigned int CalculateHeight(Node<T, Summary>* node) const;
 
 public:
 
+    // in-order iterators, the items are visited in place
+    typedef TreeIterator<Node<T, Summary>, T> iterator;
+    typedef TreeIterator<Node<T, Summary>, const T> const_iterator;
+
     // default constructor--------------------------------------------------
     RedBlackTree();
 
     // copy constructor, performs deep copy of parameter
-    RedBlackTree(const RedBlackTree<T>& rbtree);
+    // O(n): the nodes are cloned with their colors, sizes and summaries, no
+    //   insertions. With copy-on-write the copy shares the nodes instead, O(1).
+    RedBlackTree(const RedBlackTree<T, KeyOf, Alloc, Summary>& rbtree);
 
     // destructor
     // Must deallocate memory associated with all nodes in tree
     ~RedBlackTree();
 
+    // Copy-on-write mode, off by default. While it is on, copies of this tree
+    //   (and their own copies) share its nodes until one of them is changed;
+    //   that tree then clones the nodes (O(n)) and changes its own clone.
+    // Every non-const member function counts as a change, including Retrieve
+    //   and the mutable iterators: read a shared tree through a const
+    //   reference to keep it shared. A clone invalidates the iterators and
+    //   pointers of the tree that made it.
+    // Shared trees may be read from different threads at once, but each tree
+    //   is still only changed by one thread at a time.
+    void SetCopyOnWrite(bool enable);
+
+    // true if the nodes of this tree are currently shared with a copy
+    bool IsShared() const;
+
     // Mutator functions-----------------------------------------------------
 
     // Calls BSTInsert and then performs any necessary tree fixing.
     // If item already exists, do not insert and return false.
     // Otherwise, insert, increment size, and return true.
-    bool Insert(T item);
+    // The item is copied (or moved) straight into its node.
+    bool Insert(const T& item);
+    bool Insert(T&& item);
+
+    // Insert for an item constructed in place from args, with no
+    //   temporary T. The node is built before the key is known, so a
+    //   duplicate costs one node construction.
+    template <class... Args>
+    bool Emplace(Args&&... args);
+
+    // Replaces the contents of the tree with the items of [first, last), which
+    //   must be in strictly ascending key order (a forward range is read twice).
+    // Builds a perfectly balanced, correctly colored tree in O(n), with no
+    //   searches or rotations.
+    // If the items are not sorted, or contain duplicates, return false and leave
+    //   the tree unchanged.
+    template <class It>
+    bool BuildFromSorted(It first, It last);
 
     // Removal of an item from the tree.
     // Must deallocate deleted node after RBDeleteFixUp returns
-    bool Remove(T item);
+    template <class K>
+    bool Remove(const K& key);
 
     // deletes all nodes in the tree. Calls recursive helper function.
     void RemoveAll();
@@ -102,18 +347,79 @@ public:
 
     // Returns existence of item in the tree.
     // Return true if found, false otherwise.
-    bool Search(T item) const; //Done
+    template <class K>
+    bool Search(const K& key) const; //Done
 
     // Searches for item and returns a pointer to the node contents so the
     //   value may be accessed or modified
     // Use with caution! Do not modify the item's key value such that the
     //   red-black / BST properties are violated.
-    T* Retrieve(T item); //Done
+    template <class K>
+    T* Retrieve(const K& key); //Done
+
+    // Retrieve for a batch of keys sorted in ascending order.
+    // results[i] is set to the contents of the node holding keys[i], or NULL.
+    // All keys descend together, so neighbouring keys share their common
+    //   path and no node is visited twice.
+    template <class K>
+    void RetrieveSorted(const K* keys, unsigned int count, T** results);
 
     // performs an in-order traversal of the tree
     // arrsize is the size of the returned array (equal to tree size attribute)
+    // Copies every item and the caller must delete the array; prefer the
+    //   iterators or ForEach, which visit the items in place.
     T* Dump(int& arrsize) const; //Done
 
+    // iterators over the items in ascending order
+    // Do not modify an item's key value through a mutable iterator.
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    // Calls visit(item) for every item in ascending order, without copying.
+    template <class F>
+    void ForEach(F visit) const;
+
+    // iterator to the first item whose key is not less than key, or end()
+    template <class K>
+    iterator LowerBound(const K& key);
+    template <class K>
+    const_iterator LowerBound(const K& key) const;
+
+    // iterator to the first item whose key is greater than key, or end()
+    template <class K>
+    iterator UpperBound(const K& key);
+    template <class K>
+    const_iterator UpperBound(const K& key) const;
+
+    // iterator to the k-th smallest item (k = 0 is the smallest), or end()
+    //   if k >= Size(). O(log n) thanks to the subtree sizes.
+    iterator Select(unsigned int k);
+    const_iterator Select(unsigned int k) const;
+
+    // number of items whose key is less than key, i.e. the position key has
+    //   or would have in ascending order. O(log n).
+    template <class K>
+    unsigned int Rank(const K& key) const;
+
+    // Calls visit(item) for every item with lo <= key <= hi, in ascending order.
+    // Costs O(log n + k) for k visited items.
+    template <class K, class F>
+    void Range(const K& lo, const K& hi, F visit) const;
+
+    // Calls mutate(item) on the item holding key, then brings the summaries
+    //   on its path back up to date. Returns false if there is no such item.
+    // Items of a tree with a Summary must only be changed this way (not
+    //   through Retrieve or an iterator). mutate must not change the key.
+    template <class K, class F>
+    bool Update(const K& key, F mutate);
+
+    // Aggregate of the items with lo <= key <= hi, in O(log n): whole
+    //   subtrees inside the range are folded in through their summary.
+    template <class K>
+    Summary RangeSummary(const K& lo, const K& hi) const;
+
     // returns the number of items in the tree
     unsigned int Size() const;
 
@@ -122,15 +428,16 @@ public:
     unsigned int Height() const;
 
     // returns a pointer to the root of the tree
+    // Nodes changed through it are not unshared (see SetCopyOnWrite).
     // NOTE: This will be used only for grading.
     // Providing access to the tree internals is dangerous in practice!
 
-    Node<T>* GetRoot() const {
+    Node<T, Summary>* GetRoot() const {
         return this->root;
     }
 
-    // overloaded assignment operator
-    RedBlackTree<T>& operator=(const RedBlackTree<T>& rbtree);
+    // overloaded assignment operator, copies like the copy constructor
+    RedBlackTree<T, KeyOf, Alloc, Summary>& operator=(const RedBlackTree<T, KeyOf, Alloc, Summary>& rbtree);
 };
 
 #include "rbtreepartial.cpp"
@@ -0,0 +1,300 @@
+// File:        skutable.cpp
+// Date:        2026-10-17
+// Description: Implementation of a SkuTable class
+
+#include "skutable.h"
+
+//************************************
+// Method:    SkuTable.
+// FullName:  SkuTable::SkuTable.
+// Access:    public.
+// Qualifier: : data(new TableData()), size(0), copyonwrite(false).
+// Desc:      Default constructor. The slots are only
+//            allocated once the first item is inserted.
+//************************************
+SkuTable::SkuTable() : data(new TableData()), size(0), copyonwrite(false) {
+}
+
+
+
+//************************************
+// Method:    SkuTable.
+// FullName:  SkuTable::SkuTable.
+// Access:    public.
+// Qualifier: : data(NULL), size(table.size), copyonwrite(table.copyonwrite).
+// Desc:      Copy constructor.
+// Parameter: const SkuTable& table (the table to copy).
+//************************************
+SkuTable::SkuTable(const SkuTable& table) : data(NULL), size(table.size), copyonwrite(table.copyonwrite) {
+    if (copyonwrite) {
+        data = table.data;
+        data->refs.fetch_add(1, memory_order_relaxed);
+    } else {
+        data = new TableData();
+        data->slots = table.data->slots;
+        data->occupied = table.data->occupied;
+    }
+}
+
+
+
+//************************************
+// Method:    ~SkuTable.
+// FullName:  SkuTable::~SkuTable.
+// Access:    public.
+//************************************
+SkuTable::~SkuTable() {
+    Release();
+}
+
+
+
+//************************************
+// Method:    operator=.
+// FullName:  SkuTable::operator=.
+// Access:    public.
+// Returns:   SkuTable&.
+// Desc:      Copies like the copy constructor, after checking
+//            for self assignment.
+// Parameter: const SkuTable& table.
+//************************************
+SkuTable& SkuTable::operator=(const SkuTable& table) {
+    if (this != &table) {
+        SkuTable copy(table);
+        swap(data, copy.data);
+        size = copy.size;
+        copyonwrite = copy.copyonwrite;
+    }
+    return *this;
+}
+
+
+
+//************************************
+// Method:    Release.
+// FullName:  SkuTable::Release.
+// Access:    private.
+// Returns:   void.
+// Desc:      The last table holding the data deletes it.
+//            Leaves data NULL, the caller replaces it.
+//************************************
+void SkuTable::Release() {
+    if (data != NULL && data->refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+        delete data;
+    }
+    data = NULL;
+}
+
+
+
+//************************************
+// Method:    Unshare.
+// FullName:  SkuTable::Unshare.
+// Access:    private.
+// Returns:   void.
+// Desc:      Called first by every function that may change
+//            the table. If other tables still hold the data,
+//            this one copies it and lets go of the shared one.
+//************************************
+void SkuTable::Unshare() {
+    if (data->refs.load(memory_order_acquire) == 1) {
+        return;
+    }
+    TableData* copy = new TableData();
+    copy->slots = data->slots;
+    copy->occupied = data->occupied;
+    Release();
+    data = copy;
+}
+
+
+
+//************************************
+// Method:    SetCopyOnWrite.
+// FullName:  SkuTable::SetCopyOnWrite.
+// Access:    public.
+// Returns:   void.
+// Parameter: bool enable.
+//************************************
+void SkuTable::SetCopyOnWrite(bool enable) {
+    copyonwrite = enable;
+}
+
+
+
+//************************************
+// Method:    IsShared.
+// FullName:  SkuTable::IsShared.
+// Access:    public.
+// Returns:   bool.
+// Qualifier: const.
+//************************************
+bool SkuTable::IsShared() const {
+    return data->refs.load(memory_order_acquire) > 1;
+}
+
+
+
+//************************************
+// Method:    SlotOf.
+// FullName:  SkuTable::SlotOf.
+// Access:    private.
+// Returns:   int (the slot index, or -1).
+// Desc:      Maps a SKU number to its slot. Negative SKU
+//            numbers are not forced into the 5 digit range
+//            by StockItem::NormalizeSKU, and have no slot.
+// Parameter: int skuid (the SKU number).
+//************************************
+int SkuTable::SlotOf(int skuid) {
+    int sku = StockItem::NormalizeSKU(skuid);
+    if (sku < SKU_MIN || sku > SKU_MAX) {
+        return -1;
+    }
+    return sku - SKU_MIN;
+}
+
+
+
+//************************************
+// Method:    HasSlot.
+// FullName:  SkuTable::HasSlot.
+// Access:    public.
+// Returns:   bool.
+// Desc:      Takes the SKU an item holds, which is already
+//            normalised, as Insert does.
+// Parameter: int sku (the item's SKU).
+//************************************
+bool SkuTable::HasSlot(int sku) {
+    return sku >= SKU_MIN && sku <= SKU_MAX;
+}
+
+
+
+//************************************
+// Method:    IsOccupied.
+// FullName:  SkuTable::IsOccupied.
+// Access:    private.
+// Returns:   bool.
+// Desc:      Checks the occupancy bit of a slot.
+// Parameter: int slot (a valid slot index).
+//************************************
+bool SkuTable::IsOccupied(int slot) const {
+    return !data->occupied.empty() && (data->occupied[slot / 64] >> (slot % 64)) & 1;
+}
+
+
+
+//************************************
+// Method:    Insert.
+// FullName:  SkuTable::Insert.
+// Access:    public.
+// Returns:   bool (false if the SKU is taken or has no slot).
+// Desc:      Stores a copy of an item in the slot of its SKU.
+// Parameter: const StockItem& item (the item to store).
+//************************************
+bool SkuTable::Insert(const StockItem& item) {
+    int sku = item.GetSKU(); // Already normalised, and normalising twice is not a no-op below SKU_MIN.
+    if (!HasSlot(sku) || IsOccupied(sku - SKU_MIN)) {
+        return false;
+    }
+    int slot = sku - SKU_MIN;
+    Unshare();
+    if (data->slots.empty()) { // First insertion, allocate the whole table.
+        data->slots.resize(SKU_COUNT);
+        data->occupied.assign((SKU_COUNT + 63) / 64, 0);
+    }
+    data->slots[slot] = item;
+    data->occupied[slot / 64] |= (uint64_t) 1 << (slot % 64);
+    ++size;
+    return true;
+}
+
+
+
+//************************************
+// Method:    Search.
+// FullName:  SkuTable::Search.
+// Access:    public.
+// Returns:   bool.
+// Qualifier: const.
+// Desc:      Returns existence of an item with a certain SKU.
+// Parameter: int skuid (the SKU number).
+//************************************
+bool SkuTable::Search(int skuid) const {
+    int slot = SlotOf(skuid);
+    return slot >= 0 && IsOccupied(slot);
+}
+
+
+
+//************************************
+// Method:    Retrieve.
+// FullName:  SkuTable::Retrieve.
+// Access:    public.
+// Returns:   StockItem* (NULL if no item has this SKU).
+// Desc:      Returns a pointer to the stored item so it
+//            may be accessed or modified in place; a shared
+//            table is copied first.
+// Parameter: int skuid (the SKU number).
+//************************************
+StockItem* SkuTable::Retrieve(int skuid) {
+    int slot = SlotOf(skuid);
+    if (slot < 0 || !IsOccupied(slot)) {
+        return NULL;
+    }
+    Unshare();
+    return &data->slots[slot];
+}
+
+
+
+//************************************
+// Method:    Dump.
+// FullName:  SkuTable::Dump.
+// Access:    public.
+// Returns:   StockItem* (a new array, to be deleted by the caller).
+// Qualifier: const.
+// Desc:      Copies every stored item into a new array.
+//            The bitmap is scanned in slot order, so the
+//            array is sorted by SKU.
+// Parameter: int& arrsize (set to the size of the array).
+//************************************
+StockItem* SkuTable::Dump(int& arrsize) const {
+    int index = 0;
+    arrsize = size;
+    StockItem* contents = new StockItem[size];
+    ForEach([&](const StockItem& item) {
+        contents[index++] = item;
+    });
+    return contents;
+}
+
+
+
+//************************************
+// Method:    Size.
+// FullName:  SkuTable::Size.
+// Access:    public.
+// Returns:   unsigned int.
+// Qualifier: const.
+// Desc:      Returns the number of stored items.
+//************************************
+unsigned int SkuTable::Size() const {
+    return size;
+}
+
+
+
+//************************************
+// Method:    RemoveAll.
+// FullName:  SkuTable::RemoveAll.
+// Access:    public.
+// Returns:   void.
+// Desc:      Deletes every item and releases the table, or
+//            lets go of the shared one.
+//************************************
+void SkuTable::RemoveAll() {
+    Release();
+    data = new TableData();
+    size = 0;
+}
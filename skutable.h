@@ -0,0 +1,180 @@
+// File:        skutable.h
+// Date:        2026-10-17
+// Description: Declaration of a SkuTable class, a direct-indexed store of StockItems
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <bit>
+#include <vector>
+
+#include "stockitem.h"
+
+#define SKU_MIN 10000
+#define SKU_MAX 99999
+#define SKU_COUNT (SKU_MAX - SKU_MIN + 1)
+
+// Stores at most one StockItem per SKU in a flat table of SKU_COUNT slots,
+//   indexed by sku - SKU_MIN, plus a bitmap of the occupied slots.
+// Finding an item is a single array access instead of a tree descent,
+//   and scanning the bitmap visits the items in SKU order.
+class SkuTable {
+private:
+    // The slots and bitmap, shared by copy-on-write copies (see
+    //   SetCopyOnWrite). refs counts the tables sharing them; it is atomic so
+    //   copies may be released from different threads.
+    struct TableData {
+        vector<StockItem> slots; // allocated on the first insertion
+        vector<uint64_t> occupied; // bit (i % 64) of word (i / 64) is set if slot i holds an item
+        atomic<unsigned int> refs;
+
+        TableData() : refs(1) {
+        }
+    };
+
+    TableData* data; // never NULL
+    unsigned int size;
+    bool copyonwrite; // copies share the slots instead of copying them
+
+    // returns the slot index of a SKU number, or -1 if it can never be stored
+    static int SlotOf(int skuid);
+
+    bool IsOccupied(int slot) const;
+
+    // drops this table's reference to its data, deleting it if it was the last
+    void Release();
+
+    // gives this table data of its own before it is changed
+    void Unshare();
+
+public:
+    // default constructor, the table is empty and takes no memory
+    SkuTable();
+
+    // copy constructor, copies the table (O(SKU_COUNT) once allocated), or
+    //   shares it with copy-on-write on
+    SkuTable(const SkuTable& table);
+
+    ~SkuTable();
+
+    SkuTable& operator=(const SkuTable& table);
+
+    // Copy-on-write mode, off by default, as RedBlackTree::SetCopyOnWrite:
+    //   copies share the slots until one of them is changed, which then
+    //   copies them. Retrieve counts as a change.
+    void SetCopyOnWrite(bool enable);
+
+    // true if the slots of this table are currently shared with a copy
+    bool IsShared() const;
+
+    // Stores a copy of item in its slot.
+    // Return false if an item with the same SKU is already stored,
+    //   or if the item's SKU is outside [SKU_MIN, SKU_MAX].
+    bool Insert(const StockItem& item);
+
+    // true if the table has a slot for an item whose (normalised) SKU is sku,
+    //   i.e. Insert may store it
+    static bool HasSlot(int sku);
+
+    // Returns existence of an item with SKU skuid (normalised like StockItem does).
+    bool Search(int skuid) const;
+
+    // Returns a pointer to the stored item with SKU skuid, or NULL if there is none.
+    // Do not modify the item's SKU.
+    StockItem* Retrieve(int skuid);
+
+    // Copies every stored item, in SKU order, into a new array.
+    // arrsize is the size of the returned array (equal to Size()).
+    StockItem* Dump(int& arrsize) const;
+
+    // Calls visit(item) for every stored item, in SKU order.
+    template <class F>
+    void ForEach(F visit) const;
+
+    // Calls visit(item) for every stored item with lo <= SKU <= hi, in SKU order.
+    // Only the bitmap words covering the range are scanned.
+    template <class F>
+    void ForEachInRange(int lo, int hi, F visit) const;
+
+    // Calls visit(item) for at most count items, starting with the offset-th
+    //   smallest SKU (0 based). Whole bitmap words before the page are skipped
+    //   by counting their bits.
+    template <class F>
+    void ForEachInPage(unsigned int offset, unsigned int count, F visit) const;
+
+    // returns the number of stored items
+    unsigned int Size() const;
+
+    // deletes every item and releases the table
+    void RemoveAll();
+};
+
+template <class F>
+void SkuTable::ForEach(F visit) const {
+    const vector<uint64_t>& occupied = data->occupied;
+    for (size_t word = 0; word < occupied.size(); word++) {
+        uint64_t bits = occupied[word];
+        while (bits != 0) {
+            int slot = (int) (word * 64) + countr_zero(bits); // lowest occupied slot left in this word
+            visit(data->slots[slot]);
+            bits &= bits - 1;
+        }
+    }
+}
+
+template <class F>
+void SkuTable::ForEachInRange(int lo, int hi, F visit) const {
+    if (lo < SKU_MIN) {
+        lo = SKU_MIN;
+    }
+    if (hi > SKU_MAX) {
+        hi = SKU_MAX;
+    }
+    const vector<uint64_t>& occupied = data->occupied;
+    if (occupied.empty() || lo > hi) {
+        return;
+    }
+    int first = lo - SKU_MIN;
+    int last = hi - SKU_MIN;
+    for (int word = first / 64; word <= last / 64; word++) {
+        uint64_t bits = occupied[word];
+        if (word == first / 64) { // Drop the slots below the range...
+            bits &= ~(uint64_t) 0 << (first % 64);
+        }
+        if (word == last / 64 && last % 64 != 63) { // ...and above it.
+            bits &= ((uint64_t) 1 << (last % 64 + 1)) - 1;
+        }
+        while (bits != 0) {
+            visit(data->slots[word * 64 + countr_zero(bits)]);
+            bits &= bits - 1;
+        }
+    }
+}
+
+template <class F>
+void SkuTable::ForEachInPage(unsigned int offset, unsigned int count, F visit) const {
+    if (offset >= size || count == 0) {
+        return;
+    }
+    const vector<uint64_t>& occupied = data->occupied;
+    size_t word = 0;
+    while ((unsigned int) popcount(occupied[word]) <= offset) { // The page starts after this word.
+        offset -= popcount(occupied[word]);
+        word++;
+    }
+    for (; word < occupied.size(); word++) {
+        uint64_t bits = occupied[word];
+        while (bits != 0) {
+            if (offset > 0) {
+                --offset;
+            } else {
+                visit(data->slots[word * 64 + countr_zero(bits)]);
+                if (--count == 0) {
+                    return;
+                }
+            }
+            bits &= bits - 1;
+        }
+    }
+}
@@ -0,0 +1,304 @@
+// File:        stockcolumns.cpp
+// Date:        2026-10-17
+// Description: Implementation of a StockColumns class
+
+#include <atomic>
+
+#include "stockcolumns.h"
+
+//************************************
+// Method:    StockColumns.
+// FullName:  StockColumns::StockColumns.
+// Access:    public.
+// Qualifier: : data(new ColumnData()), copyonwrite(false).
+// Desc:      Default constructor, no rows.
+//************************************
+StockColumns::StockColumns() : data(new ColumnData()), copyonwrite(false) {
+}
+
+
+
+//************************************
+// Method:    StockColumns.
+// FullName:  StockColumns::StockColumns.
+// Access:    public.
+// Qualifier: : data(NULL), copyonwrite(columns.copyonwrite).
+// Desc:      Copy constructor.
+// Parameter: const StockColumns& columns (the columns to copy).
+//************************************
+StockColumns::StockColumns(const StockColumns& columns) : data(NULL), copyonwrite(columns.copyonwrite) {
+    if (copyonwrite) {
+        data = columns.data;
+        data->refs.fetch_add(1, memory_order_relaxed);
+    } else {
+        data = new ColumnData();
+        data->skus = columns.data->skus;
+        data->prices = columns.data->prices;
+        data->stocks = columns.data->stocks;
+        data->rowof = columns.data->rowof;
+    }
+}
+
+
+
+//************************************
+// Method:    ~StockColumns.
+// FullName:  StockColumns::~StockColumns.
+// Access:    public.
+//************************************
+StockColumns::~StockColumns() {
+    Release();
+}
+
+
+
+//************************************
+// Method:    operator=.
+// FullName:  StockColumns::operator=.
+// Access:    public.
+// Returns:   StockColumns&.
+// Desc:      Copies like the copy constructor, after checking
+//            for self assignment.
+// Parameter: const StockColumns& columns.
+//************************************
+StockColumns& StockColumns::operator=(const StockColumns& columns) {
+    if (this != &columns) {
+        StockColumns copy(columns);
+        swap(data, copy.data);
+        copyonwrite = copy.copyonwrite;
+    }
+    return *this;
+}
+
+
+
+//************************************
+// Method:    Release.
+// FullName:  StockColumns::Release.
+// Access:    private.
+// Returns:   void.
+// Desc:      The last object holding the data deletes it.
+//            Leaves data NULL, the caller replaces it.
+//************************************
+void StockColumns::Release() {
+    if (data != NULL && data->refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+        delete data;
+    }
+    data = NULL;
+}
+
+
+
+//************************************
+// Method:    Unshare.
+// FullName:  StockColumns::Unshare.
+// Access:    private.
+// Returns:   void.
+// Desc:      Called first by every function that changes the
+//            arrays. If other objects still hold them, this
+//            one copies them and lets go of the shared ones.
+//************************************
+void StockColumns::Unshare() {
+    if (data->refs.load(memory_order_acquire) == 1) {
+        return;
+    }
+    ColumnData* copy = new ColumnData();
+    copy->skus = data->skus;
+    copy->prices = data->prices;
+    copy->stocks = data->stocks;
+    copy->rowof = data->rowof;
+    Release();
+    data = copy;
+}
+
+
+
+//************************************
+// Method:    SetCopyOnWrite.
+// FullName:  StockColumns::SetCopyOnWrite.
+// Access:    public.
+// Returns:   void.
+// Parameter: bool enable.
+//************************************
+void StockColumns::SetCopyOnWrite(bool enable) {
+    copyonwrite = enable;
+}
+
+
+
+//************************************
+// Method:    IsShared.
+// FullName:  StockColumns::IsShared.
+// Access:    public.
+// Returns:   bool.
+// Qualifier: const.
+//************************************
+bool StockColumns::IsShared() const {
+    return data->refs.load(memory_order_acquire) > 1;
+}
+
+
+
+//************************************
+// Method:    RowOf.
+// FullName:  StockColumns::RowOf.
+// Access:    private.
+// Returns:   int (-1 if the SKU has no row).
+// Desc:      Finds the row of a SKU through the index. The
+//            few SKUs outside the 5 digit range (negative SKU
+//            numbers) are searched for in the SKU column.
+// Parameter: int sku (a normalised SKU).
+//************************************
+int StockColumns::RowOf(int sku) const {
+    const vector<int>& rowof = data->rowof;
+    const vector<int>& skus = data->skus;
+    if (rowof.empty()) {
+        return -1;
+    }
+    if (sku >= SKU_MIN && sku <= SKU_MAX) {
+        return rowof[sku - SKU_MIN];
+    }
+    for (size_t row = 0; row < skus.size(); row++) {
+        if (skus[row] == sku) {
+            return (int) row;
+        }
+    }
+    return -1;
+}
+
+
+
+//************************************
+// Method:    Append.
+// FullName:  StockColumns::Append.
+// Access:    public.
+// Returns:   void.
+// Desc:      Adds a row for an item that was just added
+//            to the catalogue.
+// Parameter: const StockItem& item.
+//************************************
+void StockColumns::Append(const StockItem& item) {
+    Unshare();
+    if (data->rowof.empty()) {
+        data->rowof.assign(SKU_COUNT, -1);
+    }
+    int sku = item.GetSKU();
+    if (sku >= SKU_MIN && sku <= SKU_MAX) {
+        data->rowof[sku - SKU_MIN] = (int) data->skus.size();
+    }
+    data->skus.push_back(sku);
+    data->prices.push_back(item.GetPrice());
+    data->stocks.push_back(item.GetStock());
+}
+
+
+
+//************************************
+// Method:    SetPrice.
+// FullName:  StockColumns::SetPrice.
+// Access:    public.
+// Returns:   void.
+// Desc:      The store is atomic (and costs the same as a
+//            plain store), so StockSystem's concurrent mode
+//            may update different rows from several threads.
+// Parameter: int sku (the item's SKU).
+// Parameter: double price (the item's new price).
+//************************************
+void StockColumns::SetPrice(int sku, double price) {
+    int row = RowOf(sku);
+    if (row >= 0) {
+        Unshare();
+        atomic_ref<double>(data->prices[row]).store(price, memory_order_relaxed);
+    }
+}
+
+
+
+//************************************
+// Method:    SetStock.
+// FullName:  StockColumns::SetStock.
+// Access:    public.
+// Returns:   void.
+// Desc:      Atomic store, see SetPrice.
+// Parameter: int sku (the item's SKU).
+// Parameter: int stock (the item's new stock).
+//************************************
+void StockColumns::SetStock(int sku, int stock) {
+    int row = RowOf(sku);
+    if (row >= 0) {
+        Unshare();
+        atomic_ref<int>(data->stocks[row]).store(stock, memory_order_relaxed);
+    }
+}
+
+
+
+//************************************
+// Method:    AddStock.
+// FullName:  StockColumns::AddStock.
+// Access:    public.
+// Returns:   void.
+// Desc:      Atomically adds to a row's stock, for updates
+//            that may race on the same row.
+// Parameter: int sku (the item's SKU).
+// Parameter: int delta (units added, negative when removed).
+//************************************
+void StockColumns::AddStock(int sku, int delta) {
+    int row = RowOf(sku);
+    if (row >= 0) {
+        Unshare();
+        atomic_ref<int>(data->stocks[row]).fetch_add(delta, memory_order_relaxed);
+    }
+}
+
+
+
+//************************************
+// Method:    Size.
+// FullName:  StockColumns::Size.
+// Access:    public.
+// Returns:   unsigned int.
+//************************************
+unsigned int StockColumns::Size() const {
+    return data->skus.size();
+}
+
+
+
+//************************************
+// Method:    SKUs, Prices, Stocks.
+// FullName:  StockColumns::SKUs, StockColumns::Prices, StockColumns::Stocks.
+// Access:    public.
+// Desc:      Return the columns as plain arrays.
+//************************************
+const int* StockColumns::SKUs() const {
+    return data->skus.data();
+}
+
+const double* StockColumns::Prices() const {
+    return data->prices.data();
+}
+
+const int* StockColumns::Stocks() const {
+    return data->stocks.data();
+}
+
+
+
+//************************************
+// Method:    RemoveAll.
+// FullName:  StockColumns::RemoveAll.
+// Access:    public.
+// Returns:   void.
+//************************************
+void StockColumns::RemoveAll() {
+    if (IsShared()) {
+        Release();
+        data = new ColumnData();
+        return;
+    }
+    data->skus.clear();
+    data->prices.clear();
+    data->stocks.clear();
+    data->rowof.clear();
+}
@@ -0,0 +1,83 @@
+// File:        stockcolumns.h
+// Date:        2026-10-17
+// Description: Declaration of a StockColumns class, a columnar mirror of the catalogue
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "stockitem.h"
+#include "skutable.h"
+
+// Keeps the SKU, price and stock of every catalogue item in three contiguous
+//   arrays (one row per item, in insertion order), so store-wide figures can
+//   be computed by streaming through plain arrays (see inventorykernels.h).
+// StockSystem's mutators keep it in sync with the catalogue.
+class StockColumns {
+private:
+    // The arrays, shared by copy-on-write copies as SkuTable's slots.
+    struct ColumnData {
+        vector<int> skus;
+        vector<double> prices;
+        vector<int> stocks;
+        vector<int> rowof; // row of each SKU, indexed by sku - SKU_MIN, -1 if absent
+        atomic<unsigned int> refs;
+
+        ColumnData() : refs(1) {
+        }
+    };
+
+    ColumnData* data; // never NULL
+    bool copyonwrite;
+
+    // returns the row of a stored SKU, or -1
+    int RowOf(int sku) const;
+
+    // drops this object's reference to its data, deleting it if it was the last
+    void Release();
+
+    // gives this object arrays of its own before they are changed
+    void Unshare();
+
+public:
+    StockColumns();
+
+    // copies the arrays, or shares them with copy-on-write on
+    StockColumns(const StockColumns& columns);
+
+    ~StockColumns();
+
+    StockColumns& operator=(const StockColumns& columns);
+
+    // Copy-on-write mode, off by default: copies share the arrays until one
+    //   of them is changed. Not for CONCURRENT_SALES, whose updates of
+    //   different rows would race on the first copy.
+    void SetCopyOnWrite(bool enable);
+
+    // true if the arrays are currently shared with a copy
+    bool IsShared() const;
+
+    // adds a row for a new item
+    void Append(const StockItem& item);
+
+    // copy an item's new price or stock into its row
+    // Updates of a row are atomic, so they may come from several threads
+    //   (with copy-on-write off).
+    void SetPrice(int sku, double price);
+    void SetStock(int sku, int stock);
+
+    // adds delta units to an item's row
+    void AddStock(int sku, int delta);
+
+    // returns the number of rows
+    unsigned int Size() const;
+
+    // Column accessors, each array holds Size() elements.
+    const int* SKUs() const;
+    const double* Prices() const;
+    const int* Stocks() const;
+
+    // deletes every row
+    void RemoveAll();
+};
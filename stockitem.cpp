@@ -2,13 +2,16 @@
 // Date:        2016-02-27
 // Description: Implementation of a StockItem class
 
+#include <atomic>
+#include <string.h>
+
 #include "stockitem.h"
 
 // Default constructor
 
 StockItem::StockItem() {
     sku = 0;
-    description = "";
+    StoreDescription("");
     price = 0;
     stock = 0;
 }
@@ -18,27 +21,41 @@ StockItem::StockItem() {
 // Stock is defaulted to 0;
 // Assume parameters are valid
 
-StockItem::StockItem(int skuid, string desc, double p) {
-    sku = skuid;
-    if (sku > 99999) sku = sku % 100000;
-    if (sku < 10000) sku += 10000; // force sku to 5 digits
-
-    if (desc.length() > 30)
-        description = desc.substr(0, 29);
-    else
-        description = desc;
+StockItem::StockItem(int skuid, string_view desc, double p) {
+    sku = NormalizeSKU(skuid);
+    StoreDescription(desc);
     price = p;
     stock = 0;
 }
 
+// Copies a description into the inline buffer.
+// Descriptions longer than 30 characters are cut to 29.
+// The rest of the buffer is cleared so equal items have equal bytes.
+
+void StockItem::StoreDescription(string_view newdesc) {
+    if (newdesc.length() > DESC_MAX_LENGTH)
+        newdesc = newdesc.substr(0, DESC_MAX_LENGTH - 1);
+    desclength = (unsigned char) newdesc.length();
+    memcpy(description, newdesc.data(), desclength);
+    memset(description + desclength, 0, sizeof(description) - desclength);
+}
+
+// Forces a SKU to 5 digits
+
+int StockItem::NormalizeSKU(int skuid) {
+    if (skuid > 99999) skuid = skuid % 100000;
+    if (skuid < 10000) skuid += 10000; // force sku to 5 digits
+    return skuid;
+}
+
 // Accessors
 
 int StockItem::GetSKU() const {
     return sku;
 }
 
-string StockItem::GetDescription() const {
-    return description;
+string_view StockItem::GetDescription() const {
+    return string_view(description, desclength);
 }
 
 double StockItem::GetPrice() const {
@@ -52,11 +69,8 @@ int StockItem::GetStock() const {
 // Mutators
 // boolean return values - return true for successful update, false if argument is invalid (i.e. negative price/stock/SKU)
 
-bool StockItem::SetDescription(string newdesc) {
-    if (newdesc.length() > 30)
-        description = newdesc.substr(0, 29);
-    else
-        description = newdesc;
+bool StockItem::SetDescription(string_view newdesc) {
+    StoreDescription(newdesc);
     return true;
 }
 
@@ -74,6 +88,42 @@ bool StockItem::SetStock(int amount) {
     } else return false;
 }
 
+// Thread-safe stock and price access
+// The fields are plain members (so items stay copyable); atomic_ref makes
+//   each access below atomic.
+
+int StockItem::LoadStock() const {
+    return atomic_ref<int>(const_cast<int&>(stock)).load(memory_order_relaxed);
+}
+
+double StockItem::LoadPrice() const {
+    return atomic_ref<double>(const_cast<double&>(price)).load(memory_order_relaxed);
+}
+
+bool StockItem::StorePrice(double newprice) {
+    if (newprice >= 0) {
+        atomic_ref<double>(price).store(newprice, memory_order_relaxed);
+        return true;
+    } else return false;
+}
+
+unsigned int StockItem::TakeStock(unsigned int quantity) {
+    atomic_ref<int> counter(stock);
+    int current = counter.load(memory_order_relaxed);
+    unsigned int taken;
+    do {
+        taken = quantity < (unsigned int) current ? quantity : current; // sell what is available
+    } while (taken > 0 && !counter.compare_exchange_weak(current, current - taken, memory_order_relaxed));
+    return taken;
+}
+
+bool StockItem::CompareExchangeStock(int expected, int amount) {
+    if (amount < 0) {
+        return false;
+    }
+    return atomic_ref<int>(stock).compare_exchange_strong(expected, amount, memory_order_relaxed);
+}
+
 bool StockItem::operator==(const StockItem& item) const {
     return (sku == item.GetSKU());
 }
@@ -97,13 +147,3 @@ bool StockItem::operator>=(const StockItem& item) const {
 bool StockItem::operator<=(const StockItem& item) const {
     return !(*this > item);
 }
-
-StockItem& StockItem::operator=(const StockItem& item) {
-    if (this != &item) {
-        this->sku = item.sku;
-        this->description = item.description;
-        this->price = item.price;
-        this->stock = item.stock;
-    }
-    return *this;
-}
\ No newline at end of file
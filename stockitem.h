@@ -7,15 +7,23 @@
 #define DESC_MAX_LENGTH 30
 
 #include <string>
+#include <string_view>
+#include <type_traits>
 
 using namespace std;
 
+// The description is stored inline, so a StockItem owns no heap memory, is
+//   trivially copyable (copies are a memcpy) and always 48 bytes.
 class StockItem {
 private:
     int sku; // unique identifier for stock keeping unit, range [10000, 99999] (5 digits)
-    string description; // product name, maximum length of 
-    double price; // retail price of product
     int stock; // number of units in stock
+    double price; // retail price of product
+    unsigned char desclength; // number of characters used in description
+    char description[DESC_MAX_LENGTH + 1]; // product name, maximum length of DESC_MAX_LENGTH, NUL terminated, unused bytes are 0
+
+    // stores newdesc, truncated the way the constructor and SetDescription always did
+    void StoreDescription(string_view newdesc);
 
 public:
     // Default constructor
@@ -24,21 +32,41 @@ public:
     // Parameterized constructor
     // Need to specify SKU, description, and price.
     // Stock is defaulted to 0;
-    StockItem(int skuid, string desc, double p);
+    StockItem(int skuid, string_view desc, double p);
+
+    // Returns skuid forced into the 5 digit SKU range, the same way the
+    //   parameterized constructor does
+    static int NormalizeSKU(int skuid);
 
     // Accessors
     int GetSKU() const;
-    string GetDescription() const;
+    // the view points into the item and is valid until the item changes
+    string_view GetDescription() const;
     double GetPrice() const;
     int GetStock() const;
 
     // Mutators
     // boolean return values - return true for successful update, false if argument is invalid (i.e. negative price/stock/SKU)
     // sku cannot be modified
-    bool SetDescription(string newdesc);
+    bool SetDescription(string_view newdesc);
     bool SetPrice(double newprice);
     bool SetStock(int amount);
 
+    // Thread-safe stock and price access, used by StockSystem's concurrent mode.
+    // Each one is a single atomic operation on the field, so these may run
+    //   from several threads at once, but not alongside the plain mutators above.
+    int LoadStock() const;
+    double LoadPrice() const;
+    bool StorePrice(double newprice);
+
+    // Removes up to quantity units in one compare-and-swap loop (a partial fill
+    //   takes whatever is left), and returns the number of units removed.
+    unsigned int TakeStock(unsigned int quantity);
+
+    // Sets the stock to amount only if it is still expected.
+    // Return false if another thread changed the stock first, or amount is negative.
+    bool CompareExchangeStock(int expected, int amount);
+
     // overloaded operators
     // return (in)equality on sku field only
     bool operator==(const StockItem& item) const;
@@ -47,6 +75,18 @@ public:
     bool operator<(const StockItem& item) const;
     bool operator>=(const StockItem& item) const;
     bool operator<=(const StockItem& item) const;
+};
+
+static_assert(is_trivially_copyable<StockItem>::value, "StockItem must stay trivially copyable");
+
+// Key policy for RedBlackTree<StockItem>: items are ordered by SKU, and a bare
+//   SKU number can be used to search, retrieve or remove an item.
+struct SkuKeyOf {
+    static int Key(const StockItem& item) {
+        return item.GetSKU();
+    }
 
-    StockItem& operator=(const StockItem& item);
-};
\ No newline at end of file
+    static int Key(int skuid) {
+        return StockItem::NormalizeSKU(skuid);
+    }
+};
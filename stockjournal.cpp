@@ -0,0 +1,545 @@
+// File:        stockjournal.cpp
+// Date:        2026-10-17
+// Description: Implementation of the StockJournal and JournalReader classes
+
+#include <errno.h>
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <random>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stockjournal.h"
+
+// longest record: opcode, a StockItem image and the checksum
+#define JOURNAL_RECORD_MAX (1 + sizeof(StockItem) + 4)
+
+// FNV-1a over the opcode and payload of a record
+
+static uint32_t RecordChecksum(const char* record, size_t length) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        h ^= (unsigned char) record[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// A new, nonzero generation number. Random rather than counted, so a journal
+//   file created afresh never takes the generation of an older one.
+
+static uint64_t NewGeneration() {
+    random_device device;
+    uint64_t generation = ((uint64_t) device() << 32 | device()) ^ chrono::system_clock::now().time_since_epoch().count();
+    return generation != 0 ? generation : 1;
+}
+
+// payload length of a record with a fixed payload, 0 for an unknown opcode
+
+static size_t FixedPayload(unsigned char code) {
+    switch (code) {
+        case JOURNAL_NEW_ITEM:
+            return sizeof(StockItem);
+        case JOURNAL_EDIT_PRICE:
+            return 4 + 8;
+        case JOURNAL_RESTOCK:
+            return 4 + 4 + 8;
+        case JOURNAL_SELL:
+            return 4 + 4;
+        default:
+            return 0;
+    }
+}
+
+
+
+//************************************
+// Method:    StockJournal.
+// FullName:  StockJournal::StockJournal.
+// Access:    public.
+// Desc:      Default constructor, the journal is closed.
+//************************************
+StockJournal::StockJournal() : fd(-1), used(0), pending(0), failed(false), generation(0), filebytes(0) {
+}
+
+
+
+//************************************
+// Method:    StockJournal.
+// FullName:  StockJournal::StockJournal.
+// Access:    public.
+// Desc:      Copy constructor. Two journals must not append
+//            to the same file, so the copy starts closed.
+// Parameter: const StockJournal& journal (ignored).
+//************************************
+StockJournal::StockJournal(const StockJournal&) : fd(-1), used(0), pending(0), failed(false), generation(0), filebytes(0) {
+}
+
+
+
+//************************************
+// Method:    operator=.
+// FullName:  StockJournal::operator=.
+// Access:    public.
+// Returns:   StockJournal&.
+// Desc:      Closes this journal, see the copy constructor.
+// Parameter: const StockJournal& journal (ignored).
+//************************************
+StockJournal& StockJournal::operator=(const StockJournal& journal) {
+    if (this != &journal) {
+        Close();
+    }
+    return *this;
+}
+
+
+
+//************************************
+// Method:    ~StockJournal.
+// FullName:  StockJournal::~StockJournal.
+// Access:    public.
+//************************************
+StockJournal::~StockJournal() {
+    Close();
+}
+
+
+
+//************************************
+// Method:    Open.
+// FullName:  StockJournal::Open.
+// Access:    public.
+// Returns:   bool (false if the file cannot be opened, or
+//            does not start with a journal header).
+// Desc:      Opens a journal for appending; records already
+//            in the file are kept, with its generation. A file
+//            too short to hold a header (new, or torn while it
+//            was being started) is started afresh.
+// Parameter: const string& path (the journal file).
+// Parameter: const JournalPolicy& syncpolicy (when to sync).
+//************************************
+bool StockJournal::Open(const string& path, const JournalPolicy& syncpolicy) {
+    Close();
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    policy = syncpolicy;
+    failed = false;
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    char header[JOURNAL_HEADER_SIZE];
+    bool opened = fstat(fd, &info) == 0;
+    if (opened && info.st_size < JOURNAL_HEADER_SIZE) {
+        opened = ftruncate(fd, 0) == 0 && StartFile();
+    } else if (opened) {
+        opened = pread(fd, header, JOURNAL_HEADER_SIZE, 0) == JOURNAL_HEADER_SIZE && memcmp(header, JOURNAL_MAGIC, 8) == 0;
+        memcpy(&generation, header + 8, 8);
+        filebytes = info.st_size;
+    }
+    if (!opened) {
+        close(fd);
+        fd = -1;
+    }
+    return opened;
+}
+
+
+
+//************************************
+// Method:    StartFile.
+// FullName:  StockJournal::StartFile.
+// Access:    private.
+// Returns:   bool (false if the header could not be written).
+//************************************
+bool StockJournal::StartFile() {
+    char header[JOURNAL_HEADER_SIZE];
+    generation = NewGeneration();
+    memcpy(header, JOURNAL_MAGIC, 8);
+    memcpy(header + 8, &generation, 8);
+    filebytes = JOURNAL_HEADER_SIZE;
+    return write(fd, header, JOURNAL_HEADER_SIZE) == JOURNAL_HEADER_SIZE && fdatasync(fd) == 0;
+}
+
+
+
+//************************************
+// Method:    Close.
+// FullName:  StockJournal::Close.
+// Access:    public.
+// Returns:   bool (false if the final commit failed).
+//************************************
+bool StockJournal::Close() {
+    if (fd < 0) {
+        return true;
+    }
+    bool committed = Commit();
+    close(fd);
+    fd = -1;
+    return committed;
+}
+
+
+
+//************************************
+// Method:    IsOpen.
+// FullName:  StockJournal::IsOpen.
+// Access:    public.
+// Returns:   bool.
+//************************************
+bool StockJournal::IsOpen() const {
+    return fd >= 0;
+}
+
+
+
+//************************************
+// Method:    Append.
+// FullName:  StockJournal::Append.
+// Access:    private.
+// Returns:   void.
+// Desc:      Encodes a record into the buffer, then commits
+//            if the policy's count or age limit is reached.
+// Parameter: JournalOpCode code.
+// Parameter: const char* payload.
+// Parameter: size_t length (of the payload).
+//************************************
+void StockJournal::Append(JournalOpCode code, const char* payload, size_t length) {
+    if (used + JOURNAL_RECORD_MAX > JOURNAL_BUFFER_SIZE) {
+        WriteBuffer();
+    }
+    char* record = buffer + used;
+    record[0] = (char) code;
+    memcpy(record + 1, payload, length);
+    uint32_t checksum = RecordChecksum(record, 1 + length);
+    memcpy(record + 1 + length, &checksum, 4);
+    used += 1 + length + 4;
+
+    if (pending++ == 0 && policy.syncmicroseconds > 0) {
+        oldest = chrono::steady_clock::now();
+    }
+    if (policy.syncevery > 0 && pending >= policy.syncevery) {
+        Commit();
+    } else if (policy.syncmicroseconds > 0
+            && chrono::steady_clock::now() - oldest >= chrono::microseconds(policy.syncmicroseconds)) {
+        Commit();
+    }
+}
+
+
+
+//************************************
+// Method:    LogNewItem, LogDescription, LogPrice, LogRestock, LogSell.
+// FullName:  StockJournal::LogNewItem, ...
+// Access:    public.
+// Returns:   void.
+// Desc:      Encode the arguments of one successful call.
+//            A new item is stored as its exact bytes, so it
+//            is replayed without normalising its SKU again.
+//************************************
+void StockJournal::LogNewItem(const StockItem& item) {
+    if (fd >= 0) {
+        Append(JOURNAL_NEW_ITEM, reinterpret_cast<const char*>(&item), sizeof(StockItem));
+    }
+}
+
+void StockJournal::LogDescription(unsigned int itemsku, string_view description) {
+    if (fd >= 0) {
+        char payload[4 + 1 + DESC_MAX_LENGTH];
+        unsigned char length = (unsigned char) min(description.length(), (size_t) DESC_MAX_LENGTH);
+        memcpy(payload, &itemsku, 4);
+        payload[4] = (char) length;
+        memcpy(payload + 5, description.data(), length);
+        Append(JOURNAL_EDIT_DESCRIPTION, payload, 5 + length);
+    }
+}
+
+void StockJournal::LogPrice(unsigned int itemsku, double price) {
+    if (fd >= 0) {
+        char payload[4 + 8];
+        memcpy(payload, &itemsku, 4);
+        memcpy(payload + 4, &price, 8);
+        Append(JOURNAL_EDIT_PRICE, payload, sizeof(payload));
+    }
+}
+
+void StockJournal::LogRestock(unsigned int itemsku, unsigned int quantity, double unitprice) {
+    if (fd >= 0) {
+        char payload[4 + 4 + 8];
+        memcpy(payload, &itemsku, 4);
+        memcpy(payload + 4, &quantity, 4);
+        memcpy(payload + 8, &unitprice, 8);
+        Append(JOURNAL_RESTOCK, payload, sizeof(payload));
+    }
+}
+
+void StockJournal::LogSell(unsigned int itemsku, unsigned int quantity) {
+    if (fd >= 0) {
+        char payload[4 + 4];
+        memcpy(payload, &itemsku, 4);
+        memcpy(payload + 4, &quantity, 4);
+        Append(JOURNAL_SELL, payload, sizeof(payload));
+    }
+}
+
+
+
+//************************************
+// Method:    WriteBuffer.
+// FullName:  StockJournal::WriteBuffer.
+// Access:    private.
+// Returns:   bool (false if the journal has failed).
+// Desc:      Writes the buffered records, retrying partial
+//            and interrupted writes.
+//************************************
+bool StockJournal::WriteBuffer() {
+    size_t written = 0;
+    while (written < used && !failed) {
+        ssize_t n = write(fd, buffer + written, used - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            failed = true;
+        } else {
+            written += n;
+            filebytes += n;
+        }
+    }
+    used = 0;
+    return !failed;
+}
+
+
+
+//************************************
+// Method:    Commit.
+// FullName:  StockJournal::Commit.
+// Access:    public.
+// Returns:   bool (false if the journal has failed).
+// Desc:      Group commit: one write and one fdatasync for
+//            every record appended since the last commit.
+//************************************
+bool StockJournal::Commit() {
+    if (fd < 0) {
+        return false;
+    }
+    if (pending > 0) {
+        if (WriteBuffer() && fdatasync(fd) != 0) {
+            failed = true;
+        }
+        pending = 0;
+    }
+    return !failed;
+}
+
+
+
+//************************************
+// Method:    Truncate.
+// FullName:  StockJournal::Truncate.
+// Access:    public.
+// Returns:   bool (false if the journal is closed or failed).
+// Desc:      Drops every record, pending ones included, and
+//            starts the file again with a new generation. A
+//            crash in between leaves an empty or headerless
+//            file, which holds no records either.
+//************************************
+bool StockJournal::Truncate() {
+    if (fd < 0) {
+        return false;
+    }
+    used = 0;
+    pending = 0;
+    if (ftruncate(fd, 0) != 0 || !StartFile()) {
+        failed = true;
+    }
+    return !failed;
+}
+
+
+
+//************************************
+// Method:    Generation.
+// FullName:  StockJournal::Generation.
+// Access:    public.
+// Returns:   uint64_t (0 if the journal is closed).
+// Qualifier: const.
+//************************************
+uint64_t StockJournal::Generation() const {
+    return fd >= 0 ? generation : 0;
+}
+
+
+
+//************************************
+// Method:    Length.
+// FullName:  StockJournal::Length.
+// Access:    public.
+// Returns:   uint64_t (0 if the journal is closed).
+// Qualifier: const.
+// Desc:      The buffered records go at the end of the file,
+//            so they are counted as if already written.
+//************************************
+uint64_t StockJournal::Length() const {
+    return fd >= 0 ? filebytes + used : 0;
+}
+
+
+
+//************************************
+// Method:    JournalReader.
+// FullName:  JournalReader::JournalReader.
+// Access:    public.
+//************************************
+JournalReader::JournalReader() : map(NULL), mapsize(0), pos(0), generation(0) {
+}
+
+
+
+//************************************
+// Method:    ~JournalReader.
+// FullName:  JournalReader::~JournalReader.
+// Access:    public.
+//************************************
+JournalReader::~JournalReader() {
+    if (map != NULL) {
+        munmap(map, mapsize);
+    }
+}
+
+
+
+//************************************
+// Method:    Open.
+// FullName:  JournalReader::Open.
+// Access:    public.
+// Returns:   bool (false if the file exists but cannot be
+//            read, or has a header that is not a journal's).
+// Desc:      The records start after the header. A file too
+//            short for a header has no records, and
+//            ValidBytes stays 0.
+// Parameter: const string& path (the journal file).
+//************************************
+bool JournalReader::Open(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return errno == ENOENT; // No journal yet, nothing to replay.
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return false;
+    }
+    pos = 0;
+    generation = 0;
+    if (info.st_size < JOURNAL_HEADER_SIZE) {
+        close(fd);
+        return true;
+    }
+    mapsize = info.st_size;
+    map = mmap(NULL, mapsize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        map = NULL;
+        mapsize = 0;
+        return false;
+    }
+    madvise(map, mapsize, MADV_SEQUENTIAL);
+    if (memcmp(map, JOURNAL_MAGIC, 8) != 0) {
+        munmap(map, mapsize);
+        map = NULL;
+        mapsize = 0;
+        return false;
+    }
+    memcpy(&generation, static_cast<const char*>(map) + 8, 8);
+    pos = JOURNAL_HEADER_SIZE;
+    return true;
+}
+
+
+
+//************************************
+// Method:    Next.
+// FullName:  JournalReader::Next.
+// Access:    public.
+// Returns:   bool (false at the end, or at a bad record).
+// Desc:      Checks that the whole record is present and
+//            that its checksum matches before decoding it.
+// Parameter: JournalEntry& entry (receives the record).
+//************************************
+bool JournalReader::Next(JournalEntry& entry) {
+    const char* data = static_cast<const char*>(map);
+    if (map == NULL || pos >= mapsize) {
+        return false;
+    }
+    const char* record = data + pos;
+    size_t left = mapsize - pos;
+    unsigned char code = (unsigned char) record[0];
+    size_t length = FixedPayload(code);
+    if (code == JOURNAL_EDIT_DESCRIPTION) {
+        if (left < 1 + 5) {
+            return false;
+        }
+        length = 5 + (unsigned char) record[5];
+        if ((unsigned char) record[5] > DESC_MAX_LENGTH) {
+            return false;
+        }
+    }
+    if (length == 0 || left < 1 + length + 4) {
+        return false;
+    }
+    uint32_t checksum;
+    memcpy(&checksum, record + 1 + length, 4);
+    if (checksum != RecordChecksum(record, 1 + length)) {
+        return false;
+    }
+
+    const char* payload = record + 1;
+    entry.code = (JournalOpCode) code;
+    if (code == JOURNAL_NEW_ITEM) {
+        memcpy((void*) &entry.item, payload, sizeof(StockItem));
+        entry.itemsku = entry.item.GetSKU();
+    } else {
+        memcpy(&entry.itemsku, payload, 4);
+    }
+    if (code == JOURNAL_EDIT_DESCRIPTION) {
+        entry.description = string_view(payload + 5, length - 5);
+    } else if (code == JOURNAL_EDIT_PRICE) {
+        memcpy(&entry.price, payload + 4, 8);
+    } else if (code == JOURNAL_RESTOCK || code == JOURNAL_SELL) {
+        memcpy(&entry.quantity, payload + 4, 4);
+        if (code == JOURNAL_RESTOCK) {
+            memcpy(&entry.price, payload + 8, 8);
+        }
+    }
+    pos += 1 + length + 4;
+    return true;
+}
+
+
+
+//************************************
+// Method:    ValidBytes.
+// FullName:  JournalReader::ValidBytes.
+// Access:    public.
+// Returns:   size_t.
+//************************************
+size_t JournalReader::ValidBytes() const {
+    return pos;
+}
+
+
+
+//************************************
+// Method:    Generation.
+// FullName:  JournalReader::Generation.
+// Access:    public.
+// Returns:   uint64_t (0 if the file has no header).
+// Qualifier: const.
+//************************************
+uint64_t JournalReader::Generation() const {
+    return generation;
+}
@@ -0,0 +1,154 @@
+// File:        stockjournal.h
+// Date:        2026-10-17
+// Description: Declaration of the StockJournal and JournalReader classes,
+//              the write-ahead journal of a StockSystem
+
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "stockitem.h"
+
+#define JOURNAL_BUFFER_SIZE 8192
+
+#define JOURNAL_MAGIC "STOCKJNL"
+#define JOURNAL_HEADER_SIZE 16 // the magic, not NUL terminated, and the 64 bit generation
+
+// Record types of the journal
+enum JournalOpCode {
+    JOURNAL_NEW_ITEM = 1, // StockNewItem(item)
+    JOURNAL_EDIT_DESCRIPTION, // EditStockItemDescription(itemsku, description)
+    JOURNAL_EDIT_PRICE, // EditStockItemPrice(itemsku, price)
+    JOURNAL_RESTOCK, // Restock(itemsku, quantity, price)
+    JOURNAL_SELL // Sell(itemsku, quantity)
+};
+
+// One decoded journal record
+struct JournalEntry {
+    JournalOpCode code;
+    unsigned int itemsku; // the SKU argument exactly as passed to the call
+    unsigned int quantity; // RESTOCK and SELL
+    double price; // EDIT_PRICE and RESTOCK
+    string_view description; // EDIT_DESCRIPTION, points into the reader's mapping
+    StockItem item; // NEW_ITEM
+};
+
+// When a StockJournal forces its records to disk.
+// Records are buffered and written with one write and one fdatasync per group,
+//   so a crash loses at most the group being formed.
+struct JournalPolicy {
+    unsigned int syncevery; // sync once this many records wait (1 syncs every record, 0 never syncs on count)
+    unsigned int syncmicroseconds; // or once the oldest waiting record is this old (0 never syncs on time)
+
+    JournalPolicy() : syncevery(64), syncmicroseconds(2000) {
+    }
+};
+
+// Append-only journal of the changes made to a StockSystem.
+// The file starts with a header holding a generation number, drawn at random
+//   whenever the file is started or emptied, so a snapshot can tell which
+//   records of which file it already holds (see StockSystem::Checkpoint).
+// A record is an opcode byte, a fixed payload for that opcode (plus the
+//   description bytes for JOURNAL_EDIT_DESCRIPTION) and a 32 bit checksum of
+//   both, so a torn final record is detected on replay.
+// The time limit of the policy is checked when a record is appended; call
+//   Commit to make everything durable when the journal goes idle.
+class StockJournal {
+private:
+    int fd; // -1 when closed
+    JournalPolicy policy;
+    char buffer[JOURNAL_BUFFER_SIZE];
+    size_t used;
+    unsigned int pending; // records appended since the last sync
+    chrono::steady_clock::time_point oldest; // when the first pending record was appended
+    bool failed; // a write or sync failed, the journal is no longer trusted
+    uint64_t generation; // of the open file
+    uint64_t filebytes; // length of the file, header included
+
+    // writes a header with a new generation to the empty file and syncs it
+    bool StartFile();
+
+    // appends one encoded record and applies the policy
+    void Append(JournalOpCode code, const char* payload, size_t length);
+
+    // hands the buffer to the file, without syncing
+    bool WriteBuffer();
+
+public:
+    StockJournal();
+
+    // a journal is never shared, a copy starts closed
+    StockJournal(const StockJournal& journal);
+    StockJournal& operator=(const StockJournal& journal);
+
+    // commits and closes
+    ~StockJournal();
+
+    // opens (creating if needed) the journal at path for appending
+    // Return false if it cannot be opened, or is not a journal.
+    bool Open(const string& path, const JournalPolicy& syncpolicy);
+
+    // commits what is pending and closes the file
+    // Return false if the final commit failed.
+    bool Close();
+
+    bool IsOpen() const;
+
+    // Record one successful call each.
+    void LogNewItem(const StockItem& item);
+    void LogDescription(unsigned int itemsku, string_view description);
+    void LogPrice(unsigned int itemsku, double price);
+    void LogRestock(unsigned int itemsku, unsigned int quantity, double unitprice);
+    void LogSell(unsigned int itemsku, unsigned int quantity);
+
+    // writes and syncs every pending record
+    // Return false if the journal has failed.
+    bool Commit();
+
+    // empties the journal, e.g. once a snapshot holds all of its changes,
+    //   and gives it a new generation
+    // Return false if the journal is closed or failed.
+    bool Truncate();
+
+    // generation of the open file, 0 if the journal is closed
+    uint64_t Generation() const;
+
+    // length the file will have once the pending records are written, 0 if
+    //   the journal is closed
+    uint64_t Length() const;
+};
+
+// Reads back the records of a journal file, in the order they were appended.
+class JournalReader {
+private:
+    void* map; // mapping of the whole file, or NULL
+    size_t mapsize;
+    size_t pos; // offset of the next record
+    uint64_t generation; // from the header, 0 if the file has none
+
+public:
+    JournalReader();
+
+    // unmaps the file
+    ~JournalReader();
+
+    // maps the file at path
+    // A missing or empty file, or one whose header was torn, is a valid journal
+    //   with no records.
+    // Return false if the file exists but cannot be read, or is not a journal.
+    bool Open(const string& path);
+
+    // decodes the next record into entry
+    // Return false at the end of the journal, or at a torn or corrupt record.
+    bool Next(JournalEntry& entry);
+
+    // length of the journal up to the last record returned by Next
+    size_t ValidBytes() const;
+
+    // generation of the file (see StockJournal), 0 if it has no header
+    uint64_t Generation() const;
+};
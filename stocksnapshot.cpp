@@ -0,0 +1,303 @@
+// File:        stocksnapshot.cpp
+// Date:        2026-10-17
+// Description: Implementation of the SnapshotWriter and SnapshotReader classes
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stocksnapshot.h"
+
+// The records are raw StockItems, so a change to StockItem's layout must
+//   come with a new SNAPSHOT_VERSION.
+static_assert(sizeof(StockItem) == 48, "StockItem layout changed, bump SNAPSHOT_VERSION");
+static_assert(sizeof(SnapshotHeader) == 64, "unexpected SnapshotHeader padding");
+
+// bytes of the header covered by the checksum
+#define SNAPSHOT_HEADER_CHECKED offsetof(SnapshotHeader, checksum)
+
+//************************************
+// Method:    SnapshotChecksum.
+// FullName:  SnapshotChecksum.
+// Access:    public.
+// Returns:   uint64_t.
+// Desc:      Folds each 8 byte word in with a xor, a multiply
+//            by an odd constant and a shift, which spreads
+//            every bit of the word over the whole state.
+// Parameter: const void* data.
+// Parameter: size_t bytes (a multiple of 8).
+// Parameter: uint64_t seed (0, or the checksum of the data before).
+//************************************
+uint64_t SnapshotChecksum(const void* data, size_t bytes, uint64_t seed) {
+    const unsigned char* pos = static_cast<const unsigned char*>(data);
+    uint64_t h = seed;
+    for (size_t i = 0; i + 8 <= bytes; i += 8) {
+        uint64_t word;
+        memcpy(&word, pos + i, 8);
+        h ^= word;
+        h *= 0x9E3779B97F4A7C15ull;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+// writes all of data to fd, retrying partial and interrupted writes
+
+static bool WriteAll(int fd, const void* data, size_t bytes) {
+    const char* pos = static_cast<const char*>(data);
+    while (bytes > 0) {
+        ssize_t n = write(fd, pos, bytes);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        pos += n;
+        bytes -= n;
+    }
+    return true;
+}
+
+
+
+//************************************
+// Method:    SnapshotWriter.
+// FullName:  SnapshotWriter::SnapshotWriter.
+// Access:    public.
+// Desc:      Default constructor, no file open.
+//************************************
+SnapshotWriter::SnapshotWriter() : fd(-1), used(0), count(0), checksum(0), failed(false) {
+}
+
+
+
+//************************************
+// Method:    ~SnapshotWriter.
+// FullName:  SnapshotWriter::~SnapshotWriter.
+// Access:    public.
+// Desc:      Abandons an unfinished snapshot, the file at
+//            path is left as it was.
+//************************************
+SnapshotWriter::~SnapshotWriter() {
+    if (fd >= 0) {
+        close(fd);
+        unlink(temppath.c_str());
+    }
+}
+
+
+
+//************************************
+// Method:    Open.
+// FullName:  SnapshotWriter::Open.
+// Access:    public.
+// Returns:   bool (false if the temporary file cannot be created).
+// Desc:      Creates path.tmp and leaves room for the header,
+//            which is only known once every record is written.
+// Parameter: const string& filepath (where the snapshot goes).
+//************************************
+bool SnapshotWriter::Open(const string& filepath) {
+    path = filepath;
+    temppath = filepath + ".tmp";
+    fd = open(temppath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    SnapshotHeader blank;
+    memset(&blank, 0, sizeof(blank));
+    failed = !WriteAll(fd, &blank, sizeof(blank));
+    return !failed;
+}
+
+
+
+//************************************
+// Method:    FlushRecords.
+// FullName:  SnapshotWriter::FlushRecords.
+// Access:    private.
+// Returns:   void.
+//************************************
+void SnapshotWriter::FlushRecords() {
+    if (used > 0 && !failed) {
+        checksum = SnapshotChecksum(records, used * sizeof(StockItem), checksum);
+        failed = !WriteAll(fd, records, used * sizeof(StockItem));
+    }
+    used = 0;
+}
+
+
+
+//************************************
+// Method:    Add.
+// FullName:  SnapshotWriter::Add.
+// Access:    public.
+// Returns:   void.
+// Parameter: const StockItem& item (the next item in SKU order).
+//************************************
+void SnapshotWriter::Add(const StockItem& item) {
+    if (used == sizeof(records) / sizeof(records[0])) {
+        FlushRecords();
+    }
+    records[used++] = item;
+    ++count;
+}
+
+
+
+//************************************
+// Method:    Finish.
+// FullName:  SnapshotWriter::Finish.
+// Access:    public.
+// Returns:   bool (false if any write, the sync or the
+//            rename failed).
+// Desc:      The header's checksum covers its own fields and
+//            then the records, so it is computed last and
+//            written over the blank header.
+// Parameter: long long balancecents (the balance, in cents).
+// Parameter: double balance (the balance, exactly).
+// Parameter: uint64_t journalgeneration (of the open journal, 0 if none).
+// Parameter: uint64_t journalbytes (the journal's length).
+//************************************
+bool SnapshotWriter::Finish(long long balancecents, double balance, uint64_t journalgeneration, uint64_t journalbytes) {
+    if (fd < 0) {
+        return false;
+    }
+    FlushRecords();
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.recordsize = sizeof(StockItem);
+    header.count = count;
+    header.balancecents = balancecents;
+    header.balance = balance;
+    header.journalgeneration = journalgeneration;
+    header.journalbytes = journalbytes;
+    header.checksum = SnapshotChecksum(&header, SNAPSHOT_HEADER_CHECKED, 0);
+    // The records were checksummed from 0, chain them after the header fields.
+    header.checksum = SnapshotChecksum(&checksum, sizeof(checksum), header.checksum);
+
+    if (!failed) {
+        failed = pwrite(fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header);
+    }
+    if (!failed) {
+        failed = fsync(fd) != 0;
+    }
+    failed = close(fd) != 0 || failed;
+    fd = -1;
+    if (!failed) {
+        failed = rename(temppath.c_str(), path.c_str()) != 0;
+    }
+    if (failed) {
+        unlink(temppath.c_str());
+    }
+    return !failed;
+}
+
+
+
+//************************************
+// Method:    SnapshotReader.
+// FullName:  SnapshotReader::SnapshotReader.
+// Access:    public.
+// Desc:      Default constructor, nothing mapped.
+//************************************
+SnapshotReader::SnapshotReader() : map(NULL), mapsize(0) {
+}
+
+
+
+//************************************
+// Method:    ~SnapshotReader.
+// FullName:  SnapshotReader::~SnapshotReader.
+// Access:    public.
+//************************************
+SnapshotReader::~SnapshotReader() {
+    if (map != NULL) {
+        munmap(map, mapsize);
+    }
+}
+
+
+
+//************************************
+// Method:    Open.
+// FullName:  SnapshotReader::Open.
+// Access:    public.
+// Returns:   bool (false if the file is missing or invalid).
+// Desc:      Maps the file and validates it in one linear
+//            pass over the records: checksum, strictly
+//            ascending SKUs and sane description lengths.
+// Parameter: const string& filepath (the snapshot file).
+//************************************
+bool SnapshotReader::Open(const string& filepath) {
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return false;
+    }
+    mapsize = info.st_size;
+    map = mmap(NULL, mapsize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping stays valid without the descriptor.
+    if (map == MAP_FAILED) {
+        map = NULL;
+        return false;
+    }
+    madvise(map, mapsize, MADV_SEQUENTIAL);
+
+    const SnapshotHeader& header = Header();
+    bool valid = memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0
+        && header.version == SNAPSHOT_VERSION
+        && header.recordsize == sizeof(StockItem)
+        && header.count == (mapsize - sizeof(SnapshotHeader)) / sizeof(StockItem)
+        && (mapsize - sizeof(SnapshotHeader)) % sizeof(StockItem) == 0;
+    if (valid) {
+        uint64_t records = SnapshotChecksum(Items(), header.count * sizeof(StockItem), 0);
+        uint64_t checksum = SnapshotChecksum(&header, SNAPSHOT_HEADER_CHECKED, 0);
+        valid = SnapshotChecksum(&records, sizeof(records), checksum) == header.checksum;
+    }
+    const StockItem* items = Items();
+    for (uint64_t i = 0; valid && i < header.count; i++) {
+        valid = items[i].GetDescription().length() <= DESC_MAX_LENGTH
+            && (i == 0 || items[i - 1].GetSKU() < items[i].GetSKU());
+    }
+    if (!valid) {
+        munmap(map, mapsize);
+        map = NULL;
+    }
+    return valid;
+}
+
+
+
+//************************************
+// Method:    Header.
+// FullName:  SnapshotReader::Header.
+// Access:    public.
+// Returns:   const SnapshotHeader&.
+//************************************
+const SnapshotHeader& SnapshotReader::Header() const {
+    return *static_cast<const SnapshotHeader*>(map);
+}
+
+
+
+//************************************
+// Method:    Items.
+// FullName:  SnapshotReader::Items.
+// Access:    public.
+// Returns:   const StockItem* (the records, in place).
+//************************************
+const StockItem* SnapshotReader::Items() const {
+    return reinterpret_cast<const StockItem*>(static_cast<const char*>(map) + sizeof(SnapshotHeader));
+}
@@ -0,0 +1,97 @@
+// File:        stocksnapshot.h
+// Date:        2026-10-17
+// Description: Declaration of the SnapshotWriter and SnapshotReader classes,
+//              the binary snapshot format of a StockSystem
+
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+
+#include "stockitem.h"
+
+#define SNAPSHOT_MAGIC "STOCKSNP"
+#define SNAPSHOT_VERSION 4
+
+// A snapshot file is a SnapshotHeader followed by count StockItem records,
+//   sorted by SKU. StockItem is trivially copyable with no padding, so each
+//   record is the item's exact bytes (native byte order) and a mapped file
+//   can be read as a StockItem array without any decoding.
+// The version and recordsize fields reject files written with another
+//   StockItem layout, and checksum covers the header fields before it and
+//   every record.
+struct SnapshotHeader {
+    char magic[8]; // SNAPSHOT_MAGIC, not NUL terminated
+    uint32_t version; // SNAPSHOT_VERSION
+    uint32_t recordsize; // sizeof(StockItem)
+    uint64_t count; // number of records
+    int64_t balancecents; // the balance in cents, loaded in CONCURRENT_SALES mode
+    double balance; // the exact balance, loaded in SINGLE_THREADED mode, which may hold fractions of a cent
+    uint64_t journalgeneration; // StockJournal::Generation of the journal open when it was saved, 0 if none
+    uint64_t journalbytes; // that journal's Length then; its records up to there are in the snapshot
+    uint64_t checksum; // SnapshotChecksum of the 56 bytes above, extended with the checksum of the records
+};
+
+// 64 bit checksum over whole 8 byte words, one multiply per word.
+// bytes must be a multiple of 8. Chain calls by passing the previous result as seed.
+uint64_t SnapshotChecksum(const void* data, size_t bytes, uint64_t seed);
+
+// Writes a snapshot to a temporary file next to path and renames it over
+//   path once it is complete and synced, so a crash never leaves a torn file.
+class SnapshotWriter {
+private:
+    string path;
+    string temppath;
+    int fd;
+    StockItem records[1024]; // buffer of records not written yet
+    size_t used;
+    uint64_t count;
+    uint64_t checksum; // of the records written so far
+    bool failed;
+
+    // writes out the buffered records
+    void FlushRecords();
+
+public:
+    SnapshotWriter();
+
+    // removes the temporary file if Finish was not reached
+    ~SnapshotWriter();
+
+    // creates the temporary file
+    // Return false if it cannot be created.
+    bool Open(const string& filepath);
+
+    // appends the next record, items must come in ascending SKU order
+    void Add(const StockItem& item);
+
+    // writes the header, syncs and renames the file into place
+    // Return false if anything failed along the way.
+    bool Finish(long long balancecents, double balance, uint64_t journalgeneration, uint64_t journalbytes);
+};
+
+// Maps a snapshot file read-only and checks it completely before any of it
+//   is used.
+class SnapshotReader {
+private:
+    void* map; // mapping of the whole file, or NULL
+    size_t mapsize;
+
+public:
+    SnapshotReader();
+
+    // unmaps the file
+    ~SnapshotReader();
+
+    // maps the file at filepath
+    // Return false if it cannot be read, or if its magic, version, record size,
+    //   length, checksum, SKU order or description lengths are wrong.
+    bool Open(const string& filepath);
+
+    // the checked header, valid after a successful Open
+    const SnapshotHeader& Header() const;
+
+    // the Header().count records, sorted by SKU, straight from the mapping
+    const StockItem* Items() const;
+};
@@ -0,0 +1,277 @@
+// File:        stockstats.cpp
+// Date:        2026-10-17
+// Description: Implementation of the per-thread instrumentation counters and of
+//              StockStats
+
+#include <math.h>
+#include <string.h>
+#include <mutex>
+#include <vector>
+
+#include "stockstats.h"
+
+static const char* const methodNames[METHOD_COUNT] = {
+    "StockNewItem", "EditStockItemDescription", "EditStockItemPrice", "Restock", "Sell", "ApplyBatch",
+    "InventoryValue", "TotalUnits", "CountBelow", "GetRangeSummary", "WriteCatalogue", "GetCatalogueRange",
+    "GetCataloguePage", "BulkLoad", "SaveSnapshot", "LoadSnapshot", "CommitJournal", "Checkpoint", "Recover",
+    "Snapshot"
+};
+
+static const char* const counterNames[TREE_COUNTER_COUNT] = {
+    "stock_tree_descents", "stock_tree_nodes_visited", "stock_tree_left_rotations", "stock_tree_right_rotations",
+    "stock_tree_insert_fixups", "stock_tree_delete_fixups"
+};
+
+const char* StockMethodName(StockMethod method) {
+    return methodNames[method];
+}
+
+//************************************
+// Method:    LatencyBucketStart.
+// FullName:  LatencyBucketStart.
+// Access:    public.
+// Returns:   uint64_t.
+// Desc:      Inverse of LatencyBucket: the bucket's magnitude
+//            and sub-bucket give the leading bits of the
+//            smallest value in it.
+// Parameter: unsigned int bucket (below STATS_LATENCY_BUCKETS).
+//************************************
+uint64_t LatencyBucketStart(unsigned int bucket) {
+    if (bucket < STATS_SUB_BUCKETS) {
+        return bucket;
+    }
+    unsigned int magnitude = bucket / STATS_SUB_BUCKETS + STATS_SUB_BITS - 1;
+    return (uint64_t) (STATS_SUB_BUCKETS + bucket % STATS_SUB_BUCKETS) << (magnitude - STATS_SUB_BITS);
+}
+
+
+
+//************************************
+// Method:    Percentile.
+// FullName:  LatencyHistogram::Percentile.
+// Access:    public.
+// Returns:   uint64_t.
+// Qualifier: const.
+// Desc:      Nearest rank: the answer is the bucket of the
+//            ceil(q * count)-th smallest call. The tiny offset
+//            keeps q * count from rounding up past a whole
+//            number, as 0.9 * 10 does in binary.
+// Parameter: double q (between 0 and 1).
+//************************************
+uint64_t LatencyHistogram::Percentile(double q) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t) ceil(q * count - 1e-9); // Calls at or below the answer, at least one.
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (unsigned int bucket = 0; bucket < STATS_LATENCY_BUCKETS; bucket++) {
+        seen += counts[bucket];
+        if (seen >= rank) {
+            uint64_t last = bucket + 1 < STATS_LATENCY_BUCKETS ? LatencyBucketStart(bucket + 1) - 1 : max;
+            return last < max ? last : max;
+        }
+    }
+    return max;
+}
+
+
+
+//************************************
+// Method:    Write.
+// FullName:  StockStats::Write.
+// Access:    public.
+// Returns:   void.
+// Qualifier: const.
+// Parameter: ostream& out.
+//************************************
+void StockStats::Write(ostream& out) const {
+    out << "stock_stats_enabled " << (enabled ? 1 : 0) << "\n";
+    for (int c = 0; c < TREE_COUNTER_COUNT; c++) {
+        out << counterNames[c] << " " << counters[c] << "\n";
+    }
+    uint64_t seen = 0;
+    for (int length = 0; length < STATS_DESCENT_BUCKETS; length++) {
+        seen += descentlengths[length];
+        if (descentlengths[length] > 0) { // Cumulative, as a histogram's "le" buckets.
+            out << "stock_tree_descent_nodes_bucket{le=\"" << length << "\"} " << seen << "\n";
+        }
+    }
+
+    const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    const char* const quantileNames[] = {"0.5", "0.9", "0.99", "0.999"};
+    for (int m = 0; m < METHOD_COUNT; m++) {
+        const LatencyHistogram& histogram = latency[m];
+        if (histogram.count == 0) {
+            continue;
+        }
+        out << "stock_call_count{method=\"" << methodNames[m] << "\"} " << histogram.count << "\n";
+        out << "stock_call_latency_ns_sum{method=\"" << methodNames[m] << "\"} " << histogram.sum << "\n";
+        for (int q = 0; q < 4; q++) {
+            out << "stock_call_latency_ns{method=\"" << methodNames[m] << "\",quantile=\"" << quantileNames[q] << "\"} "
+                << histogram.Percentile(quantiles[q]) << "\n";
+        }
+        out << "stock_call_latency_ns_max{method=\"" << methodNames[m] << "\"} " << histogram.max << "\n";
+    }
+    out.flush();
+}
+
+#ifdef STOCK_STATS
+
+thread_local StatsBlock* localstats = NULL;
+
+static mutex registrylock; // guards liveblocks and retired
+static vector<StatsBlock*> liveblocks; // the blocks of the running threads
+static StatsBlock retired; // sum of the blocks of the threads that have ended
+
+// Adds the counts of one block to another; for the latency maxima, keeps the larger.
+static void MergeBlock(const StatsBlock& from, StatsBlock& into) {
+    for (int c = 0; c < TREE_COUNTER_COUNT; c++) {
+        StatsAdd(into.counters[c], from.counters[c].load(memory_order_relaxed));
+    }
+    for (int length = 0; length < STATS_DESCENT_BUCKETS; length++) {
+        StatsAdd(into.descentlengths[length], from.descentlengths[length].load(memory_order_relaxed));
+    }
+    for (int m = 0; m < METHOD_COUNT; m++) {
+        for (int bucket = 0; bucket < STATS_LATENCY_BUCKETS; bucket++) {
+            StatsAdd(into.latency[m][bucket], from.latency[m][bucket].load(memory_order_relaxed));
+        }
+        StatsAdd(into.latencysum[m], from.latencysum[m].load(memory_order_relaxed));
+        uint64_t max = from.latencymax[m].load(memory_order_relaxed);
+        if (max > into.latencymax[m].load(memory_order_relaxed)) {
+            into.latencymax[m].store(max, memory_order_relaxed);
+        }
+    }
+}
+
+// Zeroes every counter of a block.
+static void ClearBlock(StatsBlock& block) {
+    for (int c = 0; c < TREE_COUNTER_COUNT; c++) {
+        block.counters[c].store(0, memory_order_relaxed);
+    }
+    for (int length = 0; length < STATS_DESCENT_BUCKETS; length++) {
+        block.descentlengths[length].store(0, memory_order_relaxed);
+    }
+    for (int m = 0; m < METHOD_COUNT; m++) {
+        for (int bucket = 0; bucket < STATS_LATENCY_BUCKETS; bucket++) {
+            block.latency[m][bucket].store(0, memory_order_relaxed);
+        }
+        block.latencysum[m].store(0, memory_order_relaxed);
+        block.latencymax[m].store(0, memory_order_relaxed);
+    }
+}
+
+// Owns a thread's block: when the thread ends, its counts move to retired.
+// Kept apart from localstats, so reaching the block does not go through
+//   the guard of a thread_local with a destructor.
+struct StatsBlockOwner {
+    StatsBlock* block;
+
+    StatsBlockOwner() : block(NULL) {
+    }
+
+    ~StatsBlockOwner() {
+        if (block == NULL) {
+            return;
+        }
+        lock_guard<mutex> guard(registrylock);
+        MergeBlock(*block, retired);
+        for (size_t i = 0; i < liveblocks.size(); i++) {
+            if (liveblocks[i] == block) {
+                liveblocks[i] = liveblocks.back();
+                liveblocks.pop_back();
+                break;
+            }
+        }
+        localstats = NULL;
+        delete block;
+    }
+};
+
+static thread_local StatsBlockOwner owner;
+
+//************************************
+// Method:    RegisterLocalStats.
+// FullName:  RegisterLocalStats.
+// Access:    public.
+// Returns:   StatsBlock& (this thread's block).
+// Desc:      Called the first time a thread counts something.
+//************************************
+StatsBlock& RegisterLocalStats() {
+    StatsBlock* block = new StatsBlock;
+    ClearBlock(*block);
+    {
+        lock_guard<mutex> guard(registrylock);
+        liveblocks.push_back(block);
+    }
+    owner.block = block;
+    localstats = block;
+    return *block;
+}
+
+#endif
+
+
+
+//************************************
+// Method:    CollectStockStats.
+// FullName:  CollectStockStats.
+// Access:    public.
+// Returns:   void.
+// Desc:      Sums the blocks of the running threads and of
+//            the ended ones into a scratch block, then
+//            copies it out with the histogram totals.
+// Parameter: StockStats& stats (receives the snapshot).
+//************************************
+void CollectStockStats(StockStats& stats) {
+    memset(&stats, 0, sizeof(stats));
+#ifdef STOCK_STATS
+    StatsBlock* total = new StatsBlock; // As large as the snapshot, kept off the stack.
+    ClearBlock(*total);
+    {
+        lock_guard<mutex> guard(registrylock);
+        MergeBlock(retired, *total);
+        for (StatsBlock* block : liveblocks) {
+            MergeBlock(*block, *total);
+        }
+    }
+
+    stats.enabled = true;
+    for (int c = 0; c < TREE_COUNTER_COUNT; c++) {
+        stats.counters[c] = total->counters[c].load(memory_order_relaxed);
+    }
+    for (int length = 0; length < STATS_DESCENT_BUCKETS; length++) {
+        stats.descentlengths[length] = total->descentlengths[length].load(memory_order_relaxed);
+    }
+    for (int m = 0; m < METHOD_COUNT; m++) {
+        LatencyHistogram& histogram = stats.latency[m];
+        for (int bucket = 0; bucket < STATS_LATENCY_BUCKETS; bucket++) {
+            histogram.counts[bucket] = total->latency[m][bucket].load(memory_order_relaxed);
+            histogram.count += histogram.counts[bucket];
+        }
+        histogram.sum = total->latencysum[m].load(memory_order_relaxed);
+        histogram.max = total->latencymax[m].load(memory_order_relaxed);
+    }
+    delete total;
+#endif
+}
+
+
+
+//************************************
+// Method:    ResetStockStats.
+// FullName:  ResetStockStats.
+// Access:    public.
+// Returns:   void.
+//************************************
+void ResetStockStats() {
+#ifdef STOCK_STATS
+    lock_guard<mutex> guard(registrylock);
+    ClearBlock(retired);
+    for (StatsBlock* block : liveblocks) {
+        ClearBlock(*block);
+    }
+#endif
+}
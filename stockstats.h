@@ -0,0 +1,217 @@
+// File:        stockstats.h
+// Date:        2026-10-17
+// Description: Hot path instrumentation: RedBlackTree descent, rotation and fix-up
+//              counters and StockSystem latency histograms, compiled in only with
+//              -DSTOCK_STATS (make STATS=1)
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <ostream>
+
+using namespace std;
+
+// Latency histograms are log-linear, as in HdrHistogram: values below
+//   STATS_SUB_BUCKETS ns get a bucket each, and every power of two above is
+//   split into STATS_SUB_BUCKETS buckets, so a bucket is within 1/16 (6.25%)
+//   of the values it holds. Latencies of 2^STATS_MAX_MAGNITUDE ns (about
+//   69 s) or more all go to the last bucket.
+#define STATS_SUB_BITS 4
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BITS)
+#define STATS_MAX_MAGNITUDE 36
+#define STATS_LATENCY_BUCKETS ((STATS_MAX_MAGNITUDE - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS)
+
+// Descents of 63 nodes or more share the last bucket of descentlengths.
+#define STATS_DESCENT_BUCKETS 64
+
+// RedBlackTree counters, summed over every tree
+enum TreeCounter {
+    TREE_DESCENTS, // searches from the root (FindNode, BoundNode, SelectNode, BSTInsert)
+    TREE_NODES_VISITED, // nodes visited by those descents
+    TREE_LEFT_ROTATIONS,
+    TREE_RIGHT_ROTATIONS,
+    TREE_INSERT_FIXUPS, // iterations of the insert fix-up loop
+    TREE_DELETE_FIXUPS, // iterations of RBDeleteFixUp's loop
+    TREE_COUNTER_COUNT
+};
+
+// StockSystem calls with a latency histogram
+enum StockMethod {
+    METHOD_STOCK_NEW_ITEM,
+    METHOD_EDIT_DESCRIPTION,
+    METHOD_EDIT_PRICE,
+    METHOD_RESTOCK,
+    METHOD_SELL,
+    METHOD_APPLY_BATCH,
+    METHOD_INVENTORY_VALUE,
+    METHOD_TOTAL_UNITS,
+    METHOD_COUNT_BELOW,
+    METHOD_RANGE_SUMMARY,
+    METHOD_WRITE_CATALOGUE, // also GetCatalogue
+    METHOD_CATALOGUE_RANGE,
+    METHOD_CATALOGUE_PAGE,
+    METHOD_BULK_LOAD,
+    METHOD_SAVE_SNAPSHOT,
+    METHOD_LOAD_SNAPSHOT,
+    METHOD_COMMIT_JOURNAL,
+    METHOD_CHECKPOINT,
+    METHOD_RECOVER,
+    METHOD_SNAPSHOT,
+    METHOD_COUNT
+};
+
+// name of a StockMethod, as in StockSystem
+const char* StockMethodName(StockMethod method);
+
+// bucket of a latency of ns nanoseconds
+inline unsigned int LatencyBucket(uint64_t ns) {
+    if (ns < STATS_SUB_BUCKETS) {
+        return (unsigned int) ns;
+    }
+    unsigned int magnitude = bit_width(ns) - 1; // at least STATS_SUB_BITS
+    if (magnitude >= STATS_MAX_MAGNITUDE) {
+        return STATS_LATENCY_BUCKETS - 1;
+    }
+    return (magnitude - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS + (unsigned int) ((ns >> (magnitude - STATS_SUB_BITS)) & (STATS_SUB_BUCKETS - 1));
+}
+
+// smallest latency that falls in bucket
+uint64_t LatencyBucketStart(unsigned int bucket);
+
+// Latencies of one StockMethod, in ns.
+struct LatencyHistogram {
+    uint64_t counts[STATS_LATENCY_BUCKETS];
+    uint64_t count; // calls
+    uint64_t sum;
+    uint64_t max;
+
+    // the value at or below which a fraction q of the calls fall (nearest
+    //   rank), to the bucket's precision (the bucket's last value, at most
+    //   max); 0 if there are no calls
+    uint64_t Percentile(double q) const;
+};
+
+// A snapshot of every counter and histogram, merged over all threads.
+struct StockStats {
+    bool enabled; // false if built without STOCK_STATS, everything is then 0
+    uint64_t counters[TREE_COUNTER_COUNT];
+    uint64_t descentlengths[STATS_DESCENT_BUCKETS]; // descents by number of nodes visited
+    LatencyHistogram latency[METHOD_COUNT];
+
+    // Writes the snapshot as text, one "name{labels} value" line per figure
+    //   (Prometheus' text format), e.g. for a scraper or a log:
+    //     stock_tree_descents 1200
+    //     stock_call_latency_ns{method="Sell",quantile="0.99"} 412
+    // Methods that were never called are left out.
+    void Write(ostream& out) const;
+};
+
+// Merges the counters of every thread (and of the threads that have ended).
+// Counters being written meanwhile may be read a few increments behind.
+void CollectStockStats(StockStats& stats);
+
+// Zeroes every counter; increments made while it runs may survive.
+void ResetStockStats();
+
+#ifdef STOCK_STATS
+
+// The counters of one thread. Only its thread writes them, with plain
+//   relaxed loads and stores (no locked instructions); other threads read
+//   them when collecting.
+struct StatsBlock {
+    atomic<uint64_t> counters[TREE_COUNTER_COUNT];
+    atomic<uint64_t> descentlengths[STATS_DESCENT_BUCKETS];
+    atomic<uint64_t> latency[METHOD_COUNT][STATS_LATENCY_BUCKETS];
+    atomic<uint64_t> latencysum[METHOD_COUNT];
+    atomic<uint64_t> latencymax[METHOD_COUNT];
+};
+
+// this thread's block, NULL until it first counts something
+extern thread_local StatsBlock* localstats;
+
+// creates and registers this thread's block
+StatsBlock& RegisterLocalStats();
+
+inline StatsBlock& LocalStats() {
+    StatsBlock* block = localstats;
+    return block != NULL ? *block : RegisterLocalStats();
+}
+
+// adds n to a counter only this thread writes
+inline void StatsAdd(atomic<uint64_t>& counter, uint64_t n) {
+    counter.store(counter.load(memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+inline void CountTreeEvent(TreeCounter counter) {
+    StatsAdd(LocalStats().counters[counter], 1);
+}
+
+// Counts one descent and the nodes it visits, when it goes out of scope.
+class StatsDescent {
+private:
+    unsigned int visited;
+
+public:
+    StatsDescent() : visited(0) {
+    }
+
+    void Visit() {
+        ++visited;
+    }
+
+    ~StatsDescent() {
+        StatsBlock& block = LocalStats();
+        StatsAdd(block.counters[TREE_DESCENTS], 1);
+        StatsAdd(block.counters[TREE_NODES_VISITED], visited);
+        StatsAdd(block.descentlengths[visited < STATS_DESCENT_BUCKETS ? visited : STATS_DESCENT_BUCKETS - 1], 1);
+    }
+};
+
+// Adds the time from its construction to its destruction to the histogram of a method.
+class StatsTimer {
+private:
+    StockMethod method;
+    chrono::steady_clock::time_point start;
+
+public:
+    explicit StatsTimer(StockMethod timed) : method(timed) {
+        LocalStats(); // Registers this thread's block before the clock starts, so its allocation is not timed.
+        start = chrono::steady_clock::now();
+    }
+
+    ~StatsTimer() {
+        uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        StatsBlock& block = LocalStats();
+        StatsAdd(block.latency[method][LatencyBucket(ns)], 1);
+        StatsAdd(block.latencysum[method], ns);
+        if (ns > block.latencymax[method].load(memory_order_relaxed)) {
+            block.latencymax[method].store(ns, memory_order_relaxed);
+        }
+    }
+};
+
+#define STATS_COUNT(counter) CountTreeEvent(counter)
+#define STATS_DESCENT(name) StatsDescent name
+#define STATS_VISIT(name) name.Visit()
+#define STATS_TIME(method) StatsTimer statstimer(method)
+
+#else
+
+// Without STOCK_STATS the hooks compile to nothing.
+// Recursive descents pass their StatsDescent down by reference, so it is
+//   kept as an empty object.
+class StatsDescent {
+public:
+    void Visit() {
+    }
+};
+
+#define STATS_COUNT(counter)
+#define STATS_DESCENT(name)
+#define STATS_VISIT(name)
+#define STATS_TIME(method)
+
+#endif
@@ -3,21 +3,108 @@
 // Description: implementation of a StockSystem class 
 
 #include <math.h>
+#include <algorithm>
+#include <atomic>
 #include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "stockitem.h"
 #include "stocksystem.h"
 #include "redblacktree.h"
+#include "inventorykernels.h"
+#include "stocksnapshot.h"
 
 
 //************************************
 // Method:    StockSystem.
 // FullName:  StockSystem::StockSystem.
 // Access:    public.   
-// Qualifier: : balance(100000.00) (initializing the balance to $1,000,000.00).
-// Desc:      Default constructor.
+// Qualifier: : storage(engine), concurrency(mode), balance(100000.00), balancecents(10000000)
+//            (initializing the balance to $1,000,000.00).
+// Desc:      Default constructor. SUMMARY_TREE_STORAGE and
+//            VERSIONED_TREE_STORAGE ignore CONCURRENT_SALES.
+// Parameter: StockStorage engine (where the catalogue is kept).
+// Parameter: StockConcurrency mode (whether sales may run concurrently).
 //************************************
-StockSystem::StockSystem() : balance(100000.00) {
+StockSystem::StockSystem(StockStorage engine, StockConcurrency mode) : storage(engine), concurrency(engine == SUMMARY_TREE_STORAGE || engine == VERSIONED_TREE_STORAGE ? SINGLE_THREADED : mode), balance(100000.00), balancecents(10000000), appliedgeneration(0), appliedbytes(0) {
+}
+
+
+
+//************************************
+// Method:    GetConcurrency.
+// FullName:  StockSystem::GetConcurrency.
+// Access:    public.
+// Returns:   StockConcurrency.
+// Desc:      Returns the threading mode.
+//************************************
+StockConcurrency StockSystem::GetConcurrency() const {
+    return concurrency;
+}
+
+
+
+//************************************
+// Method:    SetCopyOnWrite.
+// FullName:  StockSystem::SetCopyOnWrite.
+// Access:    public.
+// Returns:   bool (false in CONCURRENT_SALES mode).
+// Desc:      Sets the copy mode of both catalogue trees, the
+//            SKU table and the columns.
+// Parameter: bool enable.
+//************************************
+bool StockSystem::SetCopyOnWrite(bool enable) {
+    if (concurrency == CONCURRENT_SALES) {
+        return false;
+    }
+    records.SetCopyOnWrite(enable);
+    summarytree.SetCopyOnWrite(enable);
+    table.SetCopyOnWrite(enable);
+    columns.SetCopyOnWrite(enable);
+    return true;
+}
+
+
+
+//************************************
+// Method:    GetStorage.
+// FullName:  StockSystem::GetStorage.
+// Access:    public.
+// Returns:   StockStorage.
+// Desc:      Returns the storage engine of the catalogue.
+//************************************
+StockStorage StockSystem::GetStorage() const {
+    return storage;
+}
+
+
+
+//************************************
+// Method:    FindItem.
+// FullName:  StockSystem::FindItem.
+// Access:    private.
+// Returns:   StockItem* (NULL if no item has the SKU).
+// Desc:      Looks an item up by SKU, with a tree descent
+//            or a single table access depending on the
+//            storage engine. A versions item is returned
+//            for reading only, its node may be shared with
+//            a CatalogueView.
+// Parameter: unsigned int itemsku (the item's SKU).
+//************************************
+StockItem* StockSystem::FindItem(unsigned int itemsku) {
+    if (storage == TABLE_STORAGE) {
+        return table.Retrieve(itemsku);
+    }
+    if (storage == SUMMARY_TREE_STORAGE) {
+        return summarytree.Retrieve(itemsku);
+    }
+    if (storage == VERSIONED_TREE_STORAGE) {
+        return const_cast<StockItem*>(versions.Retrieve(itemsku));
+    }
+    return records.Retrieve(itemsku); // The records are keyed by SKU (see SkuKeyOf), so the
+    //   SKU alone is enough to find the item.
+    //   No temporary StockItem has to be built for the search.
 }
 
 
@@ -27,9 +114,14 @@ StockSystem::StockSystem() : balance(100000.00) {
 // FullName:  StockSystem::GetBalance.
 // Access:    public.
 // Returns:   double.
-// Desc:      Returns the current balance.
+// Qualifier: const.
+// Desc:      Returns the current balance, from balancecents in
+//            CONCURRENT_SALES mode.
 //************************************
-double StockSystem::GetBalance() {
+double StockSystem::GetBalance() const {
+    if (concurrency == CONCURRENT_SALES) {
+        return atomic_ref<long long>(const_cast<long long&>(balancecents)).load(memory_order_relaxed) / 100.0;
+    }
     return balance;
 }
 
@@ -42,14 +134,54 @@ double StockSystem::GetBalance() {
 // Returns:   bool (to make sure that the insertion is done correctly - 
 //            it the will return false if an item with the 
 //            specified SKU is already in the tree).
-// Parameter: StockItem item (the new item to inserted in the
+// Parameter: const StockItem& item (the new item to inserted in the
+//            catalog).
+// Desc:      Adding a copy of a new item to the catalog.
+//************************************
+bool StockSystem::StockNewItem(const StockItem& item) {
+    return StockNewItem(StockItem(item));
+}
+
+
+
+//************************************
+// Method:    StockNewItem.
+// FullName:  StockSystem::StockNewItem.
+// Access:    public.
+// Returns:   bool (false if an item with the specified SKU
+//            is already in the catalog).
+// Parameter: StockItem&& item (the new item, moved into the
 //            catalog).
-// Desc:      Adding a new item to the catalog.
+// Desc:      Adding a new item to the catalog. The item goes
+//            straight into its node (or table slot), with no
+//            intermediate copies. Its SKU is normalised once
+//            more, as rebuilding it through the constructor
+//            always did, so e.g. a default item (SKU 0) is
+//            stored as 10000 by every storage engine.
 //************************************
-bool StockSystem::StockNewItem(StockItem item) {
-    StockItem temp(item.GetSKU(), item.GetDescription(), item.GetPrice());
-    temp.SetStock(0); // Explicitly set the stock to 0, even though it is going to be 0 by default.
-    return records.Insert(temp); // Return true only when no item with similar SKU is in the tree already.
+bool StockSystem::StockNewItem(StockItem&& item) {
+    STATS_TIME(METHOD_STOCK_NEW_ITEM);
+    if (StockItem::NormalizeSKU(item.GetSKU()) != item.GetSKU()) { // Only rebuilt in this rare case.
+        item = StockItem(item.GetSKU(), item.GetDescription(), item.GetPrice());
+    }
+    item.SetStock(0); // New items always start with no stock.
+    bool inserted;
+    if (storage == TABLE_STORAGE) {
+        inserted = table.Insert(item);
+    } else if (storage == SUMMARY_TREE_STORAGE) {
+        inserted = summarytree.Insert(move(item));
+    } else if (storage == VERSIONED_TREE_STORAGE) {
+        inserted = versions.Insert(item);
+    } else {
+        // StockItem is trivially copyable, so item still holds its
+        //   values after being moved from.
+        inserted = records.Insert(move(item)); // Return true only when no item with similar SKU is in the tree already.
+    }
+    if (inserted) {
+        columns.Append(item);
+        journal.LogNewItem(item);
+    }
+    return inserted;
 }
 
 
@@ -64,17 +196,22 @@ bool StockSystem::StockNewItem(StockItem item) {
 //            in th tree, and the search will be
 //            done using the SKU of that item.
 // Parameter: unsigned int itemsku (the item's SKU).
-// Parameter: string desc (the description to be changed to in the item).
+// Parameter: string_view desc (the description to be changed to in the item).
 //************************************
-bool StockSystem::EditStockItemDescription(unsigned int itemsku, string desc) {
-    StockItem temp(itemsku, "", 0); // Since Stockitem have the < and > operators defined for the SKU of that stock item,
-    //   I can make a new Stockitem with the supplied SKU, without caring about what to
-    //   put in the description or price (so I put them as an empty string and 0, respectively).
-    StockItem* searchData = records.Retrieve(temp);
-    if (searchData == NULL) { // If nothing was found, return false.
+bool StockSystem::EditStockItemDescription(unsigned int itemsku, string_view desc) {
+    STATS_TIME(METHOD_EDIT_DESCRIPTION);
+    string_view stored; // points into the catalogue, still valid after WithItem
+    if (!WithItem(itemsku, [&](StockItem* searchData) {
+        if (searchData == NULL) { // If nothing was found, return false.
+            return false;
+        }
+        searchData->SetDescription(desc);
+        stored = searchData->GetDescription();
+        return true;
+    })) {
         return false;
     }
-    searchData->SetDescription(desc);
+    journal.LogDescription(itemsku, stored); // The description as stored, after any cut.
     return true;
 }
 
@@ -93,12 +230,35 @@ bool StockSystem::EditStockItemDescription(unsigned int itemsku, string desc) {
 // Parameter: double retailprice (the price to be changed to in the item).
 //************************************
 bool StockSystem::EditStockItemPrice(unsigned int itemsku, double retailprice) {
-    StockItem temp(itemsku, "", 0);
-    StockItem* searchData = records.Retrieve(temp);
+    STATS_TIME(METHOD_EDIT_PRICE);
+    if (!WithItem(itemsku, [&](StockItem* item) { return EditItemPrice(item, retailprice); })) {
+        return false;
+    }
+    journal.LogPrice(itemsku, retailprice);
+    return true;
+}
+
+
+
+//************************************
+// Method:    EditItemPrice.
+// FullName:  StockSystem::EditItemPrice.
+// Access:    private.
+// Returns:   bool (false if searchData is NULL).
+// Desc:      Body of EditStockItemPrice, once the item is found.
+// Parameter: StockItem* searchData (the item, NULL if it was not found).
+// Parameter: double retailprice (the price to be changed to in the item).
+//************************************
+bool StockSystem::EditItemPrice(StockItem* searchData, double retailprice) {
+    if (concurrency == CONCURRENT_SALES) {
+        return EditItemPriceConcurrent(searchData, retailprice);
+    }
     if (searchData == NULL) {
         return false;
     }
-    searchData->SetPrice(retailprice);
+    if (searchData->SetPrice(retailprice)) {
+        columns.SetPrice(searchData->GetSKU(), retailprice);
+    }
     return true;
 }
 
@@ -120,16 +280,36 @@ bool StockSystem::EditStockItemPrice(unsigned int itemsku, double retailprice) {
 // Parameter: double unitprice (the price of the item to be purchased).
 //************************************
 bool StockSystem::Restock(unsigned int itemsku, unsigned int quantity, double unitprice) {
+    STATS_TIME(METHOD_RESTOCK);
+    if (!WithItem(itemsku, [&](StockItem* item) { return RestockItem(item, quantity, unitprice); })) {
+        return false;
+    }
+    journal.LogRestock(itemsku, quantity, unitprice);
+    return true;
+}
 
-    StockItem* searchData = records.Retrieve(StockItem(itemsku, "", 0));
 
+
+//************************************
+// Method:    RestockItem.
+// FullName:  StockSystem::RestockItem.
+// Access:    private.
+// Returns:   bool (false if searchData is NULL or the balance is not enough).
+// Desc:      Body of Restock, once the item is found.
+// Parameter: StockItem* searchData (the item, NULL if it was not found).
+// Parameter: unsigned int quantity (the quantity to purchase).
+// Parameter: double unitprice (the price of the item to be purchased).
+//************************************
+bool StockSystem::RestockItem(StockItem* searchData, unsigned int quantity, double unitprice) {
+    if (concurrency == CONCURRENT_SALES) {
+        return RestockItemConcurrent(searchData, quantity, unitprice);
+    }
     if (searchData == NULL) {
         return false;
     }
 
 
-    // Save the price and the stock for easy access when needed.
-    double tempPrice = searchData->GetPrice();
+    // Save the stock for easy access when needed.
     unsigned int tempStock = searchData->GetStock();
 
 
@@ -160,6 +340,7 @@ bool StockSystem::Restock(unsigned int itemsku, unsigned int quantity, double un
     //   retrieved.
     balance = tempBalanace;
     searchData->SetStock(tempStock);
+    columns.SetStock(searchData->GetSKU(), tempStock);
 
     return true;
 }
@@ -179,9 +360,29 @@ bool StockSystem::Restock(unsigned int itemsku, unsigned int quantity, double un
 // Parameter: unsigned int quantity (the quantity of an item to sell).
 //************************************
 bool StockSystem::Sell(unsigned int itemsku, unsigned int quantity) {
-    StockItem* searchData = records.Retrieve(StockItem(itemsku, "", 0));
+    STATS_TIME(METHOD_SELL);
+    if (!WithItem(itemsku, [&](StockItem* item) { return SellItem(item, quantity); })) {
+        return false;
+    }
+    journal.LogSell(itemsku, quantity);
+    return true;
+}
+
 
 
+//************************************
+// Method:    SellItem.
+// FullName:  StockSystem::SellItem.
+// Access:    private.
+// Returns:   bool (false if searchData is NULL).
+// Desc:      Body of Sell, once the item is found.
+// Parameter: StockItem* searchData (the item, NULL if it was not found).
+// Parameter: unsigned int quantity (the quantity of an item to sell).
+//************************************
+bool StockSystem::SellItem(StockItem* searchData, unsigned int quantity) {
+    if (concurrency == CONCURRENT_SALES) {
+        return SellItemConcurrent(searchData, quantity);
+    }
     if (searchData == NULL) return false;
 
     double tempPrice = searchData->GetPrice();
@@ -202,6 +403,7 @@ bool StockSystem::Sell(unsigned int itemsku, unsigned int quantity) {
 
     // Modify the stock and the balance.
     searchData->SetStock(tempStock);
+    columns.SetStock(searchData->GetSKU(), tempStock);
     balance = tempBalanace;
 
     return true;
@@ -209,9 +411,920 @@ bool StockSystem::Sell(unsigned int itemsku, unsigned int quantity) {
 
 
 
+//************************************
+// Method:    EditItemPriceConcurrent.
+// FullName:  StockSystem::EditItemPriceConcurrent.
+// Access:    private.
+// Returns:   bool (false if searchData is NULL).
+// Desc:      EditItemPrice for CONCURRENT_SALES mode, the
+//            price is stored atomically. Two edits of the same
+//            item may race, so the column is not given
+//            retailprice but the item's price as read back, and
+//            the price is read again once it is written: until
+//            the two agree, another edit came in between and
+//            the column is written again. The fences order the
+//            reads after the other thread's stores, so the
+//            last column write always holds the final price.
+// Parameter: StockItem* searchData (the item, NULL if it was not found).
+// Parameter: double retailprice (the price to be changed to in the item).
+//************************************
+bool StockSystem::EditItemPriceConcurrent(StockItem* searchData, double retailprice) {
+    if (searchData == NULL) {
+        return false;
+    }
+    if (searchData->StorePrice(retailprice)) {
+        double stored;
+        do {
+            atomic_thread_fence(memory_order_seq_cst);
+            stored = searchData->LoadPrice();
+            columns.SetPrice(searchData->GetSKU(), stored);
+            atomic_thread_fence(memory_order_seq_cst);
+        } while (searchData->LoadPrice() != stored);
+    }
+    return true;
+}
+
+
+
+//************************************
+// Method:    RestockItemConcurrent.
+// FullName:  StockSystem::RestockItemConcurrent.
+// Access:    private.
+// Returns:   bool (false if searchData is NULL or the balance is not enough).
+// Desc:      RestockItem for CONCURRENT_SALES mode. The cost
+//            depends on the current stock, so the funds are
+//            taken out of the balance first (compare-and-swap,
+//            never below zero), then the stock is raised if it
+//            has not changed in the meantime. If it has, the
+//            funds are put back and the purchase is retried.
+// Parameter: StockItem* searchData (the item, NULL if it was not found).
+// Parameter: unsigned int quantity (the quantity to purchase).
+// Parameter: double unitprice (the price of the item to be purchased).
+//************************************
+bool StockSystem::RestockItemConcurrent(StockItem* searchData, unsigned int quantity, double unitprice) {
+    if (searchData == NULL) {
+        return false;
+    }
+
+    atomic_ref<long long> funds(balancecents);
+    while (true) {
+        int tempStock = searchData->LoadStock();
+        unsigned int emptySpace = 1000 - tempStock;
+        unsigned int added = quantity < emptySpace ? quantity : emptySpace;
+        long long cost = llround(added * unitprice * 100);
+
+        long long tempBalance = funds.load(memory_order_relaxed);
+        do {
+            if (tempBalance - cost < 0) { // Not enough balance.
+                return false;
+            }
+        } while (!funds.compare_exchange_weak(tempBalance, tempBalance - cost, memory_order_relaxed));
+
+        if (searchData->CompareExchangeStock(tempStock, tempStock + added)) {
+            columns.AddStock(searchData->GetSKU(), added);
+            return true;
+        }
+        funds.fetch_add(cost, memory_order_relaxed); // The stock changed under us, refund and retry.
+    }
+}
+
+
+
+//************************************
+// Method:    SellItemConcurrent.
+// FullName:  StockSystem::SellItemConcurrent.
+// Access:    private.
+// Returns:   bool (false if searchData is NULL).
+// Desc:      SellItem for CONCURRENT_SALES mode. The units
+//            are taken with a compare-and-swap on the stock
+//            (partial fills take what is left), and the sale
+//            is added to the balance in cents.
+// Parameter: StockItem* searchData (the item, NULL if it was not found).
+// Parameter: unsigned int quantity (the quantity of an item to sell).
+//************************************
+bool StockSystem::SellItemConcurrent(StockItem* searchData, unsigned int quantity) {
+    if (searchData == NULL) return false;
+
+    unsigned int sold = searchData->TakeStock(quantity);
+    if (sold > 0) {
+        long long pricecents = llround(searchData->LoadPrice() * 100);
+        atomic_ref<long long>(balancecents).fetch_add(sold * pricecents, memory_order_relaxed);
+        columns.AddStock(searchData->GetSKU(), -(int) sold);
+    }
+    return true;
+}
+
+
+
+//************************************
+// Method:    ApplyBatch.
+// FullName:  StockSystem::ApplyBatch.
+// Access:    public.
+// Returns:   void.
+// Desc:      Applies a batch of operations. The SKUs of the
+//            batch are sorted and every distinct SKU is looked
+//            up once, with shared descents for neighbouring
+//            keys (see RedBlackTree::RetrieveSorted). The
+//            operations are then applied in their original
+//            order, so results and balance are the same as
+//            when calling Sell/Restock/EditStockItemPrice in
+//            turn, and so are the journal records. With SUMMARY_TREE_STORAGE and
+//            VERSIONED_TREE_STORAGE each operation updates (or
+//            copies) its own path, so they are applied one by
+//            one.
+// Parameter: span<const StockOperation> ops (the batch).
+// Parameter: span<bool> results (receives the return value of
+//            each operation, at least ops.size() entries).
+//************************************
+void StockSystem::ApplyBatch(span<const StockOperation> ops, span<bool> results) {
+    STATS_TIME(METHOD_APPLY_BATCH);
+    size_t count = ops.size();
+    if (storage == SUMMARY_TREE_STORAGE || storage == VERSIONED_TREE_STORAGE) {
+        for (size_t i = 0; i < count; i++) {
+            switch (ops[i].code) {
+                case SELL_OP:
+                    results[i] = Sell(ops[i].itemsku, ops[i].quantity);
+                    break;
+                case RESTOCK_OP:
+                    results[i] = Restock(ops[i].itemsku, ops[i].quantity, ops[i].price);
+                    break;
+                case EDIT_PRICE_OP:
+                    results[i] = EditStockItemPrice(ops[i].itemsku, ops[i].price);
+                    break;
+                default:
+                    results[i] = false;
+                    break;
+            }
+        }
+        return;
+    }
+    batchitems.resize(count);
+
+    if (storage == TABLE_STORAGE) { // Lookups are already a single access each.
+        for (size_t i = 0; i < count; i++) {
+            batchitems[i] = table.Retrieve(ops[i].itemsku);
+        }
+    } else {
+        // Sort (SKU, position) pairs, packed into one integer each so they sort as plain numbers,
+        //   then resolve all SKUs in one merged descent.
+        batchorder.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            uint32_t key = (uint32_t) StockItem::NormalizeSKU(ops[i].itemsku) ^ 0x80000000u; // order preserving for negative SKUs
+            batchorder[i] = ((uint64_t) key << 32) | i;
+        }
+        sort(batchorder.begin(), batchorder.end());
+        batchkeys.resize(count);
+        batchfound.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            batchkeys[i] = (int) ((uint32_t) (batchorder[i] >> 32) ^ 0x80000000u);
+        }
+        records.RetrieveSorted(batchkeys.data(), count, batchfound.data());
+        for (size_t i = 0; i < count; i++) {
+            batchitems[(uint32_t) batchorder[i]] = batchfound[i];
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        switch (ops[i].code) {
+            case SELL_OP:
+                if ((results[i] = SellItem(batchitems[i], ops[i].quantity))) {
+                    journal.LogSell(ops[i].itemsku, ops[i].quantity);
+                }
+                break;
+            case RESTOCK_OP:
+                if ((results[i] = RestockItem(batchitems[i], ops[i].quantity, ops[i].price))) {
+                    journal.LogRestock(ops[i].itemsku, ops[i].quantity, ops[i].price);
+                }
+                break;
+            case EDIT_PRICE_OP:
+                if ((results[i] = EditItemPrice(batchitems[i], ops[i].price))) {
+                    journal.LogPrice(ops[i].itemsku, ops[i].price);
+                }
+                break;
+            default:
+                results[i] = false;
+                break;
+        }
+    }
+    // clear() keeps the capacity for the next batch.
+    batchorder.clear();
+    batchkeys.clear();
+    batchfound.clear();
+    batchitems.clear();
+}
+
+
+
+//************************************
+// Method:    ClampSKURange.
+// FullName:  StockSystem::ClampSKURange.
+// Access:    private.
+// Returns:   bool (false if the range holds no 5 digit SKU).
+// Desc:      Limits a SKU range to [SKU_MIN, SKU_MAX], where
+//            SkuKeyOf leaves SKU numbers unchanged.
+// Parameter: unsigned int lo, unsigned int hi (the range asked for).
+// Parameter: int& first, int& last (set to the clamped range).
+//************************************
+bool StockSystem::ClampSKURange(unsigned int lo, unsigned int hi, int& first, int& last) {
+    if (lo > hi || lo > SKU_MAX || hi < SKU_MIN) {
+        return false;
+    }
+    first = lo < SKU_MIN ? SKU_MIN : (int) lo;
+    last = hi > SKU_MAX ? SKU_MAX : (int) hi;
+    return true;
+}
+
+
+
+//************************************
+// Method:    GetRangeSummary.
+// FullName:  StockSystem::GetRangeSummary.
+// Access:    public.
+// Returns:   StockSummary (units and value of the range).
+// Qualifier: const.
+// Desc:      Sums the units on hand and their retail value
+//            over the SKUs in [lo, hi]. The summary and
+//            versioned trees answer from their subtree sums in
+//            O(log n), the other engines visit every item in
+//            the range.
+// Parameter: unsigned int lo (smallest SKU to include).
+// Parameter: unsigned int hi (largest SKU to include).
+//************************************
+StockSummary StockSystem::GetRangeSummary(unsigned int lo, unsigned int hi) const {
+    STATS_TIME(METHOD_RANGE_SUMMARY);
+    StockSummary summary;
+    int first, last;
+    if (!ClampSKURange(lo, hi, first, last)) {
+        return summary;
+    }
+    if (storage == SUMMARY_TREE_STORAGE) {
+        return summarytree.RangeSummary(first, last);
+    }
+    if (storage == VERSIONED_TREE_STORAGE) {
+        return versions.RangeSummary(first, last);
+    }
+    ForEachItemInRange(lo, hi, [&](const StockItem& item) {
+        summary.Add(item);
+    });
+    return summary;
+}
+
+
+
+//************************************
+// Method:    GetCatalogueRange.
+// FullName:  StockSystem::GetCatalogueRange.
+// Access:    public.
+// Returns:   string (the header line followed by one line per item).
+// Qualifier: const.
+// Desc:      Formats the part of the catalogue with SKUs
+//            in [lo, hi], exactly like GetCatalogue does.
+// Parameter: unsigned int lo (smallest SKU to report).
+// Parameter: unsigned int hi (largest SKU to report).
+//************************************
+string StockSystem::GetCatalogueRange(unsigned int lo, unsigned int hi) const {
+    STATS_TIME(METHOD_CATALOGUE_RANGE);
+    ostringstream strcatalogue;
+    CatalogueWriter writer(strcatalogue);
+
+    writer.WriteHeader();
+    ForEachItemInRange(lo, hi, [&](const StockItem& item) {
+        writer.WriteRow(item);
+    });
+    writer.Flush();
+    return strcatalogue.str();
+}
 
 
 
+//************************************
+// Method:    GetCataloguePage.
+// FullName:  StockSystem::GetCataloguePage.
+// Access:    public.
+// Returns:   string (the header line followed by one line per item).
+// Qualifier: const.
+// Desc:      Formats count items of the catalogue, starting
+//            at position offset, exactly like GetCatalogue does.
+//            The page is empty once offset reaches the end.
+// Parameter: unsigned int offset (position of the first item).
+// Parameter: unsigned int count (maximum number of items).
+//************************************
+string StockSystem::GetCataloguePage(unsigned int offset, unsigned int count) const {
+    STATS_TIME(METHOD_CATALOGUE_PAGE);
+    ostringstream strcatalogue;
+    CatalogueOptions options;
+    options.offset = offset;
+    options.limit = count;
+    WriteCatalogue(strcatalogue, options);
+    return strcatalogue.str();
+}
 
 
 
+//************************************
+// Method:    WriteCatalogue.
+// FullName:  StockSystem::WriteCatalogue.
+// Access:    public.
+// Returns:   bool (false if the stream failed).
+// Qualifier: const.
+// Desc:      Streams the catalogue to an ostream.
+// Parameter: ostream& out (the destination).
+// Parameter: const CatalogueOptions& options (rows to write).
+//************************************
+bool StockSystem::WriteCatalogue(ostream& out, const CatalogueOptions& options) const {
+    STATS_TIME(METHOD_WRITE_CATALOGUE);
+    CatalogueWriter writer(out);
+    return WriteCatalogueRows(writer, options);
+}
+
+
+
+//************************************
+// Method:    WriteCatalogue.
+// FullName:  StockSystem::WriteCatalogue.
+// Access:    public.
+// Returns:   bool (false if a write failed).
+// Qualifier: const.
+// Desc:      Streams the catalogue to a file descriptor.
+// Parameter: int fd (an open, writable descriptor).
+// Parameter: const CatalogueOptions& options (rows to write).
+//************************************
+bool StockSystem::WriteCatalogue(int fd, const CatalogueOptions& options) const {
+    STATS_TIME(METHOD_WRITE_CATALOGUE);
+    CatalogueWriter writer(fd);
+    return WriteCatalogueRows(writer, options);
+}
+
+
+
+//************************************
+// Method:    WriteCatalogueRows.
+// FullName:  StockSystem::WriteCatalogueRows.
+// Access:    private.
+// Returns:   bool (false if a write failed).
+// Qualifier: const.
+// Desc:      Writes the header and the selected rows. A
+//            window starting past the first row is found with
+//            Select (or the table bitmap) instead of walking
+//            the rows before it.
+// Parameter: CatalogueWriter& writer (the destination).
+// Parameter: const CatalogueOptions& options (rows to write).
+//************************************
+bool StockSystem::WriteCatalogueRows(CatalogueWriter& writer, const CatalogueOptions& options) const {
+    if (options.header) {
+        writer.WriteHeader();
+    }
+    if (options.offset == 0 && options.limit == UINT_MAX) {
+        ForEachItem([&](const StockItem& item) {
+            writer.WriteRow(item);
+        });
+    } else {
+        ForEachItemInPage(options.offset, options.limit, [&](const StockItem& item) {
+            writer.WriteRow(item);
+        });
+    }
+    return writer.Flush();
+}
+
+
+
+//************************************
+// Method:    InventoryValue.
+// FullName:  StockSystem::InventoryValue.
+// Access:    public.
+// Returns:   double.
+// Qualifier: const.
+// Desc:      Returns the total retail value of the stock on
+//            hand (sum of price * stock over the catalogue),
+//            computed over the columnar mirror.
+//************************************
+double StockSystem::InventoryValue() const {
+    STATS_TIME(METHOD_INVENTORY_VALUE);
+    return SumPriceTimesStock(columns.Prices(), columns.Stocks(), columns.Size());
+}
+
+
+
+//************************************
+// Method:    TotalUnits.
+// FullName:  StockSystem::TotalUnits.
+// Access:    public.
+// Returns:   long long.
+// Qualifier: const.
+// Desc:      Returns the number of units on hand over the
+//            whole catalogue.
+//************************************
+long long StockSystem::TotalUnits() const {
+    STATS_TIME(METHOD_TOTAL_UNITS);
+    return SumUnits(columns.Stocks(), columns.Size());
+}
+
+
+
+//************************************
+// Method:    CountBelow.
+// FullName:  StockSystem::CountBelow.
+// Access:    public.
+// Returns:   unsigned int.
+// Qualifier: const.
+// Desc:      Returns the number of SKUs with less than
+//            threshold units on hand (CountBelow(1) counts
+//            the SKUs that are out of stock).
+// Parameter: int threshold.
+//************************************
+unsigned int StockSystem::CountBelow(int threshold) const {
+    STATS_TIME(METHOD_COUNT_BELOW);
+    return ::CountBelow(columns.Stocks(), columns.Size(), threshold);
+}
+
+
+
+//************************************
+// Method:    RemoveAllItems.
+// FullName:  StockSystem::RemoveAllItems.
+// Access:    private.
+// Returns:   void.
+//************************************
+void StockSystem::RemoveAllItems() {
+    records.RemoveAll();
+    table.RemoveAll();
+    summarytree.RemoveAll();
+    versions.RemoveAll();
+    columns.RemoveAll();
+}
+
+
+
+//************************************
+// Method:    SaveSnapshot.
+// FullName:  StockSystem::SaveSnapshot.
+// Access:    public.
+// Returns:   bool (false if the file could not be written).
+// Qualifier: const.
+// Desc:      Writes every item, in SKU order, and the balance
+//            both exactly and in cents. Only one of balance and
+//            balancecents is kept up to date, depending on the
+//            threading mode, so both are saved from GetBalance;
+//            the exact value keeps the fractions of a cent a
+//            SINGLE_THREADED restock may leave. The
+//            journal's length counts its buffered records,
+//            which the catalogue already reflects. With the
+//            journal disabled, the position it had reached (or
+//            that the loaded snapshot or Recover reached) is
+//            saved instead, since the catalogue still holds its
+//            records.
+// Parameter: const string& path (the snapshot file).
+//************************************
+bool StockSystem::SaveSnapshot(const string& path) const {
+    STATS_TIME(METHOD_SAVE_SNAPSHOT);
+    SnapshotWriter writer;
+    if (!writer.Open(path)) {
+        return false;
+    }
+    ForEachItem([&](const StockItem& item) {
+        writer.Add(item);
+    });
+    double live = GetBalance();
+    if (journal.IsOpen()) {
+        return writer.Finish(llround(live * 100), live, journal.Generation(), journal.Length());
+    }
+    return writer.Finish(llround(live * 100), live, appliedgeneration, appliedbytes);
+}
+
+
+
+//************************************
+// Method:    BulkLoad.
+// FullName:  StockSystem::BulkLoad.
+// Access:    public.
+// Returns:   bool (false if the items are not in strictly
+//            ascending SKU order, TABLE_STORAGE has no slot
+//            for one of them, or the journal is enabled).
+// Desc:      The items are checked before anything is removed,
+//            then the engine in use is rebuilt in one pass and
+//            the columns are refilled.
+// Parameter: span<const StockItem> items (the new catalogue).
+//************************************
+bool StockSystem::BulkLoad(span<const StockItem> items) {
+    STATS_TIME(METHOD_BULK_LOAD);
+    if (journal.IsOpen()) {
+        return false;
+    }
+    for (size_t i = 1; i < items.size(); i++) {
+        if (items[i - 1].GetSKU() >= items[i].GetSKU()) {
+            return false;
+        }
+    }
+    if (storage == TABLE_STORAGE) {
+        for (const StockItem& item : items) {
+            if (!SkuTable::HasSlot(item.GetSKU())) {
+                return false;
+            }
+        }
+    }
+    RemoveAllItems();
+    if (storage == TABLE_STORAGE) {
+        for (const StockItem& item : items) {
+            table.Insert(item);
+            columns.Append(item);
+        }
+        return true;
+    }
+    if (storage == SUMMARY_TREE_STORAGE) {
+        summarytree.BuildFromSorted(items.begin(), items.end());
+    } else if (storage == VERSIONED_TREE_STORAGE) {
+        versions.BuildFromSorted(items.begin(), items.end());
+    } else {
+        records.BuildFromSorted(items.begin(), items.end());
+    }
+    for (const StockItem& item : items) {
+        columns.Append(item);
+    }
+    return true;
+}
+
+
+
+//************************************
+// Method:    LoadSnapshot.
+// FullName:  StockSystem::LoadSnapshot.
+// Access:    public.
+// Returns:   bool (false if the file is missing or invalid,
+//            or BulkLoad refuses its items).
+// Desc:      Maps and validates the snapshot, then bulk loads
+//            its records straight from the mapping. Both forms
+//            of the balance are set, so the snapshot loads into
+//            either threading mode, and a SINGLE_THREADED store
+//            gets its balance back exactly.
+// Parameter: const string& path (the snapshot file).
+//************************************
+bool StockSystem::LoadSnapshot(const string& path) {
+    STATS_TIME(METHOD_LOAD_SNAPSHOT);
+    uint64_t journalgeneration, journalbytes;
+    if (!LoadSnapshot(path, journalgeneration, journalbytes)) {
+        return false;
+    }
+    appliedgeneration = journalgeneration;
+    appliedbytes = journalbytes;
+    return true;
+}
+
+
+
+//************************************
+// Method:    LoadSnapshot.
+// FullName:  StockSystem::LoadSnapshot.
+// Access:    private.
+// Returns:   bool (false if the file is missing or invalid,
+//            or BulkLoad refuses its items).
+// Parameter: const string& path (the snapshot file).
+// Parameter: uint64_t& journalgeneration (set from the header).
+// Parameter: uint64_t& journalbytes (set from the header).
+//************************************
+bool StockSystem::LoadSnapshot(const string& path, uint64_t& journalgeneration, uint64_t& journalbytes) {
+    SnapshotReader reader;
+    if (journal.IsOpen() || !reader.Open(path)) {
+        return false;
+    }
+    if (!BulkLoad(span<const StockItem>(reader.Items(), reader.Header().count))) {
+        return false;
+    }
+    balancecents = reader.Header().balancecents;
+    balance = reader.Header().balance;
+    journalgeneration = reader.Header().journalgeneration;
+    journalbytes = reader.Header().journalbytes;
+    return true;
+}
+
+
+
+//************************************
+// Method:    EnableJournal.
+// FullName:  StockSystem::EnableJournal.
+// Access:    public.
+// Returns:   bool (false if the file cannot be opened, or in
+//            CONCURRENT_SALES mode).
+// Parameter: const string& path (the journal file).
+// Parameter: const JournalPolicy& policy (when records are synced).
+//************************************
+bool StockSystem::EnableJournal(const string& path, const JournalPolicy& policy) {
+    if (concurrency == CONCURRENT_SALES) {
+        return false;
+    }
+    return journal.Open(path, policy);
+}
+
+
+
+//************************************
+// Method:    DisableJournal.
+// FullName:  StockSystem::DisableJournal.
+// Access:    public.
+// Returns:   void.
+//************************************
+void StockSystem::DisableJournal() {
+    if (journal.IsOpen()) {
+        appliedgeneration = journal.Generation();
+        appliedbytes = journal.Length();
+    }
+    journal.Close();
+}
+
+
+
+//************************************
+// Method:    CommitJournal.
+// FullName:  StockSystem::CommitJournal.
+// Access:    public.
+// Returns:   bool (false if no journal is enabled or it failed).
+//************************************
+bool StockSystem::CommitJournal() {
+    STATS_TIME(METHOD_COMMIT_JOURNAL);
+    return journal.Commit();
+}
+
+
+
+//************************************
+// Method:    Checkpoint.
+// FullName:  StockSystem::Checkpoint.
+// Access:    public.
+// Returns:   bool (false if the snapshot could not be written,
+//            or the journal could not be emptied).
+// Desc:      The journal is only emptied once the snapshot
+//            has been synced and renamed into place. A crash
+//            between the two steps leaves records that the new
+//            snapshot already holds, but the snapshot names the
+//            journal's generation and length, so Recover skips
+//            them. The same goes if the truncate fails.
+// Parameter: const string& snapshotpath (the snapshot file).
+//************************************
+bool StockSystem::Checkpoint(const string& snapshotpath) {
+    STATS_TIME(METHOD_CHECKPOINT);
+    if (!SaveSnapshot(snapshotpath)) {
+        return false;
+    }
+    return !journal.IsOpen() || journal.Truncate();
+}
+
+
+
+//************************************
+// Method:    Recover.
+// FullName:  StockSystem::Recover.
+// Access:    public.
+// Returns:   bool (false if the journal is enabled, or a file
+//            exists but cannot be read).
+// Desc:      Replays the journal through the public calls, so
+//            each change is made exactly as it was the first
+//            time. If the journal has the generation the
+//            snapshot was saved with, its records up to the
+//            saved length are already in the snapshot and are
+//            skipped; a journal of another generation was
+//            started after it and is replayed in full (the
+//            snapshot names the last journal it holds even if
+//            it was saved with the journal disabled). Replay
+//            stops at the first record that is torn or fails
+//            its checksum; the file is cut there so later
+//            records are not appended after garbage.
+// Parameter: const string& journalpath (the journal file).
+// Parameter: const string& snapshotpath (the last checkpoint).
+//************************************
+bool StockSystem::Recover(const string& journalpath, const string& snapshotpath) {
+    STATS_TIME(METHOD_RECOVER);
+    if (journal.IsOpen()) {
+        return false;
+    }
+    struct stat info;
+    uint64_t journalgeneration = 0, journalbytes = 0;
+    if (stat(snapshotpath.c_str(), &info) == 0) {
+        if (!LoadSnapshot(snapshotpath, journalgeneration, journalbytes)) {
+            return false;
+        }
+    } else {
+        RemoveAllItems(); // No checkpoint yet, the journal holds every change.
+        balance = 100000.00;
+        balancecents = 10000000;
+    }
+
+    JournalReader reader;
+    if (!reader.Open(journalpath)) {
+        return false;
+    }
+    bool sameJournal = reader.Generation() == journalgeneration;
+    JournalEntry entry;
+    while (reader.Next(entry)) {
+        if (sameJournal && reader.ValidBytes() <= journalbytes) {
+            continue; // Already in the snapshot.
+        }
+        switch (entry.code) {
+            case JOURNAL_NEW_ITEM:
+                StockNewItem(entry.item);
+                break;
+            case JOURNAL_EDIT_DESCRIPTION:
+                EditStockItemDescription(entry.itemsku, entry.description);
+                break;
+            case JOURNAL_EDIT_PRICE:
+                EditStockItemPrice(entry.itemsku, entry.price);
+                break;
+            case JOURNAL_RESTOCK:
+                Restock(entry.itemsku, entry.quantity, entry.price);
+                break;
+            case JOURNAL_SELL:
+                Sell(entry.itemsku, entry.quantity);
+                break;
+        }
+    }
+    if (reader.Generation() != 0) { // The catalogue now holds this journal up to there.
+        appliedgeneration = reader.Generation();
+        appliedbytes = reader.ValidBytes();
+    } else {
+        appliedgeneration = journalgeneration;
+        appliedbytes = journalbytes;
+    }
+    if (stat(journalpath.c_str(), &info) == 0 && (size_t) info.st_size > reader.ValidBytes()) {
+        return truncate(journalpath.c_str(), reader.ValidBytes()) == 0;
+    }
+    return true;
+}
+
+
+
+//************************************
+// Method:    Snapshot.
+// FullName:  StockSystem::Snapshot.
+// Access:    public.
+// Returns:   CatalogueView (the catalogue and balance as they are now).
+// Desc:      With VERSIONED_TREE_STORAGE the view takes another
+//            reference to the current version, O(1). The other
+//            engines write to their items in place, so their
+//            catalogue is copied into a new version, O(n).
+//************************************
+CatalogueView StockSystem::Snapshot() {
+    STATS_TIME(METHOD_SNAPSHOT);
+    if (storage == VERSIONED_TREE_STORAGE) {
+        return CatalogueView(versions, GetBalance());
+    }
+    vector<StockItem> items;
+    items.reserve(columns.Size());
+    ForEachItem([&](const StockItem& item) {
+        items.push_back(item);
+    });
+    StockVersionTree copy;
+    copy.BuildFromSorted(items.begin(), items.end());
+    return CatalogueView(copy, GetBalance());
+}
+
+
+
+//************************************
+// Method:    Stats.
+// FullName:  StockSystem::Stats.
+// Access:    public.
+// Returns:   StockStats (a snapshot of the counters).
+// Qualifier: static.
+//************************************
+StockStats StockSystem::Stats() {
+    StockStats stats;
+    CollectStockStats(stats);
+    return stats;
+}
+
+
+
+//************************************
+// Method:    ResetStats.
+// FullName:  StockSystem::ResetStats.
+// Access:    public.
+// Returns:   void.
+// Qualifier: static.
+//************************************
+void StockSystem::ResetStats() {
+    ResetStockStats();
+}
+
+
+
+//************************************
+// Method:    CatalogueView.
+// FullName:  CatalogueView::CatalogueView.
+// Access:    public.
+// Qualifier: : items(catalogue), balance(bank).
+// Desc:      Constructor, O(1).
+// Parameter: const StockVersionTree& catalogue (the version to hold).
+// Parameter: double bank (the balance at that version).
+//************************************
+CatalogueView::CatalogueView(const StockVersionTree& catalogue, double bank) : items(catalogue), balance(bank) {
+}
+
+
+
+//************************************
+// Method:    GetBalance.
+// FullName:  CatalogueView::GetBalance.
+// Access:    public.
+// Returns:   double.
+// Qualifier: const.
+//************************************
+double CatalogueView::GetBalance() const {
+    return balance;
+}
+
+
+
+//************************************
+// Method:    Size.
+// FullName:  CatalogueView::Size.
+// Access:    public.
+// Returns:   unsigned int.
+// Qualifier: const.
+//************************************
+unsigned int CatalogueView::Size() const {
+    return items.Size();
+}
+
+
+
+//************************************
+// Method:    InventoryValue.
+// FullName:  CatalogueView::InventoryValue.
+// Access:    public.
+// Returns:   double.
+// Qualifier: const.
+// Desc:      Read from the sums at the root.
+//************************************
+double CatalogueView::InventoryValue() const {
+    return items.Total().value;
+}
+
+
+
+//************************************
+// Method:    TotalUnits.
+// FullName:  CatalogueView::TotalUnits.
+// Access:    public.
+// Returns:   long long.
+// Qualifier: const.
+// Desc:      Read from the sums at the root.
+//************************************
+long long CatalogueView::TotalUnits() const {
+    return items.Total().units;
+}
+
+
+
+//************************************
+// Method:    GetRangeSummary.
+// FullName:  CatalogueView::GetRangeSummary.
+// Access:    public.
+// Returns:   StockSummary (units and value of the range).
+// Qualifier: const.
+// Parameter: unsigned int lo (smallest SKU to include).
+// Parameter: unsigned int hi (largest SKU to include).
+//************************************
+StockSummary CatalogueView::GetRangeSummary(unsigned int lo, unsigned int hi) const {
+    int first, last;
+    if (!StockSystem::ClampSKURange(lo, hi, first, last)) {
+        return StockSummary();
+    }
+    return items.RangeSummary(first, last);
+}
+
+
+
+//************************************
+// Method:    GetCatalogue.
+// FullName:  CatalogueView::GetCatalogue.
+// Access:    public.
+// Returns:   string (the header line followed by one line per item).
+// Qualifier: const.
+//************************************
+string CatalogueView::GetCatalogue() const {
+    ostringstream strcatalogue;
+    WriteCatalogue(strcatalogue);
+    return strcatalogue.str();
+}
+
+
+
+//************************************
+// Method:    WriteCatalogue.
+// FullName:  CatalogueView::WriteCatalogue.
+// Access:    public.
+// Returns:   bool (false if the stream failed).
+// Qualifier: const.
+// Desc:      Streams the catalogue of the view, in the
+//            format of StockSystem::WriteCatalogue.
+// Parameter: ostream& out (the destination).
+// Parameter: const CatalogueOptions& options (rows to write).
+//************************************
+bool CatalogueView::WriteCatalogue(ostream& out, const CatalogueOptions& options) const {
+    CatalogueWriter writer(out);
+    if (options.header) {
+        writer.WriteHeader();
+    }
+    items.ForEachInPage(options.offset, options.limit, [&](const StockItem& item) {
+        writer.WriteRow(item);
+    });
+    return writer.Flush();
+}
@@ -4,31 +4,223 @@
 
 #pragma once
 
+#include <limits.h>
 #include <math.h>
+#include <span>
 #include <sstream>
+#include <vector>
 
 #include "stockitem.h"
 #include "redblacktree.h"
+#include "persistenttree.h"
+#include "skutable.h"
+#include "stockcolumns.h"
+#include "cataloguewriter.h"
+#include "stockjournal.h"
+#include "stockstats.h"
+
+// The catalogue tree, keyed by SKU so items can be looked up by SKU number alone.
+// Its nodes come from a pool owned by the tree, so loading
+//   and churning many SKUs does not go through the general purpose allocator.
+typedef RedBlackTree<StockItem, SkuKeyOf, PoolNodeAllocator<Node<StockItem> > > StockRecordTree;
+
+// Units on hand and their retail value, summed over a set of items.
+// Every node of a StockSummaryTree keeps the StockSummary of its subtree.
+struct StockSummary {
+    long long units;
+    double value; // sum of price * stock
+
+    StockSummary() : units(0), value(0) {
+    }
+
+    void Add(const StockItem& item) {
+        units += item.GetStock();
+        value += item.GetPrice() * item.GetStock();
+    }
+
+    void Add(const StockSummary& summary) {
+        units += summary.units;
+        value += summary.value;
+    }
+};
+
+// The catalogue tree of SUMMARY_TREE_STORAGE, a StockRecordTree whose nodes
+//   also sum the units and value of their subtree.
+typedef RedBlackTree<StockItem, SkuKeyOf, PoolNodeAllocator<Node<StockItem> >, StockSummary> StockSummaryTree;
+
+// The catalogue of VERSIONED_TREE_STORAGE, and of every CatalogueView: a
+//   persistent tree whose versions share their unchanged nodes, also summing
+//   the units and value of every subtree.
+typedef PersistentTree<StockItem, SkuKeyOf, StockSummary> StockVersionTree;
+
+// Storage engines for the catalogue
+enum StockStorage {
+    TREE_STORAGE, // red-black tree of items (the records)
+    TABLE_STORAGE, // direct-indexed SkuTable, O(1) lookups
+    SUMMARY_TREE_STORAGE, // red-black tree with subtree sums (summarytree), O(log n) GetRangeSummary
+    VERSIONED_TREE_STORAGE // persistent tree with subtree sums (versions), O(1) Snapshot
+};
+
+// Threading modes
+enum StockConcurrency {
+    SINGLE_THREADED, // one thread at a time, balance kept as a double
+    CONCURRENT_SALES // Sell/Restock/EditStockItemPrice from many threads, balance kept in cents
+};
+
+// Operations accepted by StockSystem::ApplyBatch
+enum StockOpCode {
+    SELL_OP, // Sell(itemsku, quantity)
+    RESTOCK_OP, // Restock(itemsku, quantity, price)
+    EDIT_PRICE_OP // EditStockItemPrice(itemsku, price)
+};
+
+// Which part of the catalogue StockSystem::WriteCatalogue writes
+struct CatalogueOptions {
+    unsigned int offset; // number of rows skipped (in SKU order)
+    unsigned int limit; // maximum number of rows written
+    bool header; // write the column header line first
+
+    CatalogueOptions() : offset(0), limit(UINT_MAX), header(true) {
+    }
+};
+
+struct StockOperation {
+    StockOpCode code;
+    unsigned int itemsku;
+    unsigned int quantity; // unused by EDIT_PRICE_OP
+    double price; // unit price for RESTOCK_OP, retail price for EDIT_PRICE_OP
+};
+
+class CatalogueView;
 
 class StockSystem {
 private:
-    RedBlackTree<StockItem> records;
+    StockStorage storage; // which of records, table and summarytree holds the catalogue
+    StockRecordTree records;
+    SkuTable table;
+    StockSummaryTree summarytree;
+    StockVersionTree versions;
+    StockColumns columns; // SKU, price and stock of every item, kept in sync by the mutators
+    StockConcurrency concurrency;
     double balance; // how much money you have in the bank
+    long long balancecents; // the balance in CONCURRENT_SALES mode, in cents, only accessed atomically
+    StockJournal journal; // write-ahead journal of the successful changes, closed unless enabled
+    // While the journal is closed, the generation and length of the journal whose
+    //   records the catalogue already holds (set by DisableJournal, LoadSnapshot
+    //   and Recover), which SaveSnapshot records in place of the open journal's.
+    uint64_t appliedgeneration;
+    uint64_t appliedbytes;
+
+    // Locates the item with key itemsku in the storage engine in use.
+    // Returns NULL if itemsku is not found.
+    // The stock and price of a summarytree item must not be changed through
+    //   the returned pointer, and a versions item not at all (its node may
+    //   belong to a CatalogueView); use WithItem for that.
+    StockItem* FindItem(unsigned int itemsku);
+
+    // Returns body(item) for the item with key itemsku (NULL if not found).
+    // With SUMMARY_TREE_STORAGE the item is changed through
+    //   RedBlackTree::Update, which refreshes the sums on its path, and with
+    //   VERSIONED_TREE_STORAGE through PersistentTree::Update, which changes
+    //   a new copy of the item.
+    template <class F>
+    bool WithItem(unsigned int itemsku, F body) {
+        if (storage == SUMMARY_TREE_STORAGE || storage == VERSIONED_TREE_STORAGE) {
+            bool result = false;
+            auto change = [&](StockItem& item) { result = body(&item); };
+            if (storage == SUMMARY_TREE_STORAGE ? summarytree.Update(itemsku, change) : versions.Update(itemsku, change)) {
+                return result;
+            }
+            return body(NULL);
+        }
+        return body(FindItem(itemsku));
+    }
+
+    // Clamps [lo, hi] to the 5 digit SKUs into [first, last].
+    // Returns false if no 5 digit SKU is left in the range.
+    static bool ClampSKURange(unsigned int lo, unsigned int hi, int& first, int& last);
+
+    // Visits at most count items of tree, starting at position offset.
+    template <class Tree, class F>
+    static void ForEachInPage(const Tree& tree, unsigned int offset, unsigned int count, F visit) {
+        typename Tree::const_iterator it = tree.Select(offset);
+        for (; count > 0 && it != tree.end(); --count, ++it) {
+            visit(*it);
+        }
+    }
+
+    // Bodies of EditStockItemPrice, Restock and Sell, once the item is found.
+    // searchData is NULL if the SKU does not exist.
+    bool EditItemPrice(StockItem* searchData, double retailprice);
+    bool RestockItem(StockItem* searchData, unsigned int quantity, double unitprice);
+    bool SellItem(StockItem* searchData, unsigned int quantity);
+
+    // CONCURRENT_SALES versions of the bodies above, built on atomic updates
+    //   of the item's stock and of balancecents.
+    bool EditItemPriceConcurrent(StockItem* searchData, double retailprice);
+    bool RestockItemConcurrent(StockItem* searchData, unsigned int quantity, double unitprice);
+    bool SellItemConcurrent(StockItem* searchData, unsigned int quantity);
+
+    // Empties the catalogue of every storage engine and the columns.
+    void RemoveAllItems();
+
+    // Body of LoadSnapshot, also returning the position of the journal the
+    //   snapshot was saved with (see SnapshotHeader).
+    bool LoadSnapshot(const string& path, uint64_t& journalgeneration, uint64_t& journalbytes);
+
+    // Body of WriteCatalogue, once the destination is chosen.
+    bool WriteCatalogueRows(CatalogueWriter& writer, const CatalogueOptions& options) const;
+
+    // Scratch space reused by ApplyBatch, left empty between calls so copies
+    //   have nothing to copy
+    vector<uint64_t> batchorder; // normalised SKU (high half) and position in batch (low half), sorted
+    vector<int> batchkeys; // sorted SKUs
+    vector<StockItem*> batchfound; // item of each sorted SKU
+    vector<StockItem*> batchitems; // item of each operation, in batch order
+
+    friend class CatalogueView; // shares ClampSKURange
 
 public:
     // default constructor;
     // begin with a balance of $100,000.00
-    StockSystem();
+    // The catalogue is kept in the records tree unless another storage engine is chosen.
+    // In CONCURRENT_SALES mode, Sell, Restock, EditStockItemPrice and GetBalance may be
+    //   called from any number of threads at once without a lock, as long as no other
+    //   member function runs at the same time (those still need exclusive access).
+    //   The per-item stock is then updated with compare-and-swap, and the balance is
+    //   kept as a fixed-point number of cents (each transaction is rounded to the cent).
+    // SUMMARY_TREE_STORAGE and VERSIONED_TREE_STORAGE are always SINGLE_THREADED,
+    //   since every change of an item also rewrites the sums of all its ancestors.
+    StockSystem(StockStorage engine = TREE_STORAGE, StockConcurrency mode = SINGLE_THREADED);
+
+    // returns the threading mode
+    StockConcurrency GetConcurrency() const;
+
+    // Copies of a StockSystem (e.g. to write a consistent report while the store
+    //   keeps trading) clone the catalogue tree in O(n). With copy-on-write on,
+    //   a copy shares the tree with the original instead, and whichever of them
+    //   changes the catalogue first clones it then (see
+    //   RedBlackTree::SetCopyOnWrite). The columns and the table of
+    //   TABLE_STORAGE are shared and cloned on first change the same way, so
+    //   the copy itself takes O(1).
+    // Not available in CONCURRENT_SALES mode, where the first change could
+    //   come from several threads at once; return false there.
+    bool SetCopyOnWrite(bool enable);
+
+    // returns the storage engine holding the catalogue
+    StockStorage GetStorage() const;
 
     // returns the balance member
-    double GetBalance();
+    double GetBalance() const;
 
     // Add a new SKU to the system. Do not allow insertion of duplicate sku
-    bool StockNewItem(StockItem item);
+    // The rvalue overload moves the item into the catalogue without copies.
+    bool StockNewItem(const StockItem& item);
+    bool StockNewItem(StockItem&& item);
 
     // Locate the item with key itemsku and update its description field.
     // Return false if itemsku is not found.
-    bool EditStockItemDescription(unsigned int itemsku, string desc);
+    bool EditStockItemDescription(unsigned int itemsku, string_view desc);
 
     // Locate the item with key itemsku and update its description field.
     // Return false if itemsku is not found or retailprice is negative.
@@ -47,32 +239,231 @@ public:
     // If no stock, sku does not exist, or quantity is negative, return false.
     bool Sell(unsigned int itemsku, unsigned int quantity);
 
+    // Applies a batch of Sell/Restock/EditStockItemPrice operations.
+    // results[i] receives the value the corresponding single call would have
+    //   returned; results must hold at least ops.size() entries.
+    // The operations take effect in batch order, but every SKU of the batch is
+    //   located in a single pass over the catalogue.
+    // Not to be called concurrently, even in CONCURRENT_SALES mode.
+    void ApplyBatch(span<const StockOperation> ops, span<bool> results);
+
+    // Store-wide figures, computed with vectorized kernels over the columnar mirror.
+    // total retail value of the stock on hand (sum of price * stock)
+    double InventoryValue() const;
+
+    // total number of units on hand
+    long long TotalUnits() const;
+
+    // number of SKUs with less than threshold units on hand
+    unsigned int CountBelow(int threshold) const;
+
+    // units on hand and their retail value over the SKUs in [lo, hi]
+    // O(log n) with SUMMARY_TREE_STORAGE, otherwise the range is scanned.
+    StockSummary GetRangeSummary(unsigned int lo, unsigned int hi) const;
+
+    // Calls visit(item) for every catalogue item in SKU order.
+    // The items are visited in place in whichever storage engine is used.
+    template <class F>
+    void ForEachItem(F visit) const {
+        if (storage == TABLE_STORAGE) {
+            table.ForEach(visit);
+        } else if (storage == SUMMARY_TREE_STORAGE) {
+            summarytree.ForEach(visit);
+        } else if (storage == VERSIONED_TREE_STORAGE) {
+            versions.ForEach(visit);
+        } else {
+            records.ForEach(visit);
+        }
+    }
+
+    // Calls visit(item) for every catalogue item with lo <= SKU <= hi, in SKU order.
+    // Only 5 digit SKUs are reported, the bounds are clamped to [SKU_MIN, SKU_MAX].
+    template <class F>
+    void ForEachItemInRange(unsigned int lo, unsigned int hi, F visit) const {
+        int first, last;
+        if (!ClampSKURange(lo, hi, first, last)) {
+            return;
+        }
+        if (storage == TABLE_STORAGE) {
+            table.ForEachInRange(first, last, visit);
+        } else if (storage == SUMMARY_TREE_STORAGE) {
+            summarytree.Range(first, last, visit);
+        } else if (storage == VERSIONED_TREE_STORAGE) {
+            versions.Range(first, last, visit);
+        } else {
+            records.Range(first, last, visit); // Already 5 digits, so SkuKeyOf leaves them as they are.
+        }
+    }
+
+    // Calls visit(item) for at most count catalogue items in SKU order, starting
+    //   with the offset-th item (0 based).
+    template <class F>
+    void ForEachItemInPage(unsigned int offset, unsigned int count, F visit) const {
+        if (storage == TABLE_STORAGE) {
+            table.ForEachInPage(offset, count, visit);
+        } else if (storage == SUMMARY_TREE_STORAGE) {
+            ForEachInPage(summarytree, offset, count, visit);
+        } else if (storage == VERSIONED_TREE_STORAGE) {
+            versions.ForEachInPage(offset, count, visit);
+        } else {
+            ForEachInPage(records, offset, count, visit);
+        }
+    }
+
     // Return a formatted string containing complete stock catalogue information in the following format:
     // <sku> <description> <quantity> <price> <newline>
 
-    string GetCatalogue() {
+    string GetCatalogue() const {
         ostringstream strcatalogue;
-        int desclengthdiff;
-
-        int cataloguesize = 0; // create a variable which will be modified by tree's Dump function
-        StockItem* catalogue = records.Dump(cataloguesize);
-        strcatalogue << "SKU\tDESCRIPTION\t\t\tQTY\tPRICE\n";
-        for (int i = 0; i < cataloguesize; i++) {
-            strcatalogue << catalogue[i].GetSKU() << "\t" << catalogue[i].GetDescription();
-            // pad description to fill to next column. Tab width is up to 8 characters
-            desclengthdiff = 32 - catalogue[i].GetDescription().length();
-            for (int j = 0; j < ceil((double) desclengthdiff / 8); j++)
-                strcatalogue << "\t";
-            strcatalogue << catalogue[i].GetStock() << "\t$" << catalogue[i].GetPrice() << "\n";
-        }
+        WriteCatalogue(strcatalogue);
         return strcatalogue.str();
     }
 
+    // Streams the catalogue, in the format of GetCatalogue, without building it
+    //   in memory first: rows are formatted into a fixed buffer straight from
+    //   an in-order walk. options selects a window of rows (all by default).
+    // Return false if writing to the destination failed.
+    bool WriteCatalogue(ostream& out, const CatalogueOptions& options = CatalogueOptions()) const;
+    bool WriteCatalogue(int fd, const CatalogueOptions& options = CatalogueOptions()) const;
+
+    // GetCatalogue restricted to the SKUs in [lo, hi], e.g. one department's block.
+    // Costs O(log n + k) for k reported items with the tree.
+    string GetCatalogueRange(unsigned int lo, unsigned int hi) const;
+
+    // GetCatalogue restricted to count items starting at position offset
+    //   (0 based, in SKU order), e.g. one page of a front end listing.
+    // Costs O(log n + count) with the tree.
+    string GetCataloguePage(unsigned int offset, unsigned int count) const;
+
+    // Replaces the catalogue with items, e.g. a snapshot, an import or a supplier
+    //   feed. The items keep their SKU, stock and price as they are, and must be
+    //   in strictly ascending SKU order. The balance is not changed.
+    // The trees are built in O(n) (see RedBlackTree::BuildFromSorted) instead of
+    //   n insertions.
+    // Return false and leave the system unchanged if the items are not sorted,
+    //   contain a duplicate SKU, hold a SKU TABLE_STORAGE has no slot for (see
+    //   SkuTable::HasSlot) while it is in use, or the journal is enabled (the
+    //   load is not journalled: disable the journal, load, then Checkpoint).
+    bool BulkLoad(span<const StockItem> items);
+
+    // Saves the catalogue and balance to a binary snapshot file (see stocksnapshot.h),
+    //   with the position the enabled journal has reached (or, with the journal
+    //   disabled, the last position the catalogue holds), so that Recover does
+    //   not replay the changes the snapshot already holds.
+    // The file is replaced atomically. Return false if it could not be written.
+    bool SaveSnapshot(const string& path) const;
+
+    // Replaces the catalogue and balance with those of a snapshot file.
+    // The file is mapped and checked in full first; if it is missing or invalid,
+    //   or BulkLoad refuses its items, return false and leave the system
+    //   unchanged.
+    bool LoadSnapshot(const string& path);
+
+    // Starts recording every successful StockNewItem, EditStockItemDescription,
+    //   EditStockItemPrice, Restock and Sell (also from ApplyBatch) in the journal
+    //   file at path, appending to it. policy sets how records are grouped into
+    //   one fdatasync (see stockjournal.h).
+    // Return false if the file cannot be opened, or in CONCURRENT_SALES mode,
+    //   whose concurrent calls have no single order to record.
+    bool EnableJournal(const string& path, const JournalPolicy& policy = JournalPolicy());
+
+    // commits the pending records and stops journalling, remembering how far
+    //   the journal went for the snapshots saved until it is enabled again
+    void DisableJournal();
+
+    // Makes every change recorded so far durable, e.g. when the system goes idle.
+    // Return false if no journal is enabled or it could not be written.
+    bool CommitJournal();
+
+    // Saves a snapshot to snapshotpath, then empties the enabled journal, whose
+    //   changes the snapshot now holds.
+    // Return false if the snapshot could not be written (the journal is kept),
+    //   or the journal could not be emptied.
+    bool Checkpoint(const string& snapshotpath);
+
+    // Rebuilds the state left by a crash: loads the snapshot at snapshotpath
+    //   (starting from an empty catalogue if there is none), then replays the
+    //   journal at journalpath on top of it, skipping the records the snapshot
+    //   already holds. A torn or corrupt record ends the replay, and the
+    //   journal file is cut back to the records before it.
+    // Call before EnableJournal; return false if the journal is enabled, or if
+    //   either file exists but cannot be read.
+    bool Recover(const string& journalpath, const string& snapshotpath);
+
+    // Returns a read-only view of the catalogue and balance as they are now.
+    // With VERSIONED_TREE_STORAGE it costs O(1): the view holds the current
+    //   version of the tree, and later changes copy the O(log n) nodes on their
+    //   path instead of writing to nodes the view can see. Other engines copy
+    //   the catalogue into a new version in O(n).
+    CatalogueView Snapshot();
+
+    // Returns the instrumentation counters (see stockstats.h): the RedBlackTree
+    //   descent, rotation and fix-up counts and the latency histogram of each
+    //   public call, merged over every thread. They are process-wide, summed
+    //   over all StockSystems. Without STOCK_STATS in the build, nothing is
+    //   counted and the snapshot has enabled false and all counts 0.
+    // Safe to call while other threads trade; StockStats::Write dumps it.
+    static StockStats Stats();
+
+    // zeroes the instrumentation counters, e.g. between benchmark phases
+    static void ResetStats();
+
     // Provides access to internal RedBlackTree.
+    // It is empty unless the catalogue uses TREE_STORAGE.
     // Used for grading.
     // Note that this is dangerous in practice!
 
-    RedBlackTree<StockItem>& GetRecords() {
+    StockRecordTree& GetRecords() {
         return records;
     }
-};
\ No newline at end of file
+};
+
+// A read-only, point-in-time view of a StockSystem (see StockSystem::Snapshot).
+// It holds its own version of the catalogue, so it never changes and stays
+//   valid after the StockSystem changes or is destroyed. It may be read on
+//   another thread while the StockSystem keeps trading, without any lock.
+class CatalogueView {
+private:
+    StockVersionTree items;
+    double balance;
+
+public:
+    // view of catalogue, with balance as its balance
+    CatalogueView(const StockVersionTree& catalogue, double bank);
+
+    // the balance at the time of the snapshot
+    double GetBalance() const;
+
+    // number of items in the catalogue
+    unsigned int Size() const;
+
+    // total retail value and number of units on hand, O(1)
+    // The value is summed over the items in SKU order, so it may differ from
+    //   StockSystem::InventoryValue in the last bits.
+    double InventoryValue() const;
+    long long TotalUnits() const;
+
+    // units on hand and their retail value over the SKUs in [lo, hi], O(log n)
+    StockSummary GetRangeSummary(unsigned int lo, unsigned int hi) const;
+
+    // Calls visit(item) for every catalogue item in SKU order.
+    template <class F>
+    void ForEachItem(F visit) const {
+        items.ForEach(visit);
+    }
+
+    // Calls visit(item) for every item with lo <= SKU <= hi, as StockSystem::ForEachItemInRange.
+    template <class F>
+    void ForEachItemInRange(unsigned int lo, unsigned int hi, F visit) const {
+        int first, last;
+        if (StockSystem::ClampSKURange(lo, hi, first, last)) {
+            items.Range(first, last, visit);
+        }
+    }
+
+    // the catalogue text, as StockSystem::GetCatalogue
+    string GetCatalogue() const;
+
+    // as StockSystem::WriteCatalogue
+    bool WriteCatalogue(ostream& out, const CatalogueOptions& options = CatalogueOptions()) const;
+};
@@ -0,0 +1,482 @@
+// File:        stocktrace.cpp
+// Date:        2026-10-17
+// Description: Implementation of the StockTraceRecorder and TraceReader classes
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stocktrace.h"
+
+static_assert(sizeof(TraceHeader) == 16, "unexpected TraceHeader padding");
+static_assert(sizeof(TraceRecord) == 88, "TraceRecord layout changed, bump TRACE_VERSION");
+
+//************************************
+// Method:    TraceDigest.
+// FullName:  TraceDigest.
+// Access:    public.
+// Returns:   uint64_t.
+// Parameter: string_view text (the catalogue text).
+//************************************
+uint64_t TraceDigest(string_view text) {
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : text) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+
+
+//************************************
+// Method:    ReplayTraceRecord.
+// FullName:  ReplayTraceRecord.
+// Access:    public.
+// Returns:   void.
+// Desc:      Makes the recorded call with the recorded
+//            arguments. A new item is rebuilt from its bytes,
+//            so its SKU is not normalised a second time.
+// Parameter: StockSystem& store (the store to call).
+// Parameter: const TraceRecord& record (the call).
+// Parameter: TraceRecord& result (receives the call and its results).
+//************************************
+void ReplayTraceRecord(StockSystem& store, const TraceRecord& record, TraceRecord& result) {
+    result = record;
+    result.status = 0;
+    result.cataloguelength = 0;
+    result.cataloguedigest = 0;
+    switch (record.code) {
+        case TRACE_NEW_ITEM: {
+            StockItem item;
+            memcpy((void*) &item, record.payload, sizeof(StockItem));
+            result.status = store.StockNewItem(item);
+            break;
+        }
+        case TRACE_EDIT_DESCRIPTION:
+            result.status = store.EditStockItemDescription(record.itemsku, string_view((const char*) record.payload, record.desclength));
+            break;
+        case TRACE_EDIT_PRICE:
+            result.status = store.EditStockItemPrice(record.itemsku, record.price);
+            break;
+        case TRACE_RESTOCK:
+            result.status = store.Restock(record.itemsku, record.quantity, record.price);
+            break;
+        case TRACE_SELL:
+            result.status = store.Sell(record.itemsku, record.quantity);
+            break;
+        case TRACE_GET_CATALOGUE: {
+            string catalogue = store.GetCatalogue();
+            result.status = 1;
+            result.cataloguelength = (uint32_t) catalogue.length();
+            result.cataloguedigest = TraceDigest(catalogue);
+            break;
+        }
+    }
+    result.balance = store.GetBalance();
+}
+
+
+
+//************************************
+// Method:    SameTraceResult.
+// FullName:  SameTraceResult.
+// Access:    public.
+// Returns:   bool.
+// Desc:      Compares the bytes of the result fields, so a
+//            balance off in its last bit is a difference.
+//            Catalogues are compared by length and digest.
+// Parameter: const TraceRecord& expected (the recorded call).
+// Parameter: const TraceRecord& actual (the replayed call).
+//************************************
+bool SameTraceResult(const TraceRecord& expected, const TraceRecord& actual) {
+    return expected.status == actual.status && memcmp(&expected.balance, &actual.balance, sizeof(double)) == 0
+        && expected.cataloguelength == actual.cataloguelength && expected.cataloguedigest == actual.cataloguedigest;
+}
+
+
+
+//************************************
+// Method:    StockTraceRecorder.
+// FullName:  StockTraceRecorder::StockTraceRecorder.
+// Access:    public.
+// Qualifier: : store(mystore), fd(-1), used(0), failed(false).
+// Parameter: StockSystem& mystore (the store to call).
+//************************************
+StockTraceRecorder::StockTraceRecorder(StockSystem& mystore) : store(mystore), fd(-1), used(0), failed(false) {
+}
+
+
+
+//************************************
+// Method:    ~StockTraceRecorder.
+// FullName:  StockTraceRecorder::~StockTraceRecorder.
+// Access:    public.
+//************************************
+StockTraceRecorder::~StockTraceRecorder() {
+    Close();
+}
+
+
+
+//************************************
+// Method:    Open.
+// FullName:  StockTraceRecorder::Open.
+// Access:    public.
+// Returns:   bool (false if the file cannot be created).
+// Desc:      Closes any trace being recorded, then creates
+//            the new one and writes its header.
+// Parameter: const string& path (the trace file).
+//************************************
+bool StockTraceRecorder::Open(const string& path) {
+    Close();
+    lock_guard<mutex> guard(tracelock);
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    TraceHeader header;
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.recordsize = sizeof(TraceRecord);
+    used = 0;
+    failed = write(fd, &header, sizeof(header)) != (ssize_t) sizeof(header);
+    return !failed;
+}
+
+
+
+//************************************
+// Method:    Close.
+// FullName:  StockTraceRecorder::Close.
+// Access:    public.
+// Returns:   bool (false if a write failed).
+//************************************
+bool StockTraceRecorder::Close() {
+    if (fd < 0) {
+        return true;
+    }
+    lock_guard<mutex> guard(tracelock);
+    Flush();
+    if (close(fd) != 0) {
+        failed = true;
+    }
+    fd = -1;
+    return !failed;
+}
+
+
+
+//************************************
+// Method:    Flush.
+// FullName:  StockTraceRecorder::Flush.
+// Access:    private.
+// Returns:   void.
+// Desc:      Writes the buffered records, calling write again
+//            after a short or interrupted write. Called with
+//            tracelock held, as NewRecord and Finish.
+//************************************
+void StockTraceRecorder::Flush() {
+    const char* data = (const char*) buffer;
+    size_t bytes = used * sizeof(TraceRecord);
+    size_t written = 0;
+    while (!failed && written < bytes) {
+        ssize_t n = write(fd, data + written, bytes - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            failed = true;
+            break;
+        }
+        written += n;
+    }
+    used = 0;
+}
+
+
+
+//************************************
+// Method:    NewRecord.
+// FullName:  StockTraceRecorder::NewRecord.
+// Access:    private.
+// Returns:   TraceRecord& (the next free record of the buffer).
+// Parameter: TraceOpCode code (the call).
+// Parameter: unsigned int itemsku (its SKU argument, 0 if none).
+//************************************
+TraceRecord& StockTraceRecorder::NewRecord(TraceOpCode code, unsigned int itemsku) {
+    TraceRecord& record = buffer[used];
+    memset(&record, 0, sizeof(TraceRecord));
+    record.code = code;
+    record.itemsku = itemsku;
+    return record;
+}
+
+
+
+//************************************
+// Method:    Finish.
+// FullName:  StockTraceRecorder::Finish.
+// Access:    private.
+// Returns:   void.
+// Parameter: TraceRecord& record (the record from NewRecord).
+// Parameter: bool status (what the call returned).
+//************************************
+void StockTraceRecorder::Finish(TraceRecord& record, bool status) {
+    record.status = status;
+    record.balance = store.GetBalance();
+    if (++used == TRACE_BUFFER_RECORDS) {
+        Flush();
+    }
+}
+
+
+
+//************************************
+// Method:    StockNewItem.
+// FullName:  StockTraceRecorder::StockNewItem.
+// Access:    public.
+// Returns:   bool (as StockSystem::StockNewItem).
+// Parameter: const StockItem& item (the new item).
+//************************************
+bool StockTraceRecorder::StockNewItem(const StockItem& item) {
+    if (fd < 0) {
+        return store.StockNewItem(item);
+    }
+    lock_guard<mutex> guard(tracelock);
+    bool status = store.StockNewItem(item);
+    TraceRecord& record = NewRecord(TRACE_NEW_ITEM, item.GetSKU());
+    memcpy(record.payload, (const void*) &item, sizeof(StockItem));
+    Finish(record, status);
+    return status;
+}
+
+
+
+//************************************
+// Method:    EditStockItemDescription.
+// FullName:  StockTraceRecorder::EditStockItemDescription.
+// Access:    public.
+// Returns:   bool (as StockSystem::EditStockItemDescription).
+// Desc:      Records the description cut the way StockItem
+//            stores it, which gives the same result on replay.
+// Parameter: unsigned int itemsku (the item's SKU).
+// Parameter: string_view desc (the new description).
+//************************************
+bool StockTraceRecorder::EditStockItemDescription(unsigned int itemsku, string_view desc) {
+    if (fd < 0) {
+        return store.EditStockItemDescription(itemsku, desc);
+    }
+    lock_guard<mutex> guard(tracelock);
+    bool status = store.EditStockItemDescription(itemsku, desc);
+    if (desc.length() > DESC_MAX_LENGTH) {
+        desc = desc.substr(0, DESC_MAX_LENGTH - 1);
+    }
+    TraceRecord& record = NewRecord(TRACE_EDIT_DESCRIPTION, itemsku);
+    record.desclength = (uint8_t) desc.length();
+    memcpy(record.payload, desc.data(), desc.length());
+    Finish(record, status);
+    return status;
+}
+
+
+
+//************************************
+// Method:    EditStockItemPrice.
+// FullName:  StockTraceRecorder::EditStockItemPrice.
+// Access:    public.
+// Returns:   bool (as StockSystem::EditStockItemPrice).
+// Parameter: unsigned int itemsku (the item's SKU).
+// Parameter: double retailprice (the new price).
+//************************************
+bool StockTraceRecorder::EditStockItemPrice(unsigned int itemsku, double retailprice) {
+    if (fd < 0) {
+        return store.EditStockItemPrice(itemsku, retailprice);
+    }
+    lock_guard<mutex> guard(tracelock);
+    bool status = store.EditStockItemPrice(itemsku, retailprice);
+    TraceRecord& record = NewRecord(TRACE_EDIT_PRICE, itemsku);
+    record.price = retailprice;
+    Finish(record, status);
+    return status;
+}
+
+
+
+//************************************
+// Method:    Restock.
+// FullName:  StockTraceRecorder::Restock.
+// Access:    public.
+// Returns:   bool (as StockSystem::Restock).
+// Parameter: unsigned int itemsku (the item's SKU).
+// Parameter: unsigned int quantity (the quantity to purchase).
+// Parameter: double unitprice (the purchase price per unit).
+//************************************
+bool StockTraceRecorder::Restock(unsigned int itemsku, unsigned int quantity, double unitprice) {
+    if (fd < 0) {
+        return store.Restock(itemsku, quantity, unitprice);
+    }
+    lock_guard<mutex> guard(tracelock);
+    bool status = store.Restock(itemsku, quantity, unitprice);
+    TraceRecord& record = NewRecord(TRACE_RESTOCK, itemsku);
+    record.quantity = quantity;
+    record.price = unitprice;
+    Finish(record, status);
+    return status;
+}
+
+
+
+//************************************
+// Method:    Sell.
+// FullName:  StockTraceRecorder::Sell.
+// Access:    public.
+// Returns:   bool (as StockSystem::Sell).
+// Parameter: unsigned int itemsku (the item's SKU).
+// Parameter: unsigned int quantity (the quantity to sell).
+//************************************
+bool StockTraceRecorder::Sell(unsigned int itemsku, unsigned int quantity) {
+    if (fd < 0) {
+        return store.Sell(itemsku, quantity);
+    }
+    lock_guard<mutex> guard(tracelock);
+    bool status = store.Sell(itemsku, quantity);
+    TraceRecord& record = NewRecord(TRACE_SELL, itemsku);
+    record.quantity = quantity;
+    Finish(record, status);
+    return status;
+}
+
+
+
+//************************************
+// Method:    GetCatalogue.
+// FullName:  StockTraceRecorder::GetCatalogue.
+// Access:    public.
+// Returns:   string (as StockSystem::GetCatalogue).
+// Desc:      Only the length and digest of the text are
+//            recorded.
+//************************************
+string StockTraceRecorder::GetCatalogue() {
+    if (fd < 0) {
+        return store.GetCatalogue();
+    }
+    lock_guard<mutex> guard(tracelock);
+    string catalogue = store.GetCatalogue();
+    TraceRecord& record = NewRecord(TRACE_GET_CATALOGUE, 0);
+    record.cataloguelength = (uint32_t) catalogue.length();
+    record.cataloguedigest = TraceDigest(catalogue);
+    Finish(record, true);
+    return catalogue;
+}
+
+
+
+//************************************
+// Method:    GetBalance.
+// FullName:  StockTraceRecorder::GetBalance.
+// Access:    public.
+// Returns:   double.
+//************************************
+double StockTraceRecorder::GetBalance() {
+    return store.GetBalance();
+}
+
+
+
+//************************************
+// Method:    TraceReader.
+// FullName:  TraceReader::TraceReader.
+// Access:    public.
+//************************************
+TraceReader::TraceReader() : map(NULL), mapsize(0) {
+}
+
+
+
+//************************************
+// Method:    ~TraceReader.
+// FullName:  TraceReader::~TraceReader.
+// Access:    public.
+//************************************
+TraceReader::~TraceReader() {
+    if (map != NULL) {
+        munmap(map, mapsize);
+    }
+}
+
+
+
+//************************************
+// Method:    Open.
+// FullName:  TraceReader::Open.
+// Access:    public.
+// Returns:   bool (false if the file cannot be read or is
+//            not a trace of this version).
+// Desc:      Unmaps the trace opened before, if any.
+// Parameter: const string& path (the trace file).
+//************************************
+bool TraceReader::Open(const string& path) {
+    if (map != NULL) {
+        munmap(map, mapsize);
+        map = NULL;
+        mapsize = 0;
+    }
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(TraceHeader)) {
+        close(fd);
+        return false;
+    }
+    mapsize = info.st_size;
+    map = mmap(NULL, mapsize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        map = NULL;
+        mapsize = 0;
+        return false;
+    }
+    madvise(map, mapsize, MADV_SEQUENTIAL);
+
+    const TraceHeader* header = static_cast<const TraceHeader*>(map);
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0 || header->version != TRACE_VERSION
+        || header->recordsize != sizeof(TraceRecord)) {
+        munmap(map, mapsize);
+        map = NULL;
+        mapsize = 0;
+        return false;
+    }
+    return true;
+}
+
+
+
+//************************************
+// Method:    Count.
+// FullName:  TraceReader::Count.
+// Access:    public.
+// Returns:   size_t.
+// Qualifier: const.
+//************************************
+size_t TraceReader::Count() const {
+    return map == NULL ? 0 : (mapsize - sizeof(TraceHeader)) / sizeof(TraceRecord);
+}
+
+
+
+//************************************
+// Method:    Records.
+// FullName:  TraceReader::Records.
+// Access:    public.
+// Returns:   const TraceRecord*.
+// Qualifier: const.
+//************************************
+const TraceRecord* TraceReader::Records() const {
+    return reinterpret_cast<const TraceRecord*>(static_cast<const char*>(map) + sizeof(TraceHeader));
+}
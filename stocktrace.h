@@ -0,0 +1,141 @@
+// File:        stocktrace.h
+// Date:        2026-10-17
+// Description: Declaration of the StockTraceRecorder and TraceReader classes,
+//              which record the calls made on a StockSystem and replay them
+
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "stockitem.h"
+#include "stocksystem.h"
+
+#define TRACE_MAGIC "STOCKTRC"
+#define TRACE_VERSION 1
+#define TRACE_BUFFER_RECORDS 1024
+
+// Calls recorded in a trace
+enum TraceOpCode {
+    TRACE_NEW_ITEM = 1, // StockNewItem(item)
+    TRACE_EDIT_DESCRIPTION, // EditStockItemDescription(itemsku, description)
+    TRACE_EDIT_PRICE, // EditStockItemPrice(itemsku, price)
+    TRACE_RESTOCK, // Restock(itemsku, quantity, price)
+    TRACE_SELL, // Sell(itemsku, quantity)
+    TRACE_GET_CATALOGUE // GetCatalogue()
+};
+
+// A trace file is a TraceHeader followed by one TraceRecord per call, in
+//   native byte order (as snapshots), so a mapped trace is read in place.
+struct TraceHeader {
+    char magic[8]; // TRACE_MAGIC, not NUL terminated
+    uint32_t version; // TRACE_VERSION
+    uint32_t recordsize; // sizeof(TraceRecord)
+};
+
+// One call with its arguments and what it returned.
+// The result fields (status, balance and, for GetCatalogue, the length and
+//   digest of the text) are compared byte for byte on replay. The catalogue
+//   text itself is not stored, so a GetCatalogue result is only checked by
+//   its length and 64 bit digest; a different text with the same length and
+//   digest would pass.
+struct TraceRecord {
+    uint8_t code; // TraceOpCode
+    uint8_t status; // the bool returned, 1 for GetCatalogue
+    uint8_t desclength; // EDIT_DESCRIPTION
+    uint8_t reserved;
+    uint32_t itemsku; // the SKU argument exactly as passed
+    uint32_t quantity; // RESTOCK and SELL
+    uint32_t cataloguelength; // GET_CATALOGUE, length of the text (low 32 bits)
+    double price; // EDIT_PRICE and RESTOCK
+    double balance; // GetBalance() after the call
+    uint64_t cataloguedigest; // GET_CATALOGUE, TraceDigest of the text
+    unsigned char payload[sizeof(StockItem)]; // NEW_ITEM: the item's bytes; EDIT_DESCRIPTION: the description as stored
+};
+
+// 64 bit FNV-1a digest of a catalogue text
+uint64_t TraceDigest(string_view text);
+
+// Makes the call of record (its arguments only) on store, and fills result
+//   with the record's arguments and the results of this call.
+void ReplayTraceRecord(StockSystem& store, const TraceRecord& record, TraceRecord& result);
+
+// true if two records of the same call have the same result bytes
+bool SameTraceResult(const TraceRecord& expected, const TraceRecord& actual);
+
+// Decorator of a StockSystem that records every call made through it.
+// While no trace is open, the calls go straight to the store.
+// The calls may come from several threads (with CONCURRENT_SALES): while
+//   recording, each call is made on the store and recorded under one lock,
+//   so the trace holds them in the order they took effect and replays to the
+//   same results. Open and Close must not run concurrently with the calls.
+class StockTraceRecorder {
+private:
+    StockSystem& store;
+    int fd; // -1 when not recording
+    mutex tracelock; // guards the store call and buffer, used and failed while recording
+    TraceRecord buffer[TRACE_BUFFER_RECORDS]; // records not written yet
+    size_t used;
+    bool failed; // a write failed, everything after it is dropped
+
+    // returns a zeroed record for a call with code
+    TraceRecord& NewRecord(TraceOpCode code, unsigned int itemsku);
+
+    // fills in the results of the record just made, and buffers it
+    void Finish(TraceRecord& record, bool status);
+
+    // writes out the buffered records
+    void Flush();
+
+public:
+    // recorder of the calls on mystore
+    explicit StockTraceRecorder(StockSystem& mystore);
+
+    // closes the trace
+    ~StockTraceRecorder();
+
+    // starts recording to a new trace at path (replacing any file there)
+    // Return false if it cannot be created.
+    bool Open(const string& path);
+
+    // writes out every record and stops recording
+    // Return false if any write failed.
+    bool Close();
+
+    // The calls of StockSystem, recorded.
+    bool StockNewItem(const StockItem& item);
+    bool EditStockItemDescription(unsigned int itemsku, string_view desc);
+    bool EditStockItemPrice(unsigned int itemsku, double retailprice);
+    bool Restock(unsigned int itemsku, unsigned int quantity, double unitprice);
+    bool Sell(unsigned int itemsku, unsigned int quantity);
+    string GetCatalogue();
+
+    // not recorded
+    double GetBalance();
+};
+
+// Maps a trace file read-only.
+class TraceReader {
+private:
+    void* map; // mapping of the whole file, or NULL
+    size_t mapsize;
+
+public:
+    TraceReader();
+
+    // unmaps the file
+    ~TraceReader();
+
+    // maps the trace at path
+    // Return false if it cannot be read, or its magic, version or record size is wrong.
+    bool Open(const string& path);
+
+    // number of whole records; a torn last record is not counted
+    size_t Count() const;
+
+    // the records, straight from the mapping
+    const TraceRecord* Records() const;
+};
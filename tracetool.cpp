@@ -0,0 +1,203 @@
+// File:        tracetool.cpp
+// Date:        2026-10-17
+// Description: Generates synthetic StockSystem traces and replays traces with result checks
+//              and latency percentiles.
+//              Usage: tracetool generate <trace> <calls> [--items N] [--skew S] [--mix M] [--seed N]
+//                     tracetool replay <trace> [tree|table|summary|versioned]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "stocksystem.h"
+#include "stocktrace.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static const char* const opNames[] = {"", "StockNewItem", "EditStockItemDescription", "EditStockItemPrice", "Restock", "Sell", "GetCatalogue"};
+
+// Prints how to call the tool and returns the exit status for a bad command line.
+static int Usage() {
+    cerr << "usage: tracetool generate <trace> <calls> [--items N] [--skew S] [--mix M] [--seed N]\n"
+        << "         --items  catalogue size, 1 to " << SKU_COUNT << " (default 10000)\n"
+        << "         --skew   Zipf exponent of the SKUs called, 0 for uniform (default 0.99)\n"
+        << "         --mix    relative weights sell:restock:price:description:catalogue (default 700:250:40:9:1)\n"
+        << "         --seed   random seed (default 1)\n"
+        << "       tracetool replay <trace> [tree|table|summary|versioned]" << endl;
+    return 2;
+}
+
+// Writes a trace of a new catalogue of items items, followed by calls calls
+//   drawn from the mix, on SKUs drawn with a Zipf skew.
+static int Generate(const char* path, int calls, int argc, char* argv[]) {
+    int items = 10000;
+    double skew = 0.99;
+    unsigned int seed = 1;
+    double weights[5] = {700, 250, 40, 9, 1};
+    for (int i = 0; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--items") == 0) {
+            items = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--skew") == 0) {
+            skew = atof(argv[i + 1]);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            seed = strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--mix") == 0) {
+            const char* field = argv[i + 1];
+            for (int w = 0; w < 5; w++) {
+                weights[w] = atof(field);
+                field = strchr(field, ':');
+                if (field == NULL && w < 4) {
+                    return Usage();
+                }
+                field = field == NULL ? "" : field + 1;
+            }
+        } else {
+            return Usage();
+        }
+    }
+    if (argc % 2 != 0 || items < 1 || items > SKU_COUNT || calls < 0 || skew < 0) {
+        return Usage();
+    }
+
+    StockSystem store;
+    StockTraceRecorder recorder(store);
+    if (!recorder.Open(path)) {
+        cerr << "Cannot create " << path << endl;
+        return 1;
+    }
+    mt19937 rng(seed);
+
+    // The SKUs are spread over the 5 digit range, and ranked for the Zipf draw in random order.
+    vector<unsigned int> skus(items);
+    for (int i = 0; i < items; i++) {
+        skus[i] = SKU_MIN + (unsigned int) ((long long) i * SKU_COUNT / items);
+        recorder.StockNewItem(StockItem(skus[i], "item " + to_string(i), (rng() % 10000) / 100.0));
+    }
+    shuffle(skus.begin(), skus.end(), rng);
+    vector<double> cumulative(items);
+    double total = 0;
+    for (int r = 0; r < items; r++) {
+        total += 1.0 / pow(r + 1, skew);
+        cumulative[r] = total;
+    }
+    uniform_real_distribution<double> pickrank(0, total);
+    discrete_distribution<int> pickop(weights, weights + 5);
+
+    for (int i = 0; i < calls; i++) {
+        int r = lower_bound(cumulative.begin(), cumulative.end(), pickrank(rng)) - cumulative.begin();
+        unsigned int sku = skus[r < items ? r : items - 1];
+        switch (pickop(rng)) {
+            case 0:
+                recorder.Sell(sku, 1 + rng() % 10);
+                break;
+            case 1:
+                recorder.Restock(sku, 1 + rng() % 200, (rng() % 500) / 100.0);
+                break;
+            case 2:
+                recorder.EditStockItemPrice(sku, (rng() % 10000) / 100.0);
+                break;
+            case 3:
+                recorder.EditStockItemDescription(sku, "renamed " + to_string(rng() % 100000));
+                break;
+            default:
+                recorder.GetCatalogue();
+                break;
+        }
+    }
+    if (!recorder.Close()) {
+        cerr << "Cannot write " << path << endl;
+        return 1;
+    }
+    cout << items + calls << " calls written to " << path << endl;
+    return 0;
+}
+
+// Replays a trace on a new store of the given engine as fast as it can,
+//   checks every result against the trace and prints latency percentiles
+//   per call. Returns 1 if any result differs.
+static int Replay(const char* path, const char* engine) {
+    StockStorage storage = TREE_STORAGE;
+    if (strcmp(engine, "table") == 0) {
+        storage = TABLE_STORAGE;
+    } else if (strcmp(engine, "summary") == 0) {
+        storage = SUMMARY_TREE_STORAGE;
+    } else if (strcmp(engine, "versioned") == 0) {
+        storage = VERSIONED_TREE_STORAGE;
+    } else if (strcmp(engine, "tree") != 0) {
+        return Usage();
+    }
+
+    TraceReader reader;
+    if (!reader.Open(path)) {
+        cerr << "Cannot read trace " << path << endl;
+        return 1;
+    }
+    const TraceRecord* records = reader.Records();
+    size_t count = reader.Count();
+    vector<vector<uint32_t> > latencies(TRACE_GET_CATALOGUE + 1); // ns, per opcode
+    StockSystem store(storage);
+    TraceRecord result;
+    size_t mismatches = 0;
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < count; i++) {
+        Clock::time_point callstart = Clock::now();
+        ReplayTraceRecord(store, records[i], result);
+        long long ns = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - callstart).count();
+        if (records[i].code >= TRACE_NEW_ITEM && records[i].code <= TRACE_GET_CATALOGUE) {
+            latencies[records[i].code].push_back((uint32_t) min<long long>(ns, UINT32_MAX));
+        }
+        if (!SameTraceResult(records[i], result)) {
+            if (++mismatches <= 10) {
+                cerr << "call " << i << " (" << (records[i].code <= TRACE_GET_CATALOGUE ? opNames[records[i].code] : "?")
+                    << "): returned " << (int) result.status << " with balance " << result.balance << ", trace has "
+                    << (int) records[i].status << " with balance " << records[i].balance << endl;
+            }
+        }
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    cout << count << " calls in " << seconds << " s, " << count / seconds << " calls/s, " << mismatches << " mismatches" << endl;
+    cout << "call\tcount\tmean\tp50\tp90\tp99\tp99.9\tmax (ns)" << endl;
+    for (int code = TRACE_NEW_ITEM; code <= TRACE_GET_CATALOGUE; code++) {
+        vector<uint32_t>& times = latencies[code];
+        if (times.empty()) {
+            continue;
+        }
+        sort(times.begin(), times.end());
+        double sum = 0;
+        for (uint32_t t : times) {
+            sum += t;
+        }
+        size_t n = times.size();
+        cout << opNames[code] << "\t" << n << "\t" << (long long) (sum / n);
+        const double percentiles[] = {0.50, 0.90, 0.99, 0.999};
+        for (double p : percentiles) {
+            cout << "\t" << times[(size_t) (p * (n - 1))];
+        }
+        cout << "\t" << times[n - 1] << endl;
+    }
+    StockStats counters = StockSystem::Stats(); // Tree counters too, when built with STOCK_STATS.
+    if (counters.enabled) {
+        counters.Write(cout);
+    }
+    return mismatches == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc >= 4 && strcmp(argv[1], "generate") == 0) {
+        return Generate(argv[2], atoi(argv[3]), argc - 4, argv + 4);
+    }
+    if (argc >= 3 && strcmp(argv[1], "replay") == 0) {
+        return Replay(argv[2], argc > 3 ? argv[3] : "tree");
+    }
+    return Usage();
+}
@@ -0,0 +1,351 @@
+// File:        wireformat.cpp
+// Date:        2026-10-17
+// Description: Implementation of the WireReader and WireReplayer classes
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "wireformat.h"
+
+// Little-endian loads and stores, one byte at a time so they work on any
+//   host and at any alignment. Compilers turn them into single moves on
+//   little-endian machines.
+static uint32_t LoadLE32(const unsigned char* bytes) {
+    return (uint32_t) bytes[0] | (uint32_t) bytes[1] << 8 | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+static double LoadLE64Double(const unsigned char* bytes) {
+    uint64_t bits = (uint64_t) LoadLE32(bytes) | (uint64_t) LoadLE32(bytes + 4) << 32;
+    double value;
+    memcpy(&value, &bits, 8);
+    return value;
+}
+
+static void StoreLE32(unsigned char* bytes, uint32_t value) {
+    bytes[0] = (unsigned char) value;
+    bytes[1] = (unsigned char) (value >> 8);
+    bytes[2] = (unsigned char) (value >> 16);
+    bytes[3] = (unsigned char) (value >> 24);
+}
+
+static void StoreLE64Double(unsigned char* bytes, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, 8);
+    StoreLE32(bytes, (uint32_t) bits);
+    StoreLE32(bytes + 4, (uint32_t) (bits >> 32));
+}
+
+//************************************
+// Method:    EncodeWireCommand.
+// FullName:  EncodeWireCommand.
+// Access:    public.
+// Returns:   void.
+// Desc:      Writes the record with its reserved and unused
+//            bytes zeroed.
+// Parameter: const WireCommand& command (the command to encode).
+// Parameter: unsigned char* record (WIRE_RECORD_SIZE bytes).
+//************************************
+void EncodeWireCommand(const WireCommand& command, unsigned char* record) {
+    size_t length = command.description.length() < WIRE_DESC_SIZE ? command.description.length() : WIRE_DESC_SIZE;
+    memset(record, 0, WIRE_RECORD_SIZE);
+    record[0] = command.code;
+    record[1] = (unsigned char) length;
+    StoreLE32(record + 4, command.itemsku);
+    StoreLE32(record + 8, command.quantity);
+    StoreLE64Double(record + 16, command.price);
+    memcpy(record + 24, command.description.data(), length);
+}
+
+
+
+//************************************
+// Method:    DecodeWireCommand.
+// FullName:  DecodeWireCommand.
+// Access:    public.
+// Returns:   void.
+// Desc:      Decodes the fixed fields; the description is a
+//            view of the record. A description length past
+//            WIRE_DESC_SIZE makes the whole record invalid,
+//            and it decodes with opcode 0.
+// Parameter: const unsigned char* record (WIRE_RECORD_SIZE bytes).
+// Parameter: WireCommand& command (receives the fields).
+//************************************
+void DecodeWireCommand(const unsigned char* record, WireCommand& command) {
+    command.code = record[1] <= WIRE_DESC_SIZE ? record[0] : 0;
+    command.itemsku = LoadLE32(record + 4);
+    command.quantity = LoadLE32(record + 8);
+    command.price = LoadLE64Double(record + 16);
+    command.description = string_view((const char*) record + 24, record[1] <= WIRE_DESC_SIZE ? record[1] : 0);
+}
+
+
+
+//************************************
+// Method:    EncodeWireResult.
+// FullName:  EncodeWireResult.
+// Access:    public.
+// Returns:   void.
+// Parameter: const WireResult& result (the result to encode).
+// Parameter: unsigned char* record (WIRE_RESULT_SIZE bytes).
+//************************************
+void EncodeWireResult(const WireResult& result, unsigned char* record) {
+    StoreLE32(record, result.sequence);
+    record[4] = result.code;
+    record[5] = result.status;
+    record[6] = 0;
+    record[7] = 0;
+    StoreLE64Double(record + 8, result.balance);
+}
+
+
+
+//************************************
+// Method:    DecodeWireResult.
+// FullName:  DecodeWireResult.
+// Access:    public.
+// Returns:   void.
+// Parameter: const unsigned char* record (WIRE_RESULT_SIZE bytes).
+// Parameter: WireResult& result (receives the fields).
+//************************************
+void DecodeWireResult(const unsigned char* record, WireResult& result) {
+    result.sequence = LoadLE32(record);
+    result.code = record[4];
+    result.status = record[5];
+    result.balance = LoadLE64Double(record + 8);
+}
+
+
+
+//************************************
+// Method:    WireReader.
+// FullName:  WireReader::WireReader.
+// Access:    public.
+//************************************
+WireReader::WireReader() : map(NULL), mapsize(0), pos(0), fd(-1), ownsfd(false), start(0), end(0), eof(true) {
+}
+
+
+
+//************************************
+// Method:    ~WireReader.
+// FullName:  WireReader::~WireReader.
+// Access:    public.
+//************************************
+WireReader::~WireReader() {
+    if (map != NULL) {
+        munmap(map, mapsize);
+    }
+    if (ownsfd) {
+        close(fd);
+    }
+}
+
+
+
+//************************************
+// Method:    Open.
+// FullName:  WireReader::Open.
+// Access:    public.
+// Returns:   bool (false if the file cannot be opened).
+// Desc:      A regular file is mapped whole and decoded in
+//            place. Anything else (a FIFO, a device) is read
+//            in blocks, as by OpenDescriptor.
+// Parameter: const string& path (the command file).
+//************************************
+bool WireReader::Open(const string& path) {
+    int filedesc = open(path.c_str(), O_RDONLY);
+    if (filedesc < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(filedesc, &info) == 0 && S_ISREG(info.st_mode)) {
+        mapsize = info.st_size;
+        pos = 0;
+        if (mapsize > 0) {
+            map = mmap(NULL, mapsize, PROT_READ, MAP_PRIVATE, filedesc, 0);
+            if (map == MAP_FAILED) {
+                map = NULL;
+                mapsize = 0;
+                close(filedesc);
+                return false;
+            }
+            madvise(map, mapsize, MADV_SEQUENTIAL);
+        }
+        close(filedesc);
+        return true;
+    }
+    OpenDescriptor(filedesc);
+    ownsfd = true;
+    return true;
+}
+
+
+
+//************************************
+// Method:    OpenDescriptor.
+// FullName:  WireReader::OpenDescriptor.
+// Access:    public.
+// Returns:   void.
+// Parameter: int filedesc (an open, readable descriptor).
+//************************************
+void WireReader::OpenDescriptor(int filedesc) {
+    fd = filedesc;
+    ownsfd = false;
+    block.resize(WIRE_BLOCK_RECORDS * WIRE_RECORD_SIZE);
+    start = 0;
+    end = 0;
+    eof = false;
+}
+
+
+
+//************************************
+// Method:    Fill.
+// FullName:  WireReader::Fill.
+// Access:    private.
+// Returns:   void.
+// Desc:      Moves the partial record left in the block to
+//            its front and reads until at least one whole
+//            record is there, or the input ends. A pipe may
+//            return less than asked for, so read is called
+//            until the block is full or would block.
+//************************************
+void WireReader::Fill() {
+    if (start > 0) {
+        memmove(block.data(), block.data() + start, end - start);
+        end -= start;
+        start = 0;
+    }
+    while (!eof && end < block.size()) {
+        ssize_t got = read(fd, block.data() + end, block.size() - end);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            eof = true;
+            break;
+        }
+        end += got;
+        if (end >= WIRE_RECORD_SIZE) {
+            break; // Enough to go on with, do not wait for a slow producer.
+        }
+    }
+}
+
+
+
+//************************************
+// Method:    Next.
+// FullName:  WireReader::Next.
+// Access:    public.
+// Returns:   bool (false at the end of the input).
+// Parameter: WireCommand& command (receives the record).
+//************************************
+bool WireReader::Next(WireCommand& command) {
+    if (fd < 0) {
+        if (map == NULL || mapsize - pos < WIRE_RECORD_SIZE) {
+            return false;
+        }
+        DecodeWireCommand(static_cast<const unsigned char*>(map) + pos, command);
+        pos += WIRE_RECORD_SIZE;
+        return true;
+    }
+    if (end - start < WIRE_RECORD_SIZE) {
+        Fill();
+        if (end - start < WIRE_RECORD_SIZE) {
+            return false;
+        }
+    }
+    DecodeWireCommand(block.data() + start, command);
+    start += WIRE_RECORD_SIZE;
+    return true;
+}
+
+
+
+//************************************
+// Method:    WireReplayer.
+// FullName:  WireReplayer::WireReplayer.
+// Access:    public.
+// Qualifier: : store(mystore), out(results), sequence(0).
+// Parameter: StockSystem& mystore (the store the commands change).
+// Parameter: CatalogueWriter* results (where the results go, or NULL).
+//************************************
+WireReplayer::WireReplayer(StockSystem& mystore, CatalogueWriter* results) : store(mystore), out(results), sequence(0) {
+}
+
+
+
+//************************************
+// Method:    Run.
+// FullName:  WireReplayer::Run.
+// Access:    public.
+// Returns:   WireStatus.
+// Desc:      Dispatches on the opcode to the public call,
+//            then writes the result record with the balance
+//            the call left.
+// Parameter: const WireCommand& command (the decoded record).
+//************************************
+WireStatus WireReplayer::Run(const WireCommand& command) {
+    bool done = false;
+    WireStatus status = WIRE_DONE;
+    switch (command.code) {
+        case WIRE_NEW_ITEM:
+            done = store.StockNewItem(StockItem(command.itemsku, command.description, command.price));
+            break;
+        case WIRE_EDIT_DESCRIPTION:
+            done = store.EditStockItemDescription(command.itemsku, command.description);
+            break;
+        case WIRE_EDIT_PRICE:
+            done = store.EditStockItemPrice(command.itemsku, command.price);
+            break;
+        case WIRE_RESTOCK:
+            done = store.Restock(command.itemsku, command.quantity, command.price);
+            break;
+        case WIRE_SELL:
+            done = store.Sell(command.itemsku, command.quantity);
+            break;
+        default:
+            status = WIRE_INVALID;
+            break;
+    }
+    if (status == WIRE_INVALID) {
+        ++stats.invalid;
+    } else {
+        ++stats.commands;
+        if (!done) {
+            status = WIRE_FAILED;
+            ++stats.failed;
+        }
+    }
+
+    if (out != NULL) {
+        WireResult result;
+        result.sequence = sequence;
+        result.code = command.code;
+        result.status = status;
+        result.balance = store.GetBalance();
+        unsigned char record[WIRE_RESULT_SIZE];
+        EncodeWireResult(result, record);
+        out->WriteText(string_view((const char*) record, WIRE_RESULT_SIZE));
+    }
+    ++sequence;
+    return status;
+}
+
+
+
+//************************************
+// Method:    Stats.
+// FullName:  WireReplayer::Stats.
+// Access:    public.
+// Returns:   const CommandStats&.
+// Qualifier: const.
+//************************************
+const CommandStats& WireReplayer::Stats() const {
+    return stats;
+}
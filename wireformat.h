@@ -0,0 +1,131 @@
+// File:        wireformat.h
+// Date:        2026-10-17
+// Description: Declaration of the WireReader and WireReplayer classes,
+//              the binary command and result records of a StockSystem
+
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "stocksystem.h"
+#include "cataloguewriter.h"
+#include "commandstream.h"
+
+#define WIRE_RECORD_SIZE 56
+#define WIRE_RESULT_SIZE 16
+#define WIRE_DESC_SIZE 32
+#define WIRE_BLOCK_RECORDS 16384 // records read from a pipe at a time
+
+// Opcodes of the command records
+enum WireOpCode {
+    WIRE_NEW_ITEM = 1, // StockNewItem(StockItem(itemsku, description, price))
+    WIRE_EDIT_DESCRIPTION, // EditStockItemDescription(itemsku, description)
+    WIRE_EDIT_PRICE, // EditStockItemPrice(itemsku, price)
+    WIRE_RESTOCK, // Restock(itemsku, quantity, price)
+    WIRE_SELL // Sell(itemsku, quantity)
+};
+
+// Status byte of a result record
+enum WireStatus {
+    WIRE_FAILED = 0, // the call returned false
+    WIRE_DONE = 1, // the call returned true
+    WIRE_INVALID = 2 // unknown opcode or description length, nothing was called
+};
+
+// One command record, decoded. Every record is WIRE_RECORD_SIZE bytes,
+//   all fields little-endian:
+//     0   u8   opcode (WireOpCode)
+//     1   u8   description length, at most WIRE_DESC_SIZE
+//     2   u16  reserved, 0
+//     4   u32  SKU
+//     8   u32  quantity (RESTOCK, SELL)
+//     12  u32  reserved, 0
+//     16  f64  price (NEW_ITEM, EDIT_PRICE, RESTOCK), IEEE 754
+//     24  32 bytes of description (NEW_ITEM, EDIT_DESCRIPTION), unused bytes 0
+// A description longer than DESC_MAX_LENGTH is cut by StockItem as usual.
+struct WireCommand {
+    unsigned char code; // a WireOpCode, unless the record is invalid
+    unsigned int itemsku;
+    unsigned int quantity;
+    double price;
+    string_view description; // points into the reader, valid until its next Next call
+};
+
+// One result record, decoded. Every result is WIRE_RESULT_SIZE bytes,
+//   little-endian:
+//     0   u32  sequence number of the command record (0 based, low 32 bits)
+//     4   u8   opcode of the command
+//     5   u8   status (WireStatus)
+//     6   u16  reserved, 0
+//     8   f64  balance after the command
+struct WireResult {
+    uint32_t sequence;
+    unsigned char code;
+    unsigned char status;
+    double balance;
+};
+
+// Encode and decode records; description must hold at most WIRE_DESC_SIZE bytes.
+void EncodeWireCommand(const WireCommand& command, unsigned char* record);
+void DecodeWireCommand(const unsigned char* record, WireCommand& command);
+void EncodeWireResult(const WireResult& result, unsigned char* record);
+void DecodeWireResult(const unsigned char* record, WireResult& result);
+
+// Reads command records from a mapped file, or from a pipe a large block
+//   at a time, and decodes them in place.
+class WireReader {
+private:
+    void* map; // mapping of the whole file, or NULL when reading blocks
+    size_t mapsize;
+    size_t pos; // offset of the next record in map
+    int fd; // descriptor read in blocks, -1 when mapped
+    bool ownsfd; // fd was opened by Open and is closed by the reader
+    vector<unsigned char> block; // records read from fd
+    size_t start; // offset of the next record in block
+    size_t end; // bytes of block filled
+    bool eof;
+
+    // refills block, keeping the partial record at its end
+    void Fill();
+
+public:
+    WireReader();
+
+    // unmaps the file, or closes the descriptor it opened
+    ~WireReader();
+
+    // maps the file at path, or reads it in blocks if it cannot be mapped (a FIFO)
+    // Return false if it cannot be opened.
+    bool Open(const string& path);
+
+    // reads an open descriptor (a pipe or stdin) in blocks; it is not closed
+    void OpenDescriptor(int filedesc);
+
+    // decodes the next record into command
+    // Return false at the end of the input; a partial last record is dropped.
+    bool Next(WireCommand& command);
+};
+
+// Applies command records to a StockSystem, each straight through the call
+//   named by its opcode, and writes a result record for each of them.
+class WireReplayer {
+private:
+    StockSystem& store;
+    CatalogueWriter* out; // NULL when the results are not wanted
+    uint32_t sequence; // of the next command
+    CommandStats stats; // invalid counts the invalid records
+
+public:
+    // replayer of commands on mystore, writing results to results if not NULL
+    WireReplayer(StockSystem& mystore, CatalogueWriter* results);
+
+    // applies one command and returns its WireStatus
+    WireStatus Run(const WireCommand& command);
+
+    // counts so far
+    const CommandStats& Stats() const;
+};